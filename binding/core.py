@@ -16,6 +16,7 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 import os
+import zlib
 from rpc import OstinatoRpcChannel, OstinatoRpcController, RpcError
 import protocols.protocol_pb2 as ost_pb
 from __init__ import __version__
@@ -65,3 +66,22 @@ class DroneProxy(object):
          os.fsync(f.fileno())
          f.close()
 
+    def saveCapture(self, port_id, file_name, compress=False):
+        # Fetches the capture file in chunks - capture need not be stopped
+        req = ost_pb.CaptureChunkRequest()
+        req.port_id.CopyFrom(port_id)
+        req.compress = compress
+        f = open(file_name, 'wb')
+        while True:
+            chunk = self.getCaptureChunk(req)
+            data = chunk.data
+            if chunk.is_compressed:
+                data = zlib.decompress(data[4:]) # skip qCompress() header
+            if not data:
+                break
+            f.write(data)
+            req.offset += len(data)
+        f.flush()
+        os.fsync(f.fileno())
+        f.close()
+
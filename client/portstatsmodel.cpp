@@ -171,6 +171,12 @@ QVariant PortStatsModel::data(const QModelIndex &index, int role) const
             case e_STAT_RX_FIFO_ERRORS: return quint64(stats.rx_fifo_errors());
             case e_STAT_RX_FRAME_ERRORS: return quint64(stats.rx_frame_errors());
 
+            case e_STAT_CAPTURE_DROPS: return quint64(stats.capture_drops());
+
+            case e_STAT_TX_LATE_PKTS: return quint64(stats.tx_late_pkts());
+            case e_STAT_TX_MAX_LATE_NSEC: 
+                return quint64(stats.tx_max_late_nsec());
+
             default:
                 qWarning("%s: Unhandled stats id %d\n", __FUNCTION__,
                         index.row());
@@ -59,7 +59,12 @@ typedef enum {
     e_STAT_RX_FIFO_ERRORS,
     e_STAT_RX_FRAME_ERRORS,
 
-    e_STATISTICS_END = e_STAT_RX_FRAME_ERRORS,
+    e_STAT_CAPTURE_DROPS,
+
+    e_STAT_TX_LATE_PKTS,
+    e_STAT_TX_MAX_LATE_NSEC,
+
+    e_STATISTICS_END = e_STAT_TX_MAX_LATE_NSEC,
 
     e_STAT_MAX
 } PortStat;
@@ -87,6 +92,11 @@ static QStringList PortStatName = (QStringList()
     << "Receive Errors"
     << "Receive Fifo Errors"
     << "Receive Frame Errors"
+
+    << "Capture Drops"
+
+    << "Transmit Late Packets"
+    << "Transmit Max Lateness (nsec)"
 );
 
 static QStringList LinkStateName = (QStringList()
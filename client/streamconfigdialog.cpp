@@ -361,6 +361,9 @@ void StreamConfigDialog::storeProtocolWidgets()
         w->storeWidget(p);
     }
     delete iter;
+
+    // Protocol sizes may have changed
+    mpStream->invalidateFrameLayout();
 }
 
 void StreamConfigDialog::on_cmbPktLenMode_currentIndexChanged(QString mode)
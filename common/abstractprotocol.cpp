@@ -19,6 +19,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "abstractprotocol.h" 
 
+#include "ipcksum.h"
+#include "ostrace.h"
+#include "prng.h"
 #include "protocollistiterator.h"
 #include "streambase.h"
 
@@ -46,7 +49,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
   - fieldCount()
   - fieldFlags()
   - fieldData()
-  - setFieldData()
+  - setProtocolFieldData()
 
   Depending on certain conditions, subclasses may need to reimplement the
   following additional methods -
@@ -56,6 +59,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
   - isProtocolFrameValueVariable()
   - isProtocolFrameSizeVariable()
   - protocolFrameVariableCount()
+  - writeFrameValue()
+  - writeFrameCksum()
 
   See the description of the methods for more information.
 
@@ -78,6 +83,7 @@ AbstractProtocol::AbstractProtocol(StreamBase *stream, AbstractProtocol *parent)
     _metaFieldCount = -1;
     _frameFieldCount = -1;
     protoSize = -1;
+    _frameLayoutIndex = -1;
     _hasPayload = true;
 }
 
@@ -305,13 +311,34 @@ QVariant AbstractProtocol::fieldData(int index, FieldAttrib attrib,
   the protocol's protoBuf.  Currently this method is called with 
   FieldAttrib = FieldValue only.
 
+  Returns true if field is successfully set, false otherwise.
+  The field is set by setProtocolFieldData() - on success, the compiled 
+  frame layout of the stream (if any) is invalidated so that the change
+  is picked up by the next frame built for the stream
+*/
+bool AbstractProtocol::setFieldData(int index, const QVariant &value,
+        FieldAttrib attrib)
+{
+    if (!setProtocolFieldData(index, value, attrib))
+        return false;
+
+    if (mpStream)
+        mpStream->invalidateFrameLayout();
+
+    return true;
+}
+
+/*! 
+  Sets the value of a field corresponding to index - called by 
+  setFieldData()
+
   Returns true if field is successfully set, false otherwise.
   The default implementation always returns false. Subclasses should 
   reimplement this method. See SampleProtocol for an example.
 
 */
-bool AbstractProtocol::setFieldData(int /*index*/, const QVariant& /*value*/,
-        FieldAttrib /*attrib*/)
+bool AbstractProtocol::setProtocolFieldData(int /*index*/, 
+        const QVariant& /*value*/, FieldAttrib /*attrib*/)
 {
     return false;
 }
@@ -361,7 +388,6 @@ quint32 AbstractProtocol::payloadProtocolId(ProtocolIdType type) const
     else
         id = 0xFFFFFFFF;
 
-    qDebug("%s: payloadProtocolId = 0x%x", __FUNCTION__, id);
     return id;
 }
 
@@ -389,7 +415,6 @@ int AbstractProtocol::protocolFrameSize(int streamIndex) const
         protoSize = (bitsize+7)/8;
     }
 
-    qDebug("%s: protoSize = %d", __FUNCTION__, protoSize);
     return protoSize;
 }
 
@@ -404,6 +429,17 @@ int AbstractProtocol::protocolFrameOffset(int streamIndex) const
 {
     int size = 0;
     AbstractProtocol *p = prev;
+
+    // Use the stream's compiled frame layout, if possible, instead of
+    // walking the protocol list
+    if (mpStream && !parent)
+    {
+        size = mpStream->protocolFrameOffset(this, streamIndex);
+        if (size >= 0)
+            return size;
+        size = 0;
+    }
+
     while (p)
     {
         size += p->protocolFrameSize(streamIndex);
@@ -413,7 +449,6 @@ int AbstractProtocol::protocolFrameOffset(int streamIndex) const
     if (parent)
         size += parent->protocolFrameOffset(streamIndex);
 
-    qDebug("%s: ofs = %d", __FUNCTION__, size);
     return size;
 }
 
@@ -427,6 +462,15 @@ int AbstractProtocol::protocolFramePayloadSize(int streamIndex) const
 {
     int size = 0;
     AbstractProtocol *p = next;
+
+    if (mpStream && !parent)
+    {
+        size = mpStream->protocolFramePayloadSize(this, streamIndex);
+        if (size >= 0)
+            return size;
+        size = 0;
+    }
+
     while (p)
     {
         size += p->protocolFrameSize(streamIndex);
@@ -435,7 +479,6 @@ int AbstractProtocol::protocolFramePayloadSize(int streamIndex) const
     if (parent)
         size += parent->protocolFramePayloadSize(streamIndex);
 
-    qDebug("%s: payloadSize = %d", __FUNCTION__, size);
     return size;
 }
 
@@ -471,9 +514,11 @@ QByteArray AbstractProtocol::protocolFrameValue(int streamIndex, bool forCksum)
             }
             else
                 field = fieldData(i, FieldFrameValue, streamIndex).toByteArray();
-            qDebug("<<< (%d, %db) %s >>>", proto.size(), lastbitpos,
+            OST_TRACE(kTraceBuild, kTraceDetail,
+                    "<<< (%d, %db) %s >>>", proto.size(), lastbitpos,
                     QString(proto.toHex()).toAscii().constData());
-            qDebug("  < %d: (%db/%dB) %s >", i, bits, field.size(),
+            OST_TRACE(kTraceBuild, kTraceDetail,
+                    "  < %d: (%db/%dB) %s >", i, bits, field.size(),
                     QString(field.toHex()).toAscii().constData());
 
             if (bits == (uint) field.size() * 8)
@@ -545,6 +590,102 @@ QByteArray AbstractProtocol::protocolFrameValue(int streamIndex, bool forCksum)
     return proto;
 }
 
+/*!
+  Encodes the protocol directly into dst - the encoding is the same as 
+  protocolFrameValue(). Returns the count of bytes in the encoding; if that
+  is more than size, the encoding is incomplete but nothing is written 
+  beyond size
+
+  This is what is used to generate the stream's frames, so protocols 
+  should reimplement it to write their fields straight into dst without 
+  any intermediate QVariant/QByteArray. The default implementation copies
+  from protocolFrameValue()
+*/
+int AbstractProtocol::writeFrameValue(uchar *dst, int size, 
+        int streamIndex) const
+{
+    QByteArray fv = protocolFrameValue(streamIndex);
+
+    if (fv.size() <= size)
+        memcpy(dst, fv.constData(), fv.size());
+
+    return fv.size();
+}
+
+/*!
+  Fills in the protocol's checksum field(s), if any, in its encoding at dst
+  (as written by writeFrameValue()) - size is the count of bytes at dst 
+  i.e. the protocol along with its payload
+
+  This is called once the entire frame has been encoded in the reverse 
+  order of protocols, so that a protocol may checksum its payload as is 
+  from the frame buffer instead of encoding it again. The default 
+  implementation does nothing
+*/
+void AbstractProtocol::writeFrameCksum(uchar* /*dst*/, int /*size*/,
+        int /*streamIndex*/) const
+{
+}
+
+/*!
+  Returns the random value for the protocol's field at fieldIndex for
+  streamIndex - see StreamBase::randomValue()
+
+  For use by fields which have a 'random' mode; the value for a given 
+  streamIndex is the same every time it is asked for
+
+  A protocol without a stream uses a seed of 0
+*/
+quint64 AbstractProtocol::randomValue(int fieldIndex, int streamIndex) const
+{
+    quint64 domain = (quint64(protocolNumber()) << 16) | quint16(fieldIndex);
+
+    if (!mpStream)
+        return prngRandom(prngRandom(0, domain), quint64(streamIndex));
+
+    return mpStream->randomValue(domain, streamIndex);
+}
+
+/*!
+  Returns the IP (one's complement) checksum of the len bytes at buf - the
+  value returned is the same as that of protocolFrameCksum(CksumIp) for 
+  those bytes
+
+  Useful for writeFrameValue() implementations to checksum the header they
+  have just written
+*/
+quint16 AbstractProtocol::ipCksum(const uchar *buf, int len)
+{
+    return quint16(~checksumIpPartial(buf, len));
+}
+
+/*!
+  Returns the TCP/UDP checksum for the protocol encoded at dst - headerSize
+  is the size of the protocol's own header (with the checksum field as 
+  zero) and size is the count of bytes at dst including the payload
+
+  The value returned is the same as protocolFrameCksum(CksumTcpUdp) but
+  the protocol and its payload are not encoded again - the payload sum
+  comes from the frame buffer (or the stream's cache, if the payload
+  doesn't vary). For use by writeFrameCksum() implementations
+*/
+quint16 AbstractProtocol::tcpUdpCksum(const uchar *dst, int headerSize, 
+        int size, int streamIndex) const
+{
+    quint16 sum, payloadSum;
+
+    sum = checksumIpPartial(dst, headerSize);
+    payloadSum = mpStream && !parent ?
+        mpStream->protocolFramePayloadPartialCksum(this, dst + headerSize,
+                size - headerSize, streamIndex) :
+        checksumIpPartial(dst + headerSize, size - headerSize);
+    sum = checksumIpAdd(sum, payloadSum, headerSize & 1);
+    sum = checksumIpAdd(sum, quint16(~protocolFrameHeaderCksum(streamIndex, 
+                    CksumIpPseudo)));
+
+    return quint16(~sum);
+}
+
 /*!
   Returns true if the protocol varies one or more of its fields at run-time,
   false otherwise
@@ -588,6 +729,40 @@ int AbstractProtocol::protocolFrameVariableCount() const
     return 1;
 }
 
+/*!
+  Returns in minSize and maxSize the smallest and largest size of the 
+  protocol across all frames of the stream
+
+  A protocol whose size is derived from the frame length - such that it
+  fills up the frame (e.g. Payload) - should set both to -1
+
+  The default implementation returns protocolFrameSize() if the protocol
+  doesn't vary its size, otherwise computes the range over 
+  protocolFrameVariableCount() frames. A subclass may reimplement if it 
+  can compute the range directly
+*/
+void AbstractProtocol::protocolFrameSizeRange(int &minSize, 
+        int &maxSize) const
+{
+    int count;
+
+    minSize = maxSize = protocolFrameSize(0);
+
+    if (!isProtocolFrameSizeVariable())
+        return;
+
+    count = protocolFrameVariableCount();
+    for (int i = 1; i < count; i++)
+    {
+        int size = protocolFrameSize(i);
+
+        if (size < minSize)
+            minSize = size;
+        if (size > maxSize)
+            maxSize = size;
+    }
+}
+
 /*!
   Returns true if the payload content for a protocol varies at run-time,
   false otherwise
@@ -598,6 +773,11 @@ int AbstractProtocol::protocolFrameVariableCount() const
 bool AbstractProtocol::isProtocolFramePayloadValueVariable() const
 {
     AbstractProtocol *p = next;
+    bool isVariable;
+
+    if (mpStream && !parent && mpStream->protocolFramePayloadVariable(
+                this, &isVariable, NULL, NULL))
+        return isVariable;
 
     while (p)
     {
@@ -621,6 +801,11 @@ bool AbstractProtocol::isProtocolFramePayloadValueVariable() const
 bool AbstractProtocol::isProtocolFramePayloadSizeVariable() const
 {
     AbstractProtocol *p = next;
+    bool isVariable;
+
+    if (mpStream && !parent && mpStream->protocolFramePayloadVariable(
+                this, NULL, &isVariable, NULL))
+        return isVariable;
 
     while (p)
     {
@@ -646,6 +831,10 @@ int AbstractProtocol::protocolFramePayloadVariableCount() const
     int count = 1;
     AbstractProtocol *p = next;
 
+    if (mpStream && !parent && mpStream->protocolFramePayloadVariable(
+                this, NULL, NULL, &count))
+        return count;
+
     while (p)
     {
         if (p->isProtocolFrameValueVariable() 
@@ -657,7 +846,7 @@ int AbstractProtocol::protocolFramePayloadVariableCount() const
                     || parent->isProtocolFramePayloadSizeVariable()))
         count = lcm(count, parent->protocolFramePayloadVariableCount());
 
-    return false;
+    return count;
 }
 
 /*!
@@ -774,7 +963,6 @@ quint32 AbstractProtocol::protocolFrameHeaderCksum(int streamIndex,
     {
         cksum = p->protocolFrameCksum(streamIndex, cksumType);
         sum += (quint16) ~cksum;
-        qDebug("%s: sum = %u, cksum = %u", __FUNCTION__, sum, cksum);
         if (cksumScope == CksumScopeAdjacentProtocol)
             goto out;
         p = p->prev;
@@ -43,12 +43,14 @@ class AbstractProtocol
     template <int protoNumber, class ProtoA, class ProtoB> 
         friend class ComboProtocol;
     friend class ProtocolListIterator;
+    friend class StreamBase;
 
 private:
     mutable int _metaFieldCount;
     mutable int _frameFieldCount;
     mutable int protoSize;
     mutable QString protoAbbr;
+    mutable int _frameLayoutIndex;
 
 protected:
     StreamBase          *mpStream; //!< Stream that this protocol belongs to
@@ -125,11 +127,17 @@ public:
     virtual FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
         int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
+    bool setFieldData(int index, const QVariant &value, 
         FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib = FieldValue);
 
     QByteArray protocolFrameValue(int streamIndex = 0,
         bool forCksum = false) const;
+    virtual int writeFrameValue(uchar *dst, int size, 
+        int streamIndex = 0) const;
+    virtual void writeFrameCksum(uchar *dst, int size,
+        int streamIndex = 0) const;
     virtual int protocolFrameSize(int streamIndex = 0) const;
     int protocolFrameOffset(int streamIndex = 0) const;
     int protocolFramePayloadSize(int streamIndex = 0) const;
@@ -137,6 +145,7 @@ public:
     virtual bool isProtocolFrameValueVariable() const;
     virtual bool isProtocolFrameSizeVariable() const;
     virtual int protocolFrameVariableCount() const;
+    virtual void protocolFrameSizeRange(int &minSize, int &maxSize) const;
     bool isProtocolFramePayloadValueVariable() const;
     bool isProtocolFramePayloadSizeVariable() const;
     int protocolFramePayloadVariableCount() const;
@@ -154,6 +163,12 @@ public:
 
     static quint64 lcm(quint64 u, quint64 v);
     static quint64 gcd(quint64 u, quint64 v);
+    static quint16 ipCksum(const uchar *buf, int len);
+
+protected:
+    quint64 randomValue(int fieldIndex, int streamIndex) const;
+    quint16 tcpUdpCksum(const uchar *dst, int headerSize, int size,
+        int streamIndex) const;
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(AbstractProtocol::FieldFlags);
 
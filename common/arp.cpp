@@ -346,7 +346,9 @@ QVariant ArpProtocol::fieldData(int index, FieldAttrib attrib,
                 case OstProto::Arp::kRandomHost:
                     subnet = data.sender_proto_addr() 
                             & data.sender_proto_addr_mask();
-                    host = (qrand() & ~data.sender_proto_addr_mask());
+                    host = (quint32(randomValue(arp_senderProtoAddr, 
+                                    streamIndex)) 
+                            & ~data.sender_proto_addr_mask());
                     protoAddr = subnet | host;
                     break;
                 default:
@@ -454,7 +456,9 @@ QVariant ArpProtocol::fieldData(int index, FieldAttrib attrib,
                 case OstProto::Arp::kRandomHost:
                     subnet = data.target_proto_addr() 
                             & data.target_proto_addr_mask();
-                    host = (qrand() & ~data.target_proto_addr_mask());
+                    host = (quint32(randomValue(arp_targetProtoAddr, 
+                                    streamIndex)) 
+                            & ~data.target_proto_addr_mask());
                     protoAddr = subnet | host;
                     break;
                 default:
@@ -605,8 +609,8 @@ QVariant ArpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool ArpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool ArpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
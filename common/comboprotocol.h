@@ -131,8 +131,8 @@ public:
         else
             return protoB->fieldData(index - cnt, attrib, streamIndex);
     }
-    virtual bool setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib = FieldValue)
+    virtual bool setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib = FieldValue)
     {
         int cnt = protoA->fieldCount();
 
@@ -142,6 +142,25 @@ public:
             return protoB->setFieldData(index - cnt, value, attrib);
     }
 
+    virtual int writeFrameValue(uchar *dst, int size, 
+        int streamIndex = 0) const
+    {
+        int len = protoA->writeFrameValue(dst, size, streamIndex);
+
+        return len + protoB->writeFrameValue(dst + len, 
+                qMax(size - len, 0), streamIndex);
+    }
+
+    virtual void writeFrameCksum(uchar *dst, int size, 
+        int streamIndex = 0) const
+    {
+        int len = protoA->protocolFrameSize(streamIndex);
+
+        if (len <= size)
+            protoB->writeFrameCksum(dst + len, size - len, streamIndex);
+        protoA->writeFrameCksum(dst, size, streamIndex);
+    }
+
 #if 0
     QByteArray protocolFrameValue(int streamIndex = 0,
         bool forCksum = false) const;
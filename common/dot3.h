@@ -54,8 +54,8 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
 
     virtual bool isProtocolFrameValueVariable() const;
     virtual int protocolFrameVariableCount() const;
@@ -155,8 +155,8 @@ QVariant Eth2Protocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool Eth2Protocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool Eth2Protocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -186,3 +186,15 @@ bool Eth2Protocol::setFieldData(int index, const QVariant &value,
     }
     return isOk;
 }
+
+int Eth2Protocol::writeFrameValue(uchar *dst, int size, int /*streamIndex*/) 
+        const
+{
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    qToBigEndian(quint16(data.is_override_type() ?
+                    data.type() : payloadProtocolId(ProtocolIdEth)), dst);
+
+    return kFrameSize;
+}
@@ -57,9 +57,14 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
+
+    virtual int writeFrameValue(uchar *dst, int size, 
+            int streamIndex = 0) const;
 private:
+    static const int kFrameSize = 2;
+
     OstProto::Eth2    data;
 };
 
@@ -555,8 +555,8 @@ QVariant GmpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool GmpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool GmpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -159,8 +159,8 @@ QVariant HexDumpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool HexDumpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool HexDumpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -209,3 +209,16 @@ int HexDumpProtocol::protocolFrameSize(int streamIndex) const
     return len;
 }
 
+/*!
+  With pad until end, the hex dump fills up the frame to the frame length
+  (like payload) - see AbstractProtocol::protocolFrameSizeRange()
+*/
+void HexDumpProtocol::protocolFrameSizeRange(int &minSize, 
+        int &maxSize) const
+{
+    if (data.pad_until_end())
+        minSize = maxSize = -1;
+    else
+        AbstractProtocol::protocolFrameSizeRange(minSize, maxSize);
+}
+
@@ -62,10 +62,11 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
 
     virtual int protocolFrameSize(int streamIndex = 0) const;
+    virtual void protocolFrameSizeRange(int &minSize, int &maxSize) const;
 
 private:
     OstProto::HexDump    data;
@@ -323,8 +323,8 @@ QVariant IcmpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool IcmpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool IcmpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
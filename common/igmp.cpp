@@ -127,7 +127,9 @@ QVariant IgmpProtocol::fieldData(int index, FieldAttrib attrib,
                 data.group_prefix(),
                 ipUtils::AddrMode(data.group_mode()),
                 data.group_count(),
-                streamIndex);
+                streamIndex,
+                data.group_mode() == OstProto::Gmp::kRandomGroup ?
+                    randomValue(kGroupAddress, streamIndex) : 0);
 
             switch(attrib)
             {
@@ -270,8 +272,8 @@ QVariant IgmpProtocol::fieldData(int index, FieldAttrib attrib,
     return GmpProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool IgmpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool IgmpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -311,7 +313,7 @@ bool IgmpProtocol::setFieldData(int index, const QVariant &value,
 
         case kGroupRecords:
         {
-            GmpProtocol::setFieldData(index, value, attrib);
+            GmpProtocol::setProtocolFieldData(index, value, attrib);
             QVariantList list = value.toList();
 
             for (int i = 0; i < list.count(); i++)
@@ -337,7 +339,7 @@ bool IgmpProtocol::setFieldData(int index, const QVariant &value,
         }
 
         default:
-            isOk = GmpProtocol::setFieldData(index, value, attrib);
+            isOk = GmpProtocol::setProtocolFieldData(index, value, attrib);
             break;
     }
 
@@ -405,36 +405,7 @@ QVariant Ip4Protocol::fieldData(int index, FieldAttrib attrib,
         }
         case ip4_srcAddr:
         {
-            int        u;
-            quint32    subnet, host, srcIp = 0;
-
-            switch(data.src_ip_mode())
-            {
-                case OstProto::Ip4::e_im_fixed:
-                    srcIp = data.src_ip();
-                    break;
-                case OstProto::Ip4::e_im_inc_host:
-                    u = streamIndex % data.src_ip_count();
-                    subnet = data.src_ip() & data.src_ip_mask();
-                    host = (((data.src_ip() & ~data.src_ip_mask()) + u) &
-                        ~data.src_ip_mask());
-                    srcIp = subnet | host;
-                    break;
-                case OstProto::Ip4::e_im_dec_host:
-                    u = streamIndex % data.src_ip_count();
-                    subnet = data.src_ip() & data.src_ip_mask();
-                    host = (((data.src_ip() & ~data.src_ip_mask()) - u) &
-                        ~data.src_ip_mask());
-                    srcIp = subnet | host;
-                    break;
-                case OstProto::Ip4::e_im_random_host:
-                    subnet = data.src_ip() & data.src_ip_mask();
-                    host = (qrand() & ~data.src_ip_mask());
-                    srcIp = subnet | host;
-                    break;
-                default:
-                    qWarning("Unhandled src_ip_mode = %d", data.src_ip_mode());
-            }
+            quint32 srcIp = srcAddress(streamIndex);
 
             switch(attrib)
             {
@@ -458,36 +429,7 @@ QVariant Ip4Protocol::fieldData(int index, FieldAttrib attrib,
         }
         case ip4_dstAddr:
         {
-            int        u;
-            quint32    subnet, host, dstIp = 0;
-
-            switch(data.dst_ip_mode())
-            {
-                case OstProto::Ip4::e_im_fixed:
-                    dstIp = data.dst_ip();
-                    break;
-                case OstProto::Ip4::e_im_inc_host:
-                    u = streamIndex % data.dst_ip_count();
-                    subnet = data.dst_ip() & data.dst_ip_mask();
-                    host = (((data.dst_ip() & ~data.dst_ip_mask()) + u) &
-                        ~data.dst_ip_mask());
-                    dstIp = subnet | host;
-                    break;
-                case OstProto::Ip4::e_im_dec_host:
-                    u = streamIndex % data.dst_ip_count();
-                    subnet = data.dst_ip() & data.dst_ip_mask();
-                    host = (((data.dst_ip() & ~data.dst_ip_mask()) - u) &
-                        ~data.dst_ip_mask());
-                    dstIp = subnet | host;
-                    break;
-                case OstProto::Ip4::e_im_random_host:
-                    subnet = data.dst_ip() & data.dst_ip_mask();
-                    host = (qrand() & ~data.dst_ip_mask());
-                    dstIp = subnet | host;
-                    break;
-                default:
-                    qWarning("Unhandled dst_ip_mode = %d", data.dst_ip_mode());
-            }
+            quint32 dstIp = dstAddress(streamIndex);
 
             switch(attrib)
             {
@@ -597,8 +539,8 @@ QVariant Ip4Protocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool Ip4Protocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool Ip4Protocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -820,12 +762,14 @@ quint32 Ip4Protocol::protocolFrameCksum(int streamIndex,
     {
         case CksumIpPseudo:
         {
+            quint32 srcIp = srcAddress(streamIndex);
+            quint32 dstIp = dstAddress(streamIndex);
             quint32 sum;
 
-            sum = fieldData(ip4_srcAddr, FieldValue, streamIndex).toUInt() >> 16;
-            sum += fieldData(ip4_srcAddr, FieldValue, streamIndex).toUInt() & 0xFFFF;
-            sum += fieldData(ip4_dstAddr, FieldValue, streamIndex).toUInt() >> 16;
-            sum += fieldData(ip4_dstAddr, FieldValue, streamIndex).toUInt() & 0xFFFF;
+            sum = srcIp >> 16;
+            sum += srcIp & 0xFFFF;
+            sum += dstIp >> 16;
+            sum += dstIp & 0xFFFF;
 
             sum += fieldData(ip4_proto, FieldValue, streamIndex).toUInt() & 0x00FF;
             sum += (fieldData(ip4_totLen, FieldValue, streamIndex).toUInt() & 0xFFFF) - 20;
@@ -844,3 +788,109 @@ quint32 Ip4Protocol::protocolFrameCksum(int streamIndex,
 
     return AbstractProtocol::protocolFrameCksum(streamIndex, cksumType);
 }
+
+int Ip4Protocol::writeFrameValue(uchar *dst, int size, int streamIndex) const
+{
+    int ver, hdrlen, totlen;
+
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    ver = data.is_override_ver() ? (data.ver_hdrlen() >> 4) & 0x0F : 4;
+    hdrlen = data.is_override_hdrlen() ? data.ver_hdrlen() & 0x0F : 5;
+    totlen = data.is_override_totlen() ? data.totlen() : 
+        (protocolFramePayloadSize(streamIndex) + 20);
+
+    dst[0] = (ver << 4) | hdrlen;
+    dst[1] = data.tos();
+    qToBigEndian(quint16(totlen), dst + 2);
+    qToBigEndian(quint16(data.id()), dst + 4);
+    qToBigEndian(quint16(((data.flags() & 0x07) << 13) 
+                | (data.frag_ofs() & 0x1FFF)), dst + 6);
+    dst[8] = data.ttl();
+    dst[9] = data.is_override_proto() ? 
+        data.proto() : payloadProtocolId(ProtocolIdIp);
+    dst[10] = dst[11] = 0;
+    qToBigEndian(srcAddress(streamIndex), dst + 12);
+    qToBigEndian(dstAddress(streamIndex), dst + 16);
+
+    // The rest of the header is in place, so checksum it right here
+    qToBigEndian(quint16(data.is_override_cksum() ? 
+                data.cksum() : ipCksum(dst, kFrameSize)), dst + 10);
+
+    return kFrameSize;
+}
+
+quint32 Ip4Protocol::srcAddress(int streamIndex) const
+{
+    int        u;
+    quint32    subnet, host, srcIp = 0;
+
+    switch(data.src_ip_mode())
+    {
+        case OstProto::Ip4::e_im_fixed:
+            srcIp = data.src_ip();
+            break;
+        case OstProto::Ip4::e_im_inc_host:
+            u = streamIndex % data.src_ip_count();
+            subnet = data.src_ip() & data.src_ip_mask();
+            host = (((data.src_ip() & ~data.src_ip_mask()) + u) &
+                ~data.src_ip_mask());
+            srcIp = subnet | host;
+            break;
+        case OstProto::Ip4::e_im_dec_host:
+            u = streamIndex % data.src_ip_count();
+            subnet = data.src_ip() & data.src_ip_mask();
+            host = (((data.src_ip() & ~data.src_ip_mask()) - u) &
+                ~data.src_ip_mask());
+            srcIp = subnet | host;
+            break;
+        case OstProto::Ip4::e_im_random_host:
+            subnet = data.src_ip() & data.src_ip_mask();
+            host = (quint32(randomValue(ip4_srcAddr, streamIndex)) 
+                    & ~data.src_ip_mask());
+            srcIp = subnet | host;
+            break;
+        default:
+            qWarning("Unhandled src_ip_mode = %d", data.src_ip_mode());
+    }
+
+    return srcIp;
+}
+
+quint32 Ip4Protocol::dstAddress(int streamIndex) const
+{
+    int        u;
+    quint32    subnet, host, dstIp = 0;
+
+    switch(data.dst_ip_mode())
+    {
+        case OstProto::Ip4::e_im_fixed:
+            dstIp = data.dst_ip();
+            break;
+        case OstProto::Ip4::e_im_inc_host:
+            u = streamIndex % data.dst_ip_count();
+            subnet = data.dst_ip() & data.dst_ip_mask();
+            host = (((data.dst_ip() & ~data.dst_ip_mask()) + u) &
+                ~data.dst_ip_mask());
+            dstIp = subnet | host;
+            break;
+        case OstProto::Ip4::e_im_dec_host:
+            u = streamIndex % data.dst_ip_count();
+            subnet = data.dst_ip() & data.dst_ip_mask();
+            host = (((data.dst_ip() & ~data.dst_ip_mask()) - u) &
+                ~data.dst_ip_mask());
+            dstIp = subnet | host;
+            break;
+        case OstProto::Ip4::e_im_random_host:
+            subnet = data.dst_ip() & data.dst_ip_mask();
+            host = (quint32(randomValue(ip4_dstAddr, streamIndex)) 
+                    & ~data.dst_ip_mask());
+            dstIp = subnet | host;
+            break;
+        default:
+            qWarning("Unhandled dst_ip_mode = %d", data.dst_ip_mode());
+    }
+
+    return dstIp;
+}
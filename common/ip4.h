@@ -82,8 +82,11 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
+
+    virtual int writeFrameValue(uchar *dst, int size, 
+            int streamIndex = 0) const;
 
     virtual bool isProtocolFrameValueVariable() const;
     virtual int protocolFrameVariableCount() const;
@@ -92,6 +95,11 @@ public:
         CksumType cksumType = CksumIp) const;
 
 private:
+    static const int kFrameSize = 20;
+
+    quint32 srcAddress(int streamIndex) const;
+    quint32 dstAddress(int streamIndex) const;
+
     OstProto::Ip4    data;
 };
 
@@ -18,6 +18,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 
 #include "ip6.h"
+
+#include "prng.h"
+
 #include <QHostAddress>
 
 
@@ -128,6 +131,64 @@ AbstractProtocol::FieldFlags Ip6Protocol::fieldFlags(int index) const
     return flags;
 }
 
+/*
+  Returns the address (as hi and lo 64 bits) for the given mode and 
+  streamIndex - random is used only for the random host mode
+*/
+static void ip6Address(OstProto::Ip6::AddrMode mode, 
+        quint64 addrHi, quint64 addrLo, int count, int prefix, 
+        int streamIndex, quint64 random, quint64 &hi, quint64 &lo)
+{
+    int u, p, q;
+    quint64 maskHi = 0, maskLo = 0;
+    quint64 prefixHi, prefixLo;
+    quint64 hostHi = 0, hostLo = 0;
+
+    hi = lo = 0;
+
+    switch(mode)
+    {
+        case OstProto::Ip6::kFixed:
+            hi = addrHi;
+            lo = addrLo;
+            break;
+        case OstProto::Ip6::kIncHost:
+        case OstProto::Ip6::kDecHost:
+        case OstProto::Ip6::kRandomHost:
+            u = streamIndex % count;
+            if (prefix > 64) {
+                p = 64;
+                q = prefix - 64;
+            } else {
+                p = prefix;
+                q = 0;
+            }
+            if (p > 0) 
+                maskHi = ~((quint64(1) << p) - 1);
+            if (q > 0) 
+                maskLo = ~((quint64(1) << q) - 1);
+            prefixHi = addrHi & maskHi;
+            prefixLo = addrLo & maskLo;
+            if (mode == OstProto::Ip6::kIncHost) {
+                hostHi = ((addrHi & ~maskHi) + u) & ~maskHi;
+                hostLo = ((addrLo & ~maskLo) + u) & ~maskLo;
+            } 
+            else if (mode == OstProto::Ip6::kDecHost) {
+                hostHi = ((addrHi & ~maskHi) - u) & ~maskHi;
+                hostLo = ((addrLo & ~maskLo) - u) & ~maskLo;
+            } 
+            else if (mode == OstProto::Ip6::kRandomHost) {
+                hostHi = random & ~maskHi;
+                hostLo = prngRandom(random, 0) & ~maskLo;
+            }
+            hi = prefixHi | hostHi;
+            lo = prefixLo | hostLo;
+            break;
+        default:
+            qWarning("Unhandled addr_mode = %d", mode);
+    }
+}
+
 QVariant Ip6Protocol::fieldData(int index, FieldAttrib attrib,
         int streamIndex) const
 {
@@ -306,54 +367,9 @@ QVariant Ip6Protocol::fieldData(int index, FieldAttrib attrib,
 
         case ip6_srcAddress:
         {
-            int u, p, q;
-            quint64 maskHi = 0, maskLo = 0;
-            quint64 prefixHi, prefixLo;
-            quint64 hostHi = 0, hostLo = 0;
-            quint64 srcHi = 0, srcLo = 0;
+            quint64 srcHi, srcLo;
 
-            switch(data.src_addr_mode())
-            {
-                case OstProto::Ip6::kFixed:
-                    srcHi = data.src_addr_hi();
-                    srcLo = data.src_addr_lo();
-                    break;
-                case OstProto::Ip6::kIncHost:
-                case OstProto::Ip6::kDecHost:
-                case OstProto::Ip6::kRandomHost:
-                    u = streamIndex % data.src_addr_count();
-                    if (data.src_addr_prefix() > 64) {
-                        p = 64;
-                        q = data.src_addr_prefix() - 64;
-                    } else {
-                        p = data.src_addr_prefix();
-                        q = 0;
-                    }
-                    if (p > 0) 
-                        maskHi = ~((quint64(1) << p) - 1);
-                    if (q > 0) 
-                        maskLo = ~((quint64(1) << q) - 1);
-                    prefixHi = data.src_addr_hi() & maskHi;
-                    prefixLo = data.src_addr_lo() & maskLo;
-                    if (data.src_addr_mode() == OstProto::Ip6::kIncHost) {
-                        hostHi = ((data.src_addr_hi() & ~maskHi) + u) & ~maskHi;
-                        hostLo = ((data.src_addr_lo() & ~maskLo) + u) & ~maskLo;
-                    } 
-                    else if (data.src_addr_mode() == OstProto::Ip6::kDecHost) {
-                        hostHi = ((data.src_addr_hi() & ~maskHi) - u) & ~maskHi;
-                        hostLo = ((data.src_addr_lo() & ~maskLo) - u) & ~maskLo;
-                    } 
-                    else if (data.src_addr_mode()==OstProto::Ip6::kRandomHost) {
-                        hostHi = qrand() & ~maskHi;
-                        hostLo = qrand() & ~maskLo;
-                    }
-                    srcHi = prefixHi | hostHi;
-                    srcLo = prefixLo | hostLo;
-                    break;
-                default:
-                    qWarning("Unhandled src_addr_mode = %d", 
-                            data.src_addr_mode());
-            }
+            srcAddress(streamIndex, srcHi, srcLo);
 
             switch(attrib)
             {
@@ -380,54 +396,9 @@ QVariant Ip6Protocol::fieldData(int index, FieldAttrib attrib,
 
         case ip6_dstAddress:
         {
-            int u, p, q;
-            quint64 maskHi = 0, maskLo = 0;
-            quint64 prefixHi, prefixLo;
-            quint64 hostHi = 0, hostLo = 0;
-            quint64 dstHi = 0, dstLo = 0;
+            quint64 dstHi, dstLo;
 
-            switch(data.dst_addr_mode())
-            {
-                case OstProto::Ip6::kFixed:
-                    dstHi = data.dst_addr_hi();
-                    dstLo = data.dst_addr_lo();
-                    break;
-                case OstProto::Ip6::kIncHost:
-                case OstProto::Ip6::kDecHost:
-                case OstProto::Ip6::kRandomHost:
-                    u = streamIndex % data.dst_addr_count();
-                    if (data.dst_addr_prefix() > 64) {
-                        p = 64;
-                        q = data.dst_addr_prefix() - 64;
-                    } else {
-                        p = data.dst_addr_prefix();
-                        q = 0;
-                    }
-                    if (p > 0) 
-                        maskHi = ~((quint64(1) << p) - 1);
-                    if (q > 0) 
-                        maskLo = ~((quint64(1) << q) - 1);
-                    prefixHi = data.dst_addr_hi() & maskHi;
-                    prefixLo = data.dst_addr_lo() & maskLo;
-                    if (data.dst_addr_mode() == OstProto::Ip6::kIncHost) {
-                        hostHi = ((data.dst_addr_hi() & ~maskHi) + u) & ~maskHi;
-                        hostLo = ((data.dst_addr_lo() & ~maskLo) + u) & ~maskLo;
-                    } 
-                    else if (data.dst_addr_mode() == OstProto::Ip6::kDecHost) {
-                        hostHi = ((data.dst_addr_hi() & ~maskHi) - u) & ~maskHi;
-                        hostLo = ((data.dst_addr_lo() & ~maskLo) - u) & ~maskLo;
-                    } 
-                    else if (data.dst_addr_mode()==OstProto::Ip6::kRandomHost) {
-                        hostHi = qrand() & ~maskHi;
-                        hostLo = qrand() & ~maskLo;
-                    }
-                    dstHi = prefixHi | hostHi;
-                    dstLo = prefixLo | hostLo;
-                    break;
-                default:
-                    qWarning("Unhandled dst_addr_mode = %d", 
-                            data.dst_addr_mode());
-            }
+            dstAddress(streamIndex, dstHi, dstLo);
 
             switch(attrib)
             {
@@ -563,8 +534,8 @@ QVariant Ip6Protocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool Ip6Protocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool Ip6Protocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -776,20 +747,16 @@ quint32 Ip6Protocol::protocolFrameCksum(int streamIndex,
 {
     if (cksumType == CksumIpPseudo)
     {
-        QByteArray addr;
+        quint64 addr[4];
         quint32 sum = 0;
 
-        addr = fieldData(ip6_srcAddress, FieldFrameValue, streamIndex)
-                .toByteArray();
-        Q_ASSERT(addr.size() == 16);
-        for (int i = 0; i < addr.size(); i+=2)
-            sum += (quint8(addr.at(i)) << 8) + quint8(addr.at(i+1));
-
-        addr = fieldData(ip6_dstAddress, FieldFrameValue, streamIndex)
-                .toByteArray();
-        Q_ASSERT(addr.size() == 16);
-        for (int i = 0; i < addr.size(); i+=2)
-            sum += (quint8(addr.at(i)) << 8) + quint8(addr.at(i+1));
+        srcAddress(streamIndex, addr[0], addr[1]);
+        dstAddress(streamIndex, addr[2], addr[3]);
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 64; j += 16)
+                sum += (addr[i] >> j) & 0xFFFF;
+        }
 
         sum += fieldData(ip6_payloadLength, FieldValue, streamIndex)
                 .toUInt() & 0xFFFF;
@@ -804,3 +771,50 @@ quint32 Ip6Protocol::protocolFrameCksum(int streamIndex,
     return AbstractProtocol::protocolFrameCksum(streamIndex, cksumType);
 }
 
+int Ip6Protocol::writeFrameValue(uchar *dst, int size, int streamIndex) const
+{
+    quint32 ver;
+    quint64 hi, lo;
+
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    ver = data.is_override_version() ? data.version() & 0xF : 0x6;
+    qToBigEndian(quint32((ver << 28) 
+                | ((data.traffic_class() & 0xFF) << 20)
+                | (data.flow_label() & 0xFFFFF)), dst);
+    qToBigEndian(quint16(data.is_override_payload_length() ?
+                data.payload_length() : protocolFramePayloadSize(streamIndex)),
+            dst + 4);
+    dst[6] = data.is_override_next_header() ? 
+        data.next_header() : payloadProtocolId(ProtocolIdIp);
+    dst[7] = data.hop_limit() & 0xFF;
+
+    srcAddress(streamIndex, hi, lo);
+    qToBigEndian(hi, dst + 8);
+    qToBigEndian(lo, dst + 16);
+
+    dstAddress(streamIndex, hi, lo);
+    qToBigEndian(hi, dst + 24);
+    qToBigEndian(lo, dst + 32);
+
+    return kFrameSize;
+}
+
+void Ip6Protocol::srcAddress(int streamIndex, quint64 &hi, quint64 &lo) const
+{
+    ip6Address(data.src_addr_mode(), data.src_addr_hi(), data.src_addr_lo(),
+            data.src_addr_count(), data.src_addr_prefix(), streamIndex,
+            data.src_addr_mode() == OstProto::Ip6::kRandomHost ?
+                randomValue(ip6_srcAddress, streamIndex) : 0,
+            hi, lo);
+}
+
+void Ip6Protocol::dstAddress(int streamIndex, quint64 &hi, quint64 &lo) const
+{
+    ip6Address(data.dst_addr_mode(), data.dst_addr_hi(), data.dst_addr_lo(),
+            data.dst_addr_count(), data.dst_addr_prefix(), streamIndex,
+            data.dst_addr_mode() == OstProto::Ip6::kRandomHost ?
+                randomValue(ip6_dstAddress, streamIndex) : 0,
+            hi, lo);
+}
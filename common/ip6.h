@@ -97,8 +97,11 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
+
+    virtual int writeFrameValue(uchar *dst, int size, 
+            int streamIndex = 0) const;
 
     virtual bool isProtocolFrameValueVariable() const;
     virtual int protocolFrameVariableCount() const;
@@ -106,6 +109,11 @@ public:
     virtual quint32 protocolFrameCksum(int streamIndex = 0,
             CksumType cksumType = CksumIp) const;
 private:
+    static const int kFrameSize = 40;
+
+    void srcAddress(int streamIndex, quint64 &hi, quint64 &lo) const;
+    void dstAddress(int streamIndex, quint64 &hi, quint64 &lo) const;
+
     OstProto::Ip6 data;
 };
 
@@ -0,0 +1,181 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "ipcksum.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+    && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define IPCKSUM_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+  The one's complement sum is independent of byte order (RFC 1071) - so all
+  the kernels below add up native order 16-bit words into a wide 
+  accumulator and the folded sum is swapped into network order at the end.
+
+  Each SIMD kernel consumes whole vectors only and returns the count of
+  bytes consumed; the remaining bytes are summed by the generic kernel
+*/
+
+static quint64 sumGeneric(const quint8 *buf, uint len)
+{
+    quint64 sum = 0;
+    quint16 w;
+
+    while (len > 1)
+    {
+        memcpy(&w, buf, 2);
+        sum += w;
+        buf += 2;
+        len -= 2;
+    }
+
+    if (len)
+    {
+        quint8 last[2] = { buf[0], 0 };
+
+        memcpy(&w, last, 2);
+        sum += w;
+    }
+
+    return sum;
+}
+
+#ifdef IPCKSUM_X86_DISPATCH
+
+// 32-bit lanes are reduced into the 64-bit sum after every kBlock vectors;
+// each lane gets at most 2*kBlock 16-bit words added per block
+static const uint kBlock = 16384;
+
+__attribute__((target("sse2")))
+static uint sumSse2(const quint8 *buf, uint len, quint64 &sum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint n = len / 16;
+
+    while (n)
+    {
+        uint count = qMin(n, kBlock);
+        quint32 lane[4];
+        __m128i acc = zero;
+
+        for (uint i = 0; i < count; i++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) buf);
+
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            buf += 16;
+        }
+
+        _mm_storeu_si128((__m128i*) lane, acc);
+        sum += quint64(lane[0]) + lane[1] + lane[2] + lane[3];
+        n -= count;
+    }
+
+    return len & ~15U;
+}
+
+__attribute__((target("avx2")))
+static uint sumAvx2(const quint8 *buf, uint len, quint64 &sum)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint n = len / 32;
+
+    while (n)
+    {
+        uint count = qMin(n, kBlock);
+        quint32 lane[8];
+        __m256i acc = zero;
+
+        for (uint i = 0; i < count; i++)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*) buf);
+
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+            buf += 32;
+        }
+
+        _mm256_storeu_si256((__m256i*) lane, acc);
+        for (int i = 0; i < 8; i++)
+            sum += lane[i];
+        n -= count;
+    }
+
+    return len & ~31U;
+}
+
+typedef uint (*SumKernel)(const quint8 *buf, uint len, quint64 &sum);
+
+static uint sumNone(const quint8* /*buf*/, uint /*len*/, quint64& /*sum*/)
+{
+    return 0;
+}
+
+static SumKernel selectKernel()
+{
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return sumAvx2;
+    if (__builtin_cpu_supports("sse2"))
+        return sumSse2;
+
+    return sumNone;
+}
+
+// Selected once at startup as per the CPU we are running on
+static SumKernel sumVector = selectKernel();
+
+#endif
+
+/*!
+  Returns the (folded, but not complemented) one's complement sum of the
+  16-bit words in buffer in network byte order - the IP checksum of the 
+  buffer is the complement of this value
+
+  Partial sums of adjacent buffers may be combined with checksumIpAdd()
+*/
+quint16 checksumIpPartial(const quint8 *buffer, uint length)
+{
+    quint64 sum = 0;
+    quint16 folded;
+
+#ifdef IPCKSUM_X86_DISPATCH
+    uint done = sumVector(buffer, length, sum);
+
+    buffer += done;
+    length -= done;
+#endif
+    sum += sumGeneric(buffer, length);
+
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    folded = quint16(sum);
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    folded = quint16((folded << 8) | (folded >> 8));
+#endif
+
+    return folded;
+}
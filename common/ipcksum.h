@@ -0,0 +1,43 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _IP_CKSUM_H
+#define _IP_CKSUM_H
+
+#include <QtGlobal>
+
+quint16 checksumIpPartial(const quint8 *buffer, uint length);
+
+/*!
+  Adds two partial IP checksums - sum2 is the partial checksum of bytes
+  that start at an odd offset w.r.t. those of sum1 if isOddOffset is true
+*/
+inline quint16 checksumIpAdd(quint16 sum1, quint16 sum2, 
+        bool isOddOffset = false)
+{
+    quint32 sum;
+
+    if (isOddOffset)
+        sum2 = quint16((sum2 << 8) | (sum2 >> 8));
+
+    sum = quint32(sum1) + sum2;
+    return quint16((sum & 0xFFFF) + (sum >> 16));
+}
+
+#endif
@@ -106,27 +106,7 @@ QVariant MacProtocol::fieldData(int index, FieldAttrib attrib,
     {
         case mac_dstAddr:
         {
-            int u;
-            quint64 dstMac = 0;
-
-            switch (data.dst_mac_mode())
-            {
-                case OstProto::Mac::e_mm_fixed:
-                    dstMac = data.dst_mac();
-                    break;
-                case OstProto::Mac::e_mm_inc:
-                    u = (streamIndex % data.dst_mac_count()) * 
-                        data.dst_mac_step(); 
-                    dstMac = data.dst_mac() + u;
-                    break;
-                case OstProto::Mac::e_mm_dec:
-                    u = (streamIndex % data.dst_mac_count()) * 
-                        data.dst_mac_step(); 
-                    dstMac = data.dst_mac() - u;
-                    break;
-                default:
-                    qWarning("Unhandled dstMac_mode %d", data.dst_mac_mode());
-            }
+            quint64 dstMac = dstMacAddress(streamIndex);
 
             switch(attrib)
             {
@@ -151,27 +131,7 @@ QVariant MacProtocol::fieldData(int index, FieldAttrib attrib,
         }
         case mac_srcAddr:
         {
-            int u;
-            quint64 srcMac = 0;
-
-            switch (data.src_mac_mode())
-            {
-                case OstProto::Mac::e_mm_fixed:
-                    srcMac = data.src_mac();
-                    break;
-                case OstProto::Mac::e_mm_inc:
-                    u = (streamIndex % data.src_mac_count()) * 
-                        data.src_mac_step(); 
-                    srcMac = data.src_mac() + u;
-                    break;
-                case OstProto::Mac::e_mm_dec:
-                    u = (streamIndex % data.src_mac_count()) * 
-                        data.src_mac_step(); 
-                    srcMac = data.src_mac() - u;
-                    break;
-                default:
-                    qWarning("Unhandled srcMac_mode %d", data.src_mac_mode());
-            }
+            quint64 srcMac = srcMacAddress(streamIndex);
 
             switch(attrib)
             {
@@ -245,8 +205,23 @@ QVariant MacProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool MacProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+int MacProtocol::writeFrameValue(uchar *dst, int size, int streamIndex) const
+{
+    uchar mac[8];
+
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    qToBigEndian(dstMacAddress(streamIndex), mac);
+    memcpy(dst, mac + 2, 6);
+    qToBigEndian(srcMacAddress(streamIndex), mac);
+    memcpy(dst + 6, mac + 2, 6);
+
+    return kFrameSize;
+}
+
+bool MacProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -349,3 +324,52 @@ int MacProtocol::protocolFrameVariableCount() const
     return count;
 }
 
+quint64 MacProtocol::dstMacAddress(int streamIndex) const
+{
+    int u;
+    quint64 dstMac = 0;
+
+    switch (data.dst_mac_mode())
+    {
+        case OstProto::Mac::e_mm_fixed:
+            dstMac = data.dst_mac();
+            break;
+        case OstProto::Mac::e_mm_inc:
+            u = (streamIndex % data.dst_mac_count()) * data.dst_mac_step(); 
+            dstMac = data.dst_mac() + u;
+            break;
+        case OstProto::Mac::e_mm_dec:
+            u = (streamIndex % data.dst_mac_count()) * data.dst_mac_step(); 
+            dstMac = data.dst_mac() - u;
+            break;
+        default:
+            qWarning("Unhandled dstMac_mode %d", data.dst_mac_mode());
+    }
+
+    return dstMac;
+}
+
+quint64 MacProtocol::srcMacAddress(int streamIndex) const
+{
+    int u;
+    quint64 srcMac = 0;
+
+    switch (data.src_mac_mode())
+    {
+        case OstProto::Mac::e_mm_fixed:
+            srcMac = data.src_mac();
+            break;
+        case OstProto::Mac::e_mm_inc:
+            u = (streamIndex % data.src_mac_count()) * data.src_mac_step(); 
+            srcMac = data.src_mac() + u;
+            break;
+        case OstProto::Mac::e_mm_dec:
+            u = (streamIndex % data.src_mac_count()) * data.src_mac_step(); 
+            srcMac = data.src_mac() - u;
+            break;
+        default:
+            qWarning("Unhandled srcMac_mode %d", data.src_mac_mode());
+    }
+
+    return srcMac;
+}
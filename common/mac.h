@@ -60,13 +60,21 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
+
+    virtual int writeFrameValue(uchar *dst, int size, 
+            int streamIndex = 0) const;
 
     virtual bool isProtocolFrameValueVariable() const;
     virtual int protocolFrameVariableCount() const;
 
 private:
+    static const int kFrameSize = 12;
+
+    quint64 dstMacAddress(int streamIndex) const;
+    quint64 srcMacAddress(int streamIndex) const;
+
     OstProto::Mac    data;
 };
 
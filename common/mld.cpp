@@ -187,6 +187,8 @@ QVariant MldProtocol::fieldData(int index, FieldAttrib attrib,
                     ipUtils::AddrMode(data.group_mode()),
                     data.group_count(),
                     streamIndex,
+                    data.group_mode() == OstProto::Gmp::kRandomGroup ?
+                        randomValue(kGroupAddress, streamIndex) : 0,
                     grpHi, 
                     grpLo);
 
@@ -389,8 +391,8 @@ QVariant MldProtocol::fieldData(int index, FieldAttrib attrib,
     return GmpProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool MldProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool MldProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -462,7 +464,7 @@ bool MldProtocol::setFieldData(int index, const QVariant &value,
 
         case kGroupRecords:
         {
-            GmpProtocol::setFieldData(index, value, attrib);
+            GmpProtocol::setProtocolFieldData(index, value, attrib);
             QVariantList list = value.toList();
 
             for (int i = 0; i < list.count(); i++)
@@ -529,7 +531,7 @@ bool MldProtocol::setFieldData(int index, const QVariant &value,
         }
 
         default:
-            isOk = GmpProtocol::setFieldData(index, value, attrib);
+            isOk = GmpProtocol::setProtocolFieldData(index, value, attrib);
             break;
     }
 
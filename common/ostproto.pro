@@ -77,6 +77,7 @@ HEADERS += \
 SOURCES = \
     abstractprotocol.cpp \
     crc32c.cpp \
+    ipcksum.cpp \
     protocolmanager.cpp \
     protocollist.cpp \
     protocollistiterator.cpp \
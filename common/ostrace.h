@@ -0,0 +1,159 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _OST_TRACE_H
+#define _OST_TRACE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QtGlobal>
+
+/*
+  Tracing for hot paths (per packet, per field, per rpc message)
+
+  Trace points are compiled in only upto OST_TRACE_LEVEL - by default
+  kTraceInfo for debug builds and kTraceOff for release builds, so that
+  a release build neither formats nor evaluates the arguments of any
+  trace point. Build with DEFINES+=OST_TRACE_LEVEL=2 for kTraceDetail.
+
+  Compiled in trace points may be enabled and sampled at run-time per
+  category using the OST_TRACE environment variable - a comma separated
+  list of category[:N] e.g. "build,tx:1000" prints all build traces and
+  every 1000th tx trace; "none" disables all. If not set, all categories
+  are enabled without sampling.
+
+  Every compiled in trace point counts an event for its category, whether
+  or not it is printed - see ostTraceDump(). Trace points are hit from
+  multiple threads (rpc, build, tx, rx), so counts are atomic; the 32 bit
+  counts wrap around and are for diagnostics only
+*/
+
+enum OstTraceLevel {
+    kTraceOff = 0,
+    kTraceInfo = 1,     // once per stream/port/request
+    kTraceDetail = 2    // per packet, per field or per rpc message
+};
+
+enum OstTraceCategory {
+    kTraceBuild = 0,    // packet list/frame building
+    kTraceTx,
+    kTraceRx,
+    kTraceRpc,
+
+    kTraceCategoryCount
+};
+
+#ifndef OST_TRACE_LEVEL
+#ifdef QT_NO_DEBUG
+#define OST_TRACE_LEVEL 0
+#else
+#define OST_TRACE_LEVEL 1
+#endif
+#endif
+
+inline const char* ostTraceCategoryName(int category)
+{
+    static const char *names[kTraceCategoryCount] = {
+        "build", "tx", "rx", "rpc"
+    };
+
+    return names[category];
+}
+
+struct OstTraceState {
+    bool enabled;
+    quint32 sampleRate;
+    QAtomicInt count;
+};
+
+inline bool ostTraceInit(OstTraceState *state)
+{
+    QByteArray env = qgetenv("OST_TRACE");
+
+    for (int i = 0; i < kTraceCategoryCount; i++)
+    {
+        state[i].enabled = env.isNull();
+        state[i].sampleRate = 1;
+        state[i].count = 0;
+    }
+
+    if (env.isNull())
+        return true;
+
+    QList<QByteArray> items = env.split(',');
+    for (int j = 0; j < items.size(); j++)
+    {
+        QList<QByteArray> item = items.at(j).trimmed().split(':');
+
+        for (int i = 0; i < kTraceCategoryCount; i++)
+        {
+            if (item.at(0) != ostTraceCategoryName(i))
+                continue;
+
+            state[i].enabled = true;
+            if (item.size() > 1 && item.at(1).toUInt() > 0)
+                state[i].sampleRate = item.at(1).toUInt();
+        }
+    }
+
+    return true;
+}
+
+inline OstTraceState* ostTraceState()
+{
+    static OstTraceState state[kTraceCategoryCount];
+    static bool isInit = ostTraceInit(state);
+
+    Q_UNUSED(isInit);
+    return state;
+}
+
+/*
+  Counts an event for category and returns true if it is to be traced
+*/
+inline bool ostTraceSample(OstTraceCategory category)
+{
+    OstTraceState &s = ostTraceState()[category];
+    quint32 n = quint32(s.count.fetchAndAddRelaxed(1));
+
+    return s.enabled && ((n % s.sampleRate) == 0);
+}
+
+#define OST_TRACE(category, level, ...)                                 \
+    do {                                                                \
+        if (((level) <= OST_TRACE_LEVEL) && ostTraceSample(category))   \
+            qDebug(__VA_ARGS__);                                        \
+    } while (0)
+
+/*
+  Prints the event counts of all categories
+*/
+inline void ostTraceDump()
+{
+#if OST_TRACE_LEVEL > 0
+    for (int i = 0; i < kTraceCategoryCount; i++)
+        qDebug("trace %s: events = %u (enabled = %d, sample = 1/%u)",
+                ostTraceCategoryName(i), 
+                quint32(int(ostTraceState()[i].count)),
+                ostTraceState()[i].enabled, ostTraceState()[i].sampleRate);
+#endif
+}
+
+#endif
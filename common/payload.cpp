@@ -18,8 +18,118 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 
 #include "payload.h"
+#include "prng.h"
 #include "streambase.h"
 
+#include <QHash>
+#include <QMutex>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const int kPatternPageSize = 65536;
+static const int kMaxPatternPages = 64;
+
+/*
+  Fills len bytes at dst with the (non-random) data pattern - 16 bytes per
+  step if SSE2 is available
+*/
+static void fillPattern(uchar *dst, int len, 
+        OstProto::Payload::DataPatternMode mode, quint32 pattern)
+{
+    uchar word[4];
+    int i = 0;
+
+    qToBigEndian(pattern, word);
+
+#ifdef __SSE2__
+    __m128i v, step;
+    quint32 w;
+
+    switch(mode)
+    {
+        case OstProto::Payload::e_dp_fixed_word:
+            memcpy(&w, word, 4);
+            v = _mm_set1_epi32(int(w));
+            step = _mm_setzero_si128();
+            break;
+        case OstProto::Payload::e_dp_inc_byte:
+            v = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 
+                    8, 9, 10, 11, 12, 13, 14, 15);
+            step = _mm_set1_epi8(16);
+            break;
+        case OstProto::Payload::e_dp_dec_byte:
+            v = _mm_setr_epi8(-1, -2, -3, -4, -5, -6, -7, -8, 
+                    -9, -10, -11, -12, -13, -14, -15, -16);
+            step = _mm_set1_epi8(-16);
+            break;
+        default:
+            return;
+    }
+
+    for (; (i + 16) <= len; i += 16)
+    {
+        _mm_storeu_si128((__m128i*) (dst + i), v);
+        v = _mm_add_epi8(v, step);
+    }
+#endif
+
+    // Remaining bytes (all of them, if no SSE2)
+    switch(mode)
+    {
+        case OstProto::Payload::e_dp_fixed_word:
+            for (; i < len; i++)
+                dst[i] = word[i & 0x3];
+            break;
+        case OstProto::Payload::e_dp_inc_byte:
+            for (; i < len; i++)
+                dst[i] = i & 0xFF;
+            break;
+        case OstProto::Payload::e_dp_dec_byte:
+            for (; i < len; i++)
+                dst[i] = 0xFF - (i & 0xFF);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+  Returns a precomputed 64KB page of the (non-random) data pattern - a 
+  payload of any length upto the page size is just a slice of the page
+
+  Pages are implicitly shared by all payload protocols with the same 
+  pattern, so streams don't cost 64KB each
+*/
+static QByteArray patternPage(OstProto::Payload::DataPatternMode mode, 
+        quint32 pattern)
+{
+    static QMutex mutex;
+    static QHash<quint64, QByteArray> pages;
+    QMutexLocker locker(&mutex);
+    QByteArray page;
+    quint64 key;
+
+    if (mode != OstProto::Payload::e_dp_fixed_word)
+        pattern = 0;
+    key = (quint64(mode) << 32) | pattern;
+
+    page = pages.value(key);
+    if (page.isEmpty())
+    {
+        page.resize(kPatternPageSize);
+        fillPattern((uchar*) page.data(), page.size(), mode, pattern);
+
+        // Pages in use are not freed since they are shared
+        if (pages.size() >= kMaxPatternPages)
+            pages.clear();
+        pages.insert(key, page);
+    }
+
+    return page;
+}
+
 PayloadProtocol::PayloadProtocol(StreamBase *stream, AbstractProtocol *parent)
     : AbstractProtocol(stream, parent)
 {
@@ -51,6 +161,7 @@ void PayloadProtocol::protoDataCopyFrom(const OstProto::Protocol &protocol)
     if (protocol.protocol_id().id() == protocolNumber() &&
             protocol.HasExtension(OstProto::payload))
         data.MergeFrom(protocol.GetExtension(OstProto::payload));
+    patternPage_.clear();
 }
 
 QString PayloadProtocol::name() const
@@ -73,8 +184,6 @@ int PayloadProtocol::protocolFrameSize(int streamIndex) const
     if (len < 0)
         len = 0;
 
-    qDebug("%s: this = %p, streamIndex = %d, len = %d", __FUNCTION__, this,
-            streamIndex, len);
     return len;
 }
 
@@ -130,32 +239,8 @@ QVariant PayloadProtocol::fieldData(int index, FieldAttrib attrib,
                     if (dataLen <= 0)
                         dataLen = 1;
 
-                    fv.resize(dataLen+4);
-                    switch(data.pattern_mode())
-                    {
-                        case OstProto::Payload::e_dp_fixed_word:
-                            for (int i = 0; i < (dataLen/4)+1; i++)
-                                qToBigEndian((quint32) data.pattern(), 
-                                    (uchar*)(fv.data()+(i*4)) );
-                            break;
-                        case OstProto::Payload::e_dp_inc_byte:
-                            for (int i = 0; i < dataLen; i++)
-                                fv[i] = i % (0xFF + 1);
-                            break;
-                        case OstProto::Payload::e_dp_dec_byte:
-                            for (int i = 0; i < dataLen; i++)
-                                fv[i] = 0xFF - (i % (0xFF + 1));
-                            break;
-                        case OstProto::Payload::e_dp_random:
-                            //! \todo (HIGH) cksum is incorrect for random pattern
-                            for (int i = 0; i < dataLen; i++)
-                                fv[i] =  qrand() % (0xFF + 1);
-                            break;
-                        default:
-                            qWarning("Unhandled data pattern %d", 
-                                data.pattern_mode());
-                    }
                     fv.resize(dataLen);
+                    writePattern((uchar*) fv.data(), dataLen, streamIndex);
                     return fv;
                 }
                 default:
@@ -179,8 +264,8 @@ QVariant PayloadProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool PayloadProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool PayloadProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -210,9 +295,51 @@ bool PayloadProtocol::setFieldData(int index, const QVariant &value,
                 index);
         break;
     }
+
+    if (isOk)
+        patternPage_.clear();
     return isOk;
 }
 
+int PayloadProtocol::writeFrameValue(uchar *dst, int size, 
+        int streamIndex) const
+{
+    int dataLen = protocolFrameSize(streamIndex);
+
+    if (dataLen > size)
+        return dataLen;
+
+    writePattern(dst, dataLen, streamIndex);
+
+    return dataLen;
+}
+
+void PayloadProtocol::writePattern(uchar *dst, int len, int streamIndex) const
+{
+    switch(data.pattern_mode())
+    {
+        case OstProto::Payload::e_dp_fixed_word:
+        case OstProto::Payload::e_dp_inc_byte:
+        case OstProto::Payload::e_dp_dec_byte:
+            if (len > kPatternPageSize)
+            {
+                fillPattern(dst, len, data.pattern_mode(), data.pattern());
+                break;
+            }
+            if (patternPage_.isEmpty())
+                patternPage_ = patternPage(data.pattern_mode(), 
+                                    data.pattern());
+            memcpy(dst, patternPage_.constData(), len);
+            break;
+        case OstProto::Payload::e_dp_random:
+            prngFill(randomValue(payload_dataPattern, streamIndex), 
+                    dst, len);
+            break;
+        default:
+            qWarning("Unhandled data pattern %d", data.pattern_mode());
+    }
+}
+
 bool PayloadProtocol::isProtocolFrameValueVariable() const
 {
     if (isProtocolFrameSizeVariable() 
@@ -256,3 +383,13 @@ int PayloadProtocol::protocolFrameVariableCount() const
 
     return count;
 }
+
+/*!
+  Payload fills up the frame to the frame length - see 
+  AbstractProtocol::protocolFrameSizeRange()
+*/
+void PayloadProtocol::protocolFrameSizeRange(int &minSize, 
+        int &maxSize) const
+{
+    minSize = maxSize = -1;
+}
@@ -57,15 +57,23 @@ public:
     virtual AbstractProtocol::FieldFlags fieldFlags(int index) const;
     virtual QVariant fieldData(int index, FieldAttrib attrib,
                int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
+
+    virtual int writeFrameValue(uchar *dst, int size, 
+            int streamIndex = 0) const;
 
     virtual bool isProtocolFrameValueVariable() const;
     virtual bool isProtocolFrameSizeVariable() const;
     virtual int protocolFrameVariableCount() const;
+    virtual void protocolFrameSizeRange(int &minSize, int &maxSize) const;
 
 private:
+    void writePattern(uchar *dst, int len, int streamIndex) const;
+
     OstProto::Payload            data;
+
+    mutable QByteArray patternPage_; // shared, see patternPage()
 };
 
 #endif
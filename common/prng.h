@@ -0,0 +1,66 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _PRNG_H
+#define _PRNG_H
+
+#include <QtGlobal>
+
+#include <string.h>
+
+/*
+  Counter based pseudo random number generator - the SplitMix64 output 
+  function applied to (key, counter). Unlike qrand(), there's no state: 
+  the random value for any counter is computed in constant time, so a 
+  frame's random values depend only on the key and the frame index and 
+  not on which (or how many) frames were generated before it
+*/
+
+inline quint64 prngRandom(quint64 key, quint64 counter)
+{
+    quint64 z = key + (counter + 1) * Q_UINT64_C(0x9E3779B97F4A7C15);
+
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/*
+  Fills len bytes at dst with the random sequence for key - 8 bytes
+  per step
+*/
+inline void prngFill(quint64 key, uchar *dst, int len)
+{
+    quint64 r;
+    int i;
+
+    for (i = 0; (i + 8) <= len; i += 8)
+    {
+        r = prngRandom(key, i >> 3);
+        memcpy(dst + i, &r, 8);
+    }
+
+    if (i < len)
+    {
+        r = prngRandom(key, i >> 3);
+        memcpy(dst + i, &r, len - i);
+    }
+}
+
+#endif
@@ -359,10 +359,10 @@ QVariant SampleProtocol::fieldData(int index, FieldAttrib attrib,
 /*!
 TODO: Edit this function to set the data for each field
 
-See AbstractProtocol::setFieldData() for more info
+See AbstractProtocol::setProtocolFieldData() for more info
 */
-bool SampleProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool SampleProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
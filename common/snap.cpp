@@ -207,8 +207,8 @@ QVariant SnapProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool SnapProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool SnapProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -19,16 +19,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "streambase.h"
 #include "abstractprotocol.h"
+#include "ipcksum.h"
+#include "prng.h"
 #include "protocollist.h"
 #include "protocollistiterator.h"
 #include "protocolmanager.h"
 
+#include <QVarLengthArray>
+
 extern ProtocolManager *OstProtocolManager;
 
 StreamBase::StreamBase() :
     mStreamId(new OstProto::StreamId),
     mCore(new OstProto::StreamCore),
-    mControl(new OstProto::StreamControl)
+    mControl(new OstProto::StreamControl),
+    mFrameLayoutValid(false),
+    mFrameLayoutCompiling(false),
+    mFrameLayoutGeneration(0),
+    mFrameValueVariable(false),
+    mFrameSizeVariable(false),
+    mFrameVariableCount(1),
+    mFrameFixedLength(0),
+    mFrameFirstVariable(-1)
 {
     AbstractProtocol *proto;
     ProtocolListIterator *iter;
@@ -85,6 +97,7 @@ void StreamBase::protoDataCopyFrom(const OstProto::Stream &stream)
     mCore->CopyFrom(stream.core());
     mControl->CopyFrom(stream.control());
 
+    invalidateFrameLayout();
     currentFrameProtocols->destroy();
     iter = createProtocolListIterator();
     for (int i=0; i < stream.protocol_size(); i++)
@@ -138,6 +151,264 @@ ProtocolListIterator*  StreamBase::createProtocolListIterator() const
     return new ProtocolListIterator(*currentFrameProtocols);
 }
 
+/*!
+  Discards the compiled frame layout - must be called whenever the stream's
+  protocols (or their fields) are changed other than via the StreamBase, 
+  ProtocolListIterator and AbstractProtocol::setFieldData() methods which
+  already do so
+*/
+void StreamBase::invalidateFrameLayout()
+{
+    mFrameLayoutValid = false;
+    mFrameLayoutGeneration++;
+}
+
+/*!
+  Returns a count which changes everytime the frame layout is invalidated
+
+  Protocols which memoize their own per frame results may compare this
+  with the value at the time of memoizing to find if those are stale
+*/
+quint32 StreamBase::frameLayoutGeneration() const
+{
+    return mFrameLayoutGeneration;
+}
+
+/*!
+  Compiles the frame layout - the size, offset and payload size of every
+  protocol that doesn't vary in size across the stream along with the
+  protocol's (and its payload's) 'variable' properties - so that these 
+  need not be computed by walking the protocol list for every frame
+
+  The layout is a flat array in frame order, so all per frame queries 
+  (including frameValue()) work off it instead of the protocol list
+
+  Returns false if called recursively i.e. while compiling (protocols such
+  as payload may query their own offset to find their size)
+*/
+bool StreamBase::compileFrameLayout() const
+{
+    int offset = 0, payloadSize = 0, variable = -1;
+    int variableCount = 1;
+    quint64 frameCount = 1;
+    bool valueVariable, sizeVariable;
+    int i = 0;
+
+    if (mFrameLayoutValid)
+        return true;
+
+    if (mFrameLayoutCompiling)
+        return false;
+
+    mFrameLayoutCompiling = true;
+    mFrameLayout.resize(currentFrameProtocols->size());
+
+    foreach (const AbstractProtocol* proto, *currentFrameProtocols)
+    {
+        ProtocolLayout &pl = mFrameLayout[i];
+
+        pl.protocol = proto;
+        pl.valueVariable = proto->isProtocolFrameValueVariable();
+        pl.sizeVariable = proto->isProtocolFrameSizeVariable();
+        pl.variableCount = proto->protocolFrameVariableCount();
+        pl.size = pl.sizeVariable ? 0 : proto->protocolFrameSize(0);
+        pl.offset = offset;
+        pl.prevVariable = variable;
+        pl.cksumValid = false;
+        pl.cksum = 0;
+
+        // correct count for mis-behaving protocols
+        if (pl.variableCount <= 0)
+            pl.variableCount = 1;
+
+        offset += pl.size;
+        if (pl.sizeVariable)
+            variable = i;
+
+        proto->_frameLayoutIndex = i++;
+    }
+
+    variable = -1;
+    valueVariable = sizeVariable = false;
+    for (i = mFrameLayout.size() - 1; i >= 0; i--)
+    {
+        ProtocolLayout &pl = mFrameLayout[i];
+
+        pl.payloadSize = payloadSize;
+        pl.nextVariable = variable;
+        pl.payloadValueVariable = valueVariable;
+        pl.payloadSizeVariable = sizeVariable;
+        pl.payloadVariableCount = variableCount;
+
+        payloadSize += pl.size;
+        if (pl.sizeVariable)
+            variable = i;
+        if (pl.valueVariable || pl.sizeVariable)
+            variableCount = AbstractProtocol::lcm(variableCount, 
+                                pl.variableCount);
+        valueVariable = valueVariable || pl.valueVariable;
+        sizeVariable = sizeVariable || pl.sizeVariable;
+        frameCount = AbstractProtocol::lcm(frameCount, pl.variableCount);
+    }
+
+    mFrameValueVariable = valueVariable;
+    mFrameSizeVariable = sizeVariable;
+    mFrameVariableCount = frameCount;
+    mFrameFixedLength = offset;
+    mFrameFirstVariable = variable;
+
+    mFrameLayoutCompiling = false;
+    mFrameLayoutValid = true;
+
+    return true;
+}
+
+const StreamBase::ProtocolLayout* StreamBase::protocolLayout(
+        const AbstractProtocol *proto) const
+{
+    int i;
+
+    if (!compileFrameLayout())
+        return NULL;
+
+    i = proto->_frameLayoutIndex;
+    if ((i < 0) || (i >= mFrameLayout.size()) 
+            || (mFrameLayout.at(i).protocol != proto))
+        return NULL;
+
+    return &mFrameLayout.at(i);
+}
+
+/*!
+  Returns the byte offset of proto (a protocol of this stream) in the
+  frame for streamIndex using the compiled frame layout or -1 if proto is
+  not part of the layout
+
+  The offset is computed in constant time unless there are preceding 
+  protocols which vary in size
+*/
+int StreamBase::protocolFrameOffset(const AbstractProtocol *proto,
+        int streamIndex) const
+{
+    const ProtocolLayout *pl = protocolLayout(proto);
+    int offset;
+
+    if (!pl)
+        return -1;
+
+    offset = pl->offset;
+    for (int i = pl->prevVariable; i >= 0; 
+            i = mFrameLayout.at(i).prevVariable)
+        offset += mFrameLayout.at(i).protocol->protocolFrameSize(streamIndex);
+
+    return offset;
+}
+
+/*!
+  Returns the size of all protocols following proto (a protocol of this
+  stream) in the frame for streamIndex using the compiled frame layout or
+  -1 if proto is not part of the layout
+
+  The size is computed in constant time unless there are succeeding 
+  protocols which vary in size
+*/
+int StreamBase::protocolFramePayloadSize(const AbstractProtocol *proto,
+        int streamIndex) const
+{
+    const ProtocolLayout *pl = protocolLayout(proto);
+    int size;
+
+    if (!pl)
+        return -1;
+
+    size = pl->payloadSize;
+    for (int i = pl->nextVariable; i >= 0; 
+            i = mFrameLayout.at(i).nextVariable)
+        size += mFrameLayout.at(i).protocol->protocolFrameSize(streamIndex);
+
+    return size;
+}
+
+/*!
+  Retrieves the 'variable' properties of all protocols following proto (a
+  protocol of this stream) using the compiled frame layout - returns false
+  if proto is not part of the layout
+*/
+bool StreamBase::protocolFramePayloadVariable(const AbstractProtocol *proto,
+        bool *isValueVariable, bool *isSizeVariable, int *variableCount) const
+{
+    const ProtocolLayout *pl = protocolLayout(proto);
+
+    if (!pl)
+        return false;
+
+    if (isValueVariable)
+        *isValueVariable = pl->payloadValueVariable;
+    if (isSizeVariable)
+        *isSizeVariable = pl->payloadSizeVariable;
+    if (variableCount)
+        *variableCount = pl->payloadVariableCount;
+
+    return true;
+}
+
+/*!
+  Returns the partial IP checksum (see checksumIpPartial()) of the size
+  bytes at payload which are the encoded protocols following proto (a 
+  protocol of this stream) in the frame for streamIndex
+
+  The partial checksum of a protocol which varies neither in value nor in
+  size is computed only once and cached in the frame layout - so it is
+  dropped along with the layout by invalidateFrameLayout() (including on
+  any AbstractProtocol::setFieldData()) and like the layout, is not thread
+  safe
+*/
+quint16 StreamBase::protocolFramePayloadPartialCksum(
+        const AbstractProtocol *proto, const uchar *payload, int size, 
+        int streamIndex) const
+{
+    const ProtocolLayout *pl = protocolLayout(proto);
+    quint16 sum = 0;
+    int offset = 0;
+
+    if (!pl)
+        return checksumIpPartial(payload, size);
+
+    for (int i = int(pl - mFrameLayout.constData()) + 1; 
+            (i < mFrameLayout.size()) && (offset < size); i++)
+    {
+        ProtocolLayout &next = mFrameLayout[i];
+        quint16 cksum;
+        int len;
+
+        len = next.sizeVariable ? 
+            next.protocol->protocolFrameSize(streamIndex) : next.size;
+        len = qMin(len, size - offset);
+
+        if (!next.sizeVariable && !next.valueVariable && (len == next.size))
+        {
+            if (!next.cksumValid)
+            {
+                next.cksum = checksumIpPartial(payload + offset, len);
+                next.cksumValid = true;
+            }
+            cksum = next.cksum;
+        }
+        else
+            cksum = checksumIpPartial(payload + offset, len);
+
+        sum = checksumIpAdd(sum, cksum, offset & 1);
+        offset += len;
+    }
+
+    if (offset < size)
+        sum = checksumIpAdd(sum, 
+                checksumIpPartial(payload + offset, size - offset), 
+                offset & 1);
+
+    return sum;
+}
+
 quint32    StreamBase::id()
 {
     return mStreamId->id();
@@ -190,6 +461,7 @@ StreamBase::FrameLengthMode    StreamBase::lenMode() const
 bool StreamBase::setLenMode(FrameLengthMode    lenMode)
 {
     mCore->set_len_mode((OstProto::StreamCore::FrameLengthMode) lenMode); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -212,12 +484,8 @@ quint16    StreamBase::frameLen(int streamIndex) const
                 (frameLenMax() - frameLenMin() + 1));
             break;
         case OstProto::StreamCore::e_fl_random:
-            //! \todo (MED) This 'random' sequence is same across iterations
-            pktLen = 64; // to avoid the 'maybe used uninitialized' warning
-            qsrand(reinterpret_cast<ulong>(this));
-            for (int i = 0; i <= streamIndex; i++)
-                pktLen = qrand();
-            pktLen = frameLenMin() + (pktLen %
+            // Domain 0 is reserved for the frame length - see randomValue()
+            pktLen = frameLenMin() + int(randomValue(0, streamIndex) %
                 (frameLenMax() - frameLenMin() + 1));
             break;
         default:
@@ -233,6 +501,7 @@ quint16    StreamBase::frameLen(int streamIndex) const
 bool StreamBase::setFrameLen(quint16 frameLen)
 {
     mCore->set_frame_len(frameLen);  
+    invalidateFrameLayout();
     return true;
 }
 
@@ -244,6 +513,7 @@ quint16    StreamBase::frameLenMin() const
 bool StreamBase::setFrameLenMin(quint16 frameLenMin)
 {
     mCore->set_frame_len_min(frameLenMin);  
+    invalidateFrameLayout();
     return true;
 }
 
@@ -255,6 +525,7 @@ quint16    StreamBase::frameLenMax() const
 bool StreamBase::setFrameLenMax(quint16 frameLenMax)
 {
     mCore->set_frame_len_max(frameLenMax);  
+    invalidateFrameLayout();
     return true;
 }
 
@@ -271,6 +542,31 @@ quint16 StreamBase::frameLenAvg() const
     return avgFrameLen;
 }
 
+quint64 StreamBase::randomSeed() const
+{
+    return mCore->has_random_seed() ? mCore->random_seed() : mStreamId->id();
+}
+
+bool StreamBase::setRandomSeed(quint64 seed)
+{
+    mCore->set_random_seed(seed);
+    return true;
+}
+
+/*!
+  Returns the random value for streamIndex for the given domain
+
+  Each user of random values (the frame length, a protocol field etc.) 
+  uses a different domain so that their sequences are independent of each
+  other - protocols use (protocolNumber() << 16 | fieldIndex) as the domain.
+  The value depends only on the stream's random seed, domain and 
+  streamIndex, so it is the same every time it is asked for
+*/
+quint64 StreamBase::randomValue(quint64 domain, int streamIndex) const
+{
+    return prngRandom(prngRandom(randomSeed(), domain), quint64(streamIndex));
+}
+
 StreamBase::SendUnit StreamBase::sendUnit() const
 {
     return (StreamBase::SendUnit) mControl->unit();
@@ -279,6 +575,7 @@ StreamBase::SendUnit StreamBase::sendUnit() const
 bool StreamBase::setSendUnit(SendUnit sendUnit)
 {
     mControl->set_unit((OstProto::StreamControl::SendUnit) sendUnit); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -305,6 +602,22 @@ bool StreamBase::setNextWhat(NextWhat nextWhat)
     return true;
 }
 
+bool StreamBase::hasGotoStreamId() const
+{
+    return mControl->has_goto_stream_id();
+}
+
+quint32 StreamBase::gotoStreamId() const
+{
+    return mControl->goto_stream_id();
+}
+
+bool StreamBase::setGotoStreamId(quint32 streamId)
+{
+    mControl->set_goto_stream_id(streamId);
+    return true;
+}
+
 quint32 StreamBase::numPackets() const
 {
     return (quint32) mControl->num_packets();
@@ -313,6 +626,7 @@ quint32 StreamBase::numPackets() const
 bool StreamBase::setNumPackets(quint32 numPackets)
 {
     mControl->set_num_packets(numPackets); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -324,6 +638,7 @@ quint32 StreamBase::numBursts() const
 bool StreamBase::setNumBursts(quint32 numBursts)
 {
     mControl->set_num_bursts(numBursts); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -335,6 +650,7 @@ quint32 StreamBase::burstSize() const
 bool StreamBase::setBurstSize(quint32 packetsPerBurst)
 {
     mControl->set_packets_per_burst(packetsPerBurst); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -357,6 +673,7 @@ double StreamBase::burstRate() const
 bool StreamBase::setBurstRate(double burstsPerSec)
 {
     mControl->set_bursts_per_sec(burstsPerSec); 
+    invalidateFrameLayout();
     return true;
 }
 
@@ -400,85 +717,33 @@ bool StreamBase::setAveragePacketRate(double packetsPerSec)
 
 bool StreamBase::isFrameVariable() const
 {
-    ProtocolListIterator    *iter;
-
-    iter = createProtocolListIterator();
-    while (iter->hasNext())
-    {
-        AbstractProtocol    *proto;
-
-        proto = iter->next();
-        if (proto->isProtocolFrameValueVariable())
-            goto _exit;
-    }
-    delete iter;
-    return false;
-
-_exit:
-    delete iter;
-    return true;
+    compileFrameLayout();
+    return mFrameValueVariable;
 }
 
 bool StreamBase::isFrameSizeVariable() const
 {
-    ProtocolListIterator    *iter;
-
-    iter = createProtocolListIterator();
-    while (iter->hasNext())
-    {
-        AbstractProtocol    *proto;
-
-        proto = iter->next();
-        if (proto->isProtocolFrameSizeVariable())
-            goto _exit;
-    }
-    delete iter;
-    return false;
-
-_exit:
-    delete iter;
-    return true;
+    compileFrameLayout();
+    return mFrameSizeVariable;
 }
 
 int StreamBase::frameVariableCount() const
 {
-    ProtocolListIterator    *iter;
-    quint64 frameCount = 1;
-
-    iter = createProtocolListIterator();
-    while (iter->hasNext())
-    {
-        AbstractProtocol    *proto;
-        int count;
-
-        proto = iter->next();
-        count = proto->protocolFrameVariableCount();
-
-        // correct count for mis-behaving protocols
-        if (count <= 0)
-            count = 1;
-
-        frameCount = AbstractProtocol::lcm(frameCount, count);
-    }
-    delete iter;
-
-    return frameCount;
+    compileFrameLayout();
+    return mFrameVariableCount;
 }
 
 // frameProtocolLength() returns the sum of all the individual protocol sizes
 // which may be different from frameLen()
 int StreamBase::frameProtocolLength(int frameIndex) const
 {
-    int len = 0;
-    ProtocolListIterator *iter = createProtocolListIterator();
+    int len;
 
-    while (iter->hasNext())
-    {
-        AbstractProtocol *proto = iter->next();
-
-        len += proto->protocolFrameSize(frameIndex);
-    }
-    delete iter;
+    compileFrameLayout();
+    len = mFrameFixedLength;
+    for (int i = mFrameFirstVariable; i >= 0; 
+            i = mFrameLayout.at(i).nextVariable)
+        len += mFrameLayout.at(i).protocol->protocolFrameSize(frameIndex);
 
     return len;
 }
@@ -500,6 +765,7 @@ int StreamBase::frameCount() const
 int StreamBase::frameValue(uchar *buf, int bufMaxSize, int frameIndex) const
 {
     int        pktLen, len = 0;
+    QVarLengthArray<int, 16> offset;
 
     pktLen = frameLen(frameIndex);
 
@@ -509,22 +775,31 @@ int StreamBase::frameValue(uchar *buf, int bufMaxSize, int frameIndex) const
     if ((pktLen < 0) || (pktLen > bufMaxSize))
         return 0;
 
-    ProtocolListIterator    *iter;
+    if (!compileFrameLayout())
+        return 0;
 
-    iter = createProtocolListIterator();
-    while (iter->hasNext())
+    // Each protocol encodes itself directly into buf; we walk the compiled
+    // layout instead of the protocol list so that generating a frame needs
+    // no heap allocation or pointer chasing between list nodes
+    offset.resize(mFrameLayout.size());
+    for (int i = 0; i < mFrameLayout.size(); i++)
     {
-        AbstractProtocol    *proto;
-        QByteArray            ba;
-
-        proto = iter->next();
-        ba = proto->protocolFrameValue(frameIndex);
+        offset[i] = len;
+        len += mFrameLayout.at(i).protocol->writeFrameValue(buf + len, 
+                qMax(bufMaxSize - len, 0), frameIndex);
+    }
 
-        if (len + ba.size() < bufMaxSize)
-            memcpy(buf+len, ba.constData(), ba.size());
-        len += ba.size();
+    // Checksums are computed in a final pass over the encoded frame -
+    // last protocol first, so that a protocol's payload is complete 
+    // (including any checksums in it) by the time it is checksummed
+    if (len <= bufMaxSize)
+    {
+        for (int i = mFrameLayout.size() - 1; i >= 0; i--)
+        {
+            mFrameLayout.at(i).protocol->writeFrameCksum(buf + offset.at(i),
+                    len - offset.at(i), frameIndex);
+        }
     }
-    delete iter;
 
     // Pad with zero, if required
     if (len < pktLen)
@@ -533,27 +808,110 @@ int StreamBase::frameValue(uchar *buf, int bufMaxSize, int frameIndex) const
     return pktLen;
 }
 
+/*!
+  Returns in minLen and maxLen the smallest and largest frame length 
+  across all frames of the stream - without going over every frame
+*/
+void StreamBase::frameLenRange(int &minLen, int &maxLen) const
+{
+    int range = frameLenMax() - frameLenMin() + 1;
+    int count = frameCount();
+
+    switch(lenMode())
+    {
+        case e_fl_inc:
+            if (range <= 0)
+                goto _fixed;
+            minLen = frameLenMin();
+            maxLen = (count < range) ? minLen + qMax(count, 1) - 1 
+                                     : frameLenMax();
+            break;
+        case e_fl_dec:
+            if (range <= 0)
+                goto _fixed;
+            maxLen = frameLenMax();
+            minLen = (count < range) ? maxLen - qMax(count, 1) + 1 
+                                     : frameLenMin();
+            break;
+        case e_fl_random:
+            // May be narrower for a small count, but we can't tell 
+            // without generating each random length
+            if (range <= 0)
+                goto _fixed;
+            minLen = frameLenMin();
+            maxLen = frameLenMax();
+            break;
+        case e_fl_fixed:
+        default:
+_fixed:
+            minLen = maxLen = frameLen(0);
+            break;
+    }
+}
+
+/*!
+  Checks if the stream's frames may be truncated or need jumbo support
+
+  The check is done analytically from the range of frame lengths and the
+  range of each protocol's size (see 
+  AbstractProtocol::protocolFrameSizeRange()) instead of per frame, so 
+  it takes the same time irrespective of the number of packets; since 
+  the largest size of each protocol is assumed, it may be conservative
+  for protocols whose sizes vary independent of each other
+*/
 bool StreamBase::preflightCheck(QString &result) const
 {
     bool pass = true;
-    int count = isFrameSizeVariable() ? frameCount() : 1;
-
-    for (int i = 0; i < count; i++)
+    bool hasFiller = false;
+    int minLen, maxLen;
+    int preLen = 0, postLen = 0;
+    int requiredLen;
+
+    if (isFrameSizeVariable() && (frameCount() <= 0))
+        return true;
+
+    frameLenRange(minLen, maxLen);
+
+    // A protocol which fills up the frame (e.g. payload) never needs 
+    // more than what is left of the frame length after the preceding
+    // protocols; any protocols following it are always over and above
+    // the frame length - so find the largest length of the protocols
+    // preceding and following the (first) filler separately
+    compileFrameLayout();
+    for (int i = 0; i < mFrameLayout.size(); i++)
     {
-        if (frameLen(i) < (frameProtocolLength(i) + kFcsSize))
-        {
-            result += QString("One or more frames may be truncated - "
-                "frame length should be at least %1.\n")
-                .arg(frameProtocolLength(i) + kFcsSize);
-            pass = false;
-        }
+        int minSize, maxSize;
 
-        if (frameLen(i) > 1522)
+        mFrameLayout.at(i).protocol->protocolFrameSizeRange(minSize, maxSize);
+        if (maxSize < 0)
         {
-            result += QString("Jumbo frames may be truncated or dropped "
-                "if not supported by the hardware\n");
-            pass = false;
+            hasFiller = true;
+            continue;
         }
+
+        if (hasFiller)
+            postLen += maxSize;
+        else
+            preLen += maxSize;
+    }
+
+    requiredLen = preLen + postLen + kFcsSize;
+    if (hasFiller && (postLen > 0))
+        requiredLen = qMax(minLen, preLen + kFcsSize) + postLen;
+
+    if (minLen < requiredLen)
+    {
+        result += QString("One or more frames may be truncated - "
+            "frame length should be at least %1.\n")
+            .arg(requiredLen);
+        pass = false;
+    }
+
+    if (maxLen > 1522)
+    {
+        result += QString("Jumbo frames may be truncated or dropped "
+            "if not supported by the hardware\n");
+        pass = false;
     }
 
     return pass;
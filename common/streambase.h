@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include <QString>
 #include <QLinkedList>
+#include <QVector>
 
 #include "protocol.pb.h"
 
@@ -40,6 +41,44 @@ private:
 
     ProtocolList            *currentFrameProtocols;
 
+    // Compiled frame layout - one entry per (top level) protocol in the
+    // same order as currentFrameProtocols; see compileFrameLayout()
+    // The layout (and the cksums cached in it) is filled in lazily by
+    // const methods and is NOT thread safe - a stream must be used by only
+    // one thread at a time; threads such as the packet producer work on
+    // their own copy of the streams
+    struct ProtocolLayout {
+        const AbstractProtocol *protocol;
+        int size;           // protocol size, if not sizeVariable
+        int offset;         // sum of preceding fixed protocol sizes
+        int payloadSize;    // sum of succeeding fixed protocol sizes
+        int prevVariable;   // preceding variable size protocol (or -1)
+        int nextVariable;   // succeeding variable size protocol (or -1)
+        int variableCount;
+        bool valueVariable;
+        bool sizeVariable;
+        bool payloadValueVariable;  // of all succeeding protocols
+        bool payloadSizeVariable;   // -do-
+        int payloadVariableCount;   // -do-
+        bool cksumValid;    // partial cksum is cached (constant protocols)
+        quint16 cksum;
+    };
+    mutable QVector<ProtocolLayout> mFrameLayout;
+    mutable bool mFrameLayoutValid;
+    mutable bool mFrameLayoutCompiling;
+
+    // Frame level summary of the compiled layout
+    mutable bool mFrameValueVariable;
+    mutable bool mFrameSizeVariable;
+    mutable int mFrameVariableCount;
+    mutable int mFrameFixedLength;      // sum of fixed protocol sizes
+    mutable int mFrameFirstVariable;    // first variable size protocol
+    quint32 mFrameLayoutGeneration;
+
+    bool compileFrameLayout() const;
+    const ProtocolLayout* protocolLayout(const AbstractProtocol *proto) const;
+    void frameLenRange(int &minLen, int &maxLen) const;
+
 public:
     StreamBase();
     ~StreamBase();
@@ -49,6 +88,18 @@ public:
 
     ProtocolListIterator* createProtocolListIterator() const;
 
+    void invalidateFrameLayout();
+    quint32 frameLayoutGeneration() const;
+    int protocolFrameOffset(const AbstractProtocol *proto,
+            int streamIndex) const;
+    int protocolFramePayloadSize(const AbstractProtocol *proto,
+            int streamIndex) const;
+    bool protocolFramePayloadVariable(const AbstractProtocol *proto,
+            bool *isValueVariable, bool *isSizeVariable, 
+            int *variableCount) const;
+    quint16 protocolFramePayloadPartialCksum(const AbstractProtocol *proto,
+            const uchar *payload, int size, int streamIndex) const;
+
     //! \todo (LOW) should we have a copy constructor??
 
 public:
@@ -109,6 +160,10 @@ public:
 
     quint16 frameLenAvg() const;
 
+    quint64 randomSeed() const;
+    bool setRandomSeed(quint64 seed);
+    quint64 randomValue(quint64 domain, int streamIndex) const;
+
     SendUnit sendUnit() const;
     bool setSendUnit(SendUnit sendUnit);
 
@@ -118,6 +173,10 @@ public:
     NextWhat nextWhat() const;
     bool setNextWhat(NextWhat nextWhat);
 
+    bool hasGotoStreamId() const;
+    quint32 gotoStreamId() const;
+    bool setGotoStreamId(quint32 streamId);
+
     quint32 numPackets() const;
     bool setNumPackets(quint32 numPackets);
 
@@ -471,8 +471,8 @@ QVariant TcpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool TcpProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool TcpProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -604,3 +604,40 @@ int TcpProtocol::protocolFrameVariableCount() const
     return protocolFramePayloadVariableCount();
 }
 
+int TcpProtocol::writeFrameValue(uchar *dst, int size, int streamIndex) const
+{
+    int hdrlen;
+
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    hdrlen = data.is_override_hdrlen() ? 
+        (data.hdrlen_rsvd() >> 4) & 0x0F : 0x05;
+
+    qToBigEndian(quint16(data.is_override_src_port() ?
+                data.src_port() : payloadProtocolId(ProtocolIdTcpUdp)), dst);
+    qToBigEndian(quint16(data.is_override_dst_port() ?
+                data.dst_port() : payloadProtocolId(ProtocolIdTcpUdp)), 
+            dst + 2);
+    qToBigEndian(quint32(data.seq_num()), dst + 4);
+    qToBigEndian(quint32(data.ack_num()), dst + 8);
+    dst[12] = (hdrlen << 4) | (data.hdrlen_rsvd() & 0x0F);
+    dst[13] = data.flags() & 0x3F;
+    qToBigEndian(quint16(data.window()), dst + 14);
+    dst[16] = dst[17] = 0;
+    qToBigEndian(quint16(data.urg_ptr()), dst + 18);
+
+    // Checksum is filled in by writeFrameCksum()
+    if (data.is_override_cksum())
+        qToBigEndian(quint16(data.cksum()), dst + 16);
+
+    return kFrameSize;
+}
+
+void TcpProtocol::writeFrameCksum(uchar *dst, int size, int streamIndex) const
+{
+    if (data.is_override_cksum() || (size < kFrameSize))
+        return;
+
+    qToBigEndian(tcpUdpCksum(dst, kFrameSize, size, streamIndex), dst + 16);
+}
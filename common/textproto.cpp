@@ -182,8 +182,8 @@ QVariant TextProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool TextProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool TextProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -342,8 +342,8 @@ QVariant UdpProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool UdpProtocol::setFieldData(int index, const QVariant& value, 
-        FieldAttrib attrib)
+bool UdpProtocol::setProtocolFieldData(int index,
+        const QVariant& value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -429,3 +429,32 @@ int UdpProtocol::protocolFrameVariableCount() const
 
     return protocolFramePayloadVariableCount();
 }
+
+int UdpProtocol::writeFrameValue(uchar *dst, int size, int streamIndex) const
+{
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    qToBigEndian(quint16(data.is_override_src_port() ?
+                data.src_port() : payloadProtocolId(ProtocolIdTcpUdp)), dst);
+    qToBigEndian(quint16(data.is_override_dst_port() ?
+                data.dst_port() : payloadProtocolId(ProtocolIdTcpUdp)), 
+            dst + 2);
+    qToBigEndian(quint16(data.is_override_totlen() ? data.totlen() :
+                (protocolFramePayloadSize(streamIndex) + 8)), dst + 4);
+    dst[6] = dst[7] = 0;
+
+    // Checksum is filled in by writeFrameCksum()
+    if (data.is_override_cksum())
+        qToBigEndian(quint16(data.cksum()), dst + 6);
+
+    return kFrameSize;
+}
+
+void UdpProtocol::writeFrameCksum(uchar *dst, int size, int streamIndex) const
+{
+    if (data.is_override_cksum() || (size < kFrameSize))
+        return;
+
+    qToBigEndian(tcpUdpCksum(dst, kFrameSize, size, streamIndex), dst + 6);
+}
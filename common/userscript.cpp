@@ -19,6 +19,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "userscript.h"
 
+#include "streambase.h"
+
 //
 // -------------------- UserScriptProtocol --------------------
 //
@@ -29,6 +31,8 @@ UserScriptProtocol::UserScriptProtocol(StreamBase *stream, AbstractProtocol *par
 {
     isScriptValid_ = false;
     errorLineNumber_ = 0;
+    isScriptEvaluated_ = false;
+    cacheGeneration_ = 0;
 
     userProtocolScriptValue_ = engine_.newQObject(&userProtocol_);
     engine_.globalObject().setProperty("protocol", userProtocolScriptValue_);
@@ -60,11 +64,15 @@ void UserScriptProtocol::protoDataCopyInto(OstProto::Protocol &protocol) const
 
 void UserScriptProtocol::protoDataCopyFrom(const OstProto::Protocol &protocol)
 {
+    std::string program = data.program();
+
     if (protocol.protocol_id().id() == protocolNumber() &&
             protocol.HasExtension(OstProto::userScript))
         data.MergeFrom(protocol.GetExtension(OstProto::userScript));
 
-    evaluateUserScript();
+    // The script need be evaluated again only if it has changed
+    if (!isScriptEvaluated_ || (data.program() != program))
+        evaluateUserScript();
 }
 
 QString UserScriptProtocol::name() const
@@ -81,10 +89,15 @@ quint32 UserScriptProtocol::protocolId(ProtocolIdType type) const
 {
     QScriptValue userFunction;
     QScriptValue userValue;
+    quint32 id;
 
     if (!isScriptValid_)
         goto _do_default;
 
+    validateCache();
+    if (protocolIdCache_.contains(type))
+        return protocolIdCache_.value(type);
+
     userFunction = userProtocolScriptValue_.property("protocolId");
 
     if (!userFunction.isValid())
@@ -98,7 +111,10 @@ quint32 UserScriptProtocol::protocolId(ProtocolIdType type) const
     Q_ASSERT(userValue.isValid());
     Q_ASSERT(userValue.isNumber());
 
-    return userValue.toUInt32();
+    id = userValue.toUInt32();
+    protocolIdCache_.insert(type, id);
+
+    return id;
 
 _do_default:
     return AbstractProtocol::protocolId(type);
@@ -126,33 +142,8 @@ QVariant UserScriptProtocol::fieldData(int index, FieldAttrib attrib,
             return QString().fromStdString(data.program());
 
         case FieldFrameValue:
-        {
-            if (!isScriptValid_)
-                return QByteArray();
-
-            QScriptValue userFunction = userProtocolScriptValue_.property(
-                    "protocolFrameValue");
-
-            Q_ASSERT(userFunction.isValid());
-            Q_ASSERT(userFunction.isFunction());
-
-            QScriptValue userValue = userFunction.call(QScriptValue(),
-                QScriptValueList() << QScriptValue(&engine_, streamIndex));
-
-            Q_ASSERT(userValue.isValid());
-            Q_ASSERT(userValue.isArray());
-
-            QByteArray fv;
-            QList<int> pktBuf;
-               
-            qScriptValueToSequence(userValue, pktBuf); 
+            return cachedFrameValue(streamIndex);
 
-            fv.resize(pktBuf.size());
-            for (int i = 0; i < pktBuf.size(); i++)
-                fv[i] = pktBuf.at(i) & 0xFF;
-
-            return fv;
-        }
         default:
             break;
         }
@@ -167,8 +158,8 @@ QVariant UserScriptProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool UserScriptProtocol::setFieldData(int index, const QVariant &value, 
-        FieldAttrib attrib)
+bool UserScriptProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -193,23 +184,37 @@ _exit:
     return isOk;
 }
 
+int UserScriptProtocol::writeFrameValue(uchar *dst, int size,
+        int streamIndex) const
+{
+    QByteArray fv = cachedFrameValue(streamIndex);
+
+    if (fv.size() <= size)
+        memcpy(dst, fv.constData(), fv.size());
+
+    return fv.size();
+}
+
 int UserScriptProtocol::protocolFrameSize(int streamIndex) const
 {
+    int i;
+    int size;
+
     if (!isScriptValid_)
         return 0;
 
-    QScriptValue userFunction = userProtocolScriptValue_.property(
-            "protocolFrameSize");
-
-    Q_ASSERT(userFunction.isValid());
-    Q_ASSERT(userFunction.isFunction());
+    i = frameCacheIndex(streamIndex);
+    if (i < 0)
+        return userFrameSize(streamIndex);
 
-    QScriptValue userValue = userFunction.call(QScriptValue(), 
-            QScriptValueList() << QScriptValue(&engine_, streamIndex));
+    if (frameCache_.at(i).isSizeValid)
+        return frameCache_.at(i).size;
 
-    Q_ASSERT(userValue.isNumber());
+    size = userFrameSize(streamIndex);
+    frameCache_[i].size = size;
+    frameCache_[i].isSizeValid = true;
 
-    return userValue.toInt32();
+    return size;
 }
 
 bool UserScriptProtocol::isProtocolFrameValueVariable() const
@@ -238,9 +243,6 @@ quint32 UserScriptProtocol::protocolFrameCksum(int streamIndex,
 
     userFunction = userProtocolScriptValue_.property("protocolFrameCksum");
 
-    qDebug("userscript protoFrameCksum(): isValid:%d/isFunc:%d",
-        userFunction.isValid(), userFunction.isFunction());
-
     if (!userFunction.isValid())
         goto _do_default;
 
@@ -266,7 +268,9 @@ void UserScriptProtocol::evaluateUserScript() const
     QString         property;
 
     isScriptValid_ = false;
+    isScriptEvaluated_ = true;
     errorLineNumber_ = userScriptLineCount();
+    clearCache();
 
     // Reset all properties including the dynamic ones
     userProtocol_.reset();
@@ -447,6 +451,113 @@ int UserScriptProtocol::userScriptLineCount() const
             QChar('\n')) + 1;
 }
 
+/*!
+  Discards all memoized script results
+*/
+void UserScriptProtocol::clearCache() const
+{
+    frameCache_.clear();
+    protocolIdCache_.clear();
+    if (mpStream)
+        cacheGeneration_ = mpStream->frameLayoutGeneration();
+}
+
+/*!
+  Discards the memoized script results if the stream has changed since
+  they were memoized - the script may depend on the other protocols (e.g.
+  via protocol.protocolFramePayloadSize())
+*/
+void UserScriptProtocol::validateCache() const
+{
+    if (mpStream && (mpStream->frameLayoutGeneration() != cacheGeneration_))
+        clearCache();
+}
+
+/*!
+  Returns the index into the frame cache for streamIndex or -1 if the 
+  results for streamIndex cannot be memoized
+
+  Results are memoized per streamIndex (for the first kMaxCachedFrames
+  frames only) - a script's results need not repeat every variable count 
+  frames, so one frame's results are never reused for another
+*/
+int UserScriptProtocol::frameCacheIndex(int streamIndex) const
+{
+    validateCache();
+
+    if ((streamIndex < 0) || (streamIndex >= kMaxCachedFrames))
+        return -1;
+
+    if (frameCache_.size() <= streamIndex)
+        frameCache_.resize(streamIndex + 1);
+
+    return streamIndex;
+}
+
+QByteArray UserScriptProtocol::cachedFrameValue(int streamIndex) const
+{
+    QByteArray fv;
+    int i;
+
+    if (!isScriptValid_)
+        return QByteArray();
+
+    i = frameCacheIndex(streamIndex);
+    if (i < 0)
+        return userFrameValue(streamIndex);
+
+    if (frameCache_.at(i).isValueValid)
+        return frameCache_.at(i).value;
+
+    fv = userFrameValue(streamIndex);
+    frameCache_[i].value = fv;
+    frameCache_[i].isValueValid = true;
+
+    return fv;
+}
+
+QByteArray UserScriptProtocol::userFrameValue(int streamIndex) const
+{
+    QScriptValue userFunction = userProtocolScriptValue_.property(
+            "protocolFrameValue");
+
+    Q_ASSERT(userFunction.isValid());
+    Q_ASSERT(userFunction.isFunction());
+
+    QScriptValue userValue = userFunction.call(QScriptValue(),
+        QScriptValueList() << QScriptValue(&engine_, streamIndex));
+
+    Q_ASSERT(userValue.isValid());
+    Q_ASSERT(userValue.isArray());
+
+    QByteArray fv;
+    QList<int> pktBuf;
+
+    qScriptValueToSequence(userValue, pktBuf); 
+
+    fv.resize(pktBuf.size());
+    for (int i = 0; i < pktBuf.size(); i++)
+        fv[i] = pktBuf.at(i) & 0xFF;
+
+    return fv;
+}
+
+int UserScriptProtocol::userFrameSize(int streamIndex) const
+{
+    QScriptValue userFunction = userProtocolScriptValue_.property(
+            "protocolFrameSize");
+
+    Q_ASSERT(userFunction.isValid());
+    Q_ASSERT(userFunction.isFunction());
+
+    QScriptValue userValue = userFunction.call(QScriptValue(), 
+            QScriptValueList() << QScriptValue(&engine_, streamIndex));
+
+    Q_ASSERT(userValue.isNumber());
+
+    return userValue.toInt32();
+}
+
 //
 // -------------------- UserProtocol --------------------
 //
@@ -548,7 +659,6 @@ quint32 UserProtocol::protocolFramePayloadCksum(int streamIndex,
     quint32 cksum;
 
     cksum = parent_->protocolFramePayloadCksum(streamIndex, cksumType);
-    qDebug("UserProto:%s = %d", __FUNCTION__, cksum);
     return cksum;
 }
 
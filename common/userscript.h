@@ -23,8 +23,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include "abstractprotocol.h"
 #include "userscript.pb.h"
 
+#include <QHash>
 #include <QScriptEngine>
 #include <QScriptValue>
+#include <QVector>
 
 class UserScriptProtocol;
 
@@ -128,9 +130,11 @@ public:
 
     virtual QVariant fieldData(int index, FieldAttrib attrib,
             int streamIndex = 0) const;
-    virtual bool setFieldData(int index, const QVariant &value, 
-            FieldAttrib attrib = FieldValue);
+    virtual bool setProtocolFieldData(int index,
+            const QVariant &value, FieldAttrib attrib = FieldValue);
 
+    virtual int writeFrameValue(uchar *dst, int size,
+            int streamIndex = 0) const;
     virtual int protocolFrameSize(int streamIndex = 0) const;
 
     virtual bool isProtocolFrameValueVariable() const;
@@ -146,7 +150,24 @@ public:
     QString userScriptErrorText() const;
 
 private:
+    // Max frames (per variable count) whose results are memoized
+    static const int kMaxCachedFrames = 4096;
+
+    struct CachedFrame {
+        CachedFrame() : isValueValid(false), isSizeValid(false), size(0) {}
+        bool isValueValid;
+        bool isSizeValid;
+        int size;
+        QByteArray value;
+    };
+
     int userScriptLineCount() const;
+    void clearCache() const;
+    void validateCache() const;
+    int frameCacheIndex(int streamIndex) const;
+    QByteArray cachedFrameValue(int streamIndex) const;
+    QByteArray userFrameValue(int streamIndex) const;
+    int userFrameSize(int streamIndex) const;
 
     OstProto::UserScript    data;
 
@@ -157,6 +178,13 @@ private:
     mutable bool            isScriptValid_;
     mutable int             errorLineNumber_;
     mutable QString         errorText_;
+    mutable bool            isScriptEvaluated_;
+
+    // Memoized script results - valid for the evaluated script and
+    // the stream's frame layout generation at the time of memoizing
+    mutable QVector<CachedFrame> frameCache_;
+    mutable QHash<int, quint32> protocolIdCache_;
+    mutable quint32         cacheGeneration_;
 };
 
 #endif
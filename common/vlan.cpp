@@ -209,8 +209,8 @@ QVariant VlanProtocol::fieldData(int index, FieldAttrib attrib,
     return AbstractProtocol::fieldData(index, attrib, streamIndex);
 }
 
-bool VlanProtocol::setFieldData(int index, const QVariant &value,
-        FieldAttrib attrib)
+bool VlanProtocol::setProtocolFieldData(int index,
+        const QVariant &value, FieldAttrib attrib)
 {
     bool isOk = false;
 
@@ -268,3 +268,15 @@ bool VlanProtocol::setFieldData(int index, const QVariant &value,
 _exit:
     return isOk;
 }
+
+int VlanProtocol::writeFrameValue(uchar *dst, int size, int /*streamIndex*/) 
+        const
+{
+    if (size < kFrameSize)
+        return kFrameSize;
+
+    qToBigEndian(quint16(data.is_override_tpid() ? data.tpid() : 0x8100), dst);
+    qToBigEndian(quint16(data.vlan_tag() & 0xFFFF), dst + 2);
+
+    return kFrameSize;
+}
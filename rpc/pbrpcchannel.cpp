@@ -147,10 +147,11 @@ void PbRpcChannel::CallMethod(
     // Avoid printing stats since it happens every couple of seconds
     if (pendingMethodId != 13)
     {
-        qDebug("client(%s) sending %d bytes <----", __FUNCTION__, 
+        OST_TRACE(kTraceRpc, kTraceDetail,
+                "client(%s) sending %d bytes <----", __FUNCTION__, 
                 PB_HDR_SIZE + len);
         BUFDUMP(msg, PB_HDR_SIZE);
-        qDebug("method = %d\n req = \n%s\n---->", 
+        OST_TRACE(kTraceRpc, kTraceDetail, "method = %d\n req = \n%s\n---->",
                 method->index(), req->DebugString().c_str());
     }
 
@@ -260,8 +261,10 @@ void PbRpcChannel::on_mpSocket_readyRead()
             // Avoid printing stats
             if (method != 13)
             {
-                qDebug("client(%s): Received Msg <---- ", __FUNCTION__);
-                qDebug("method = %d\nresp = \n%s\n---->",
+                OST_TRACE(kTraceRpc, kTraceDetail,
+                        "client(%s): Received Msg <---- ", __FUNCTION__);
+                OST_TRACE(kTraceRpc, kTraceDetail,
+                        "method = %d\nresp = \n%s\n---->",
                         method, response->DebugString().c_str());
             }
 
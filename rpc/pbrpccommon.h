@@ -20,9 +20,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #ifndef _PB_RPC_COMMON_H
 #define _PB_RPC_COMMON_H
 
+#include "../common/ostrace.h"
+
 // Print a HexDump
-#define BUFDUMP(ptr, len) qDebug("%s", QString(QByteArray((char*)(ptr), \
-    (len)).toHex()).toAscii().data()); 
+#define BUFDUMP(ptr, len) OST_TRACE(kTraceRpc, kTraceDetail, "%s", \
+    QString(QByteArray((char*)(ptr), (len)).toHex()).toAscii().data()); 
 
 /*
 ** RPC Header (8)
@@ -40,6 +40,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 static QThreadStorage<QString*> connId;
 
+static const int kBlobChunkSize = 64*1024;
+
 RpcConnection::RpcConnection(int socketDescriptor, 
                              ::google::protobuf::Service *service)
     : socketDescriptor(socketDescriptor),
@@ -141,14 +143,15 @@ void RpcConnection::sendRpcReply(PbRpcController *controller)
         writeHeader(msg, PB_MSG_TYPE_BINBLOB, pendingMethodId, len);
         clientSock->write(msg, PB_HDR_SIZE);
 
+        // Large chunks - not one socket write per few bytes
         blob->seek(0);
         while (!blob->atEnd())
         {    
+            QByteArray chunk = blob->read(kBlobChunkSize);
             int l;
 
-            len = blob->read(msg, sizeof(msgBuf));
-            l = clientSock->write(msg, len);
-            Q_ASSERT(l == len);
+            l = clientSock->write(chunk);
+            Q_ASSERT(l == chunk.size());
             Q_UNUSED(l);
         }
 
@@ -172,10 +175,11 @@ void RpcConnection::sendRpcReply(PbRpcController *controller)
     // Avoid printing stats since it happens once every couple of seconds
     if (pendingMethodId != 13)
     {
-        qDebug("Server(%s): sending %d bytes to client <----",
+        OST_TRACE(kTraceRpc, kTraceDetail,
+            "Server(%s): sending %d bytes to client <----",
             __FUNCTION__, len + PB_HDR_SIZE);
         BUFDUMP(msg, 8);
-        qDebug("method = %d\nreq = \n%s---->", 
+        OST_TRACE(kTraceRpc, kTraceDetail, "method = %d\nreq = \n%s---->", 
             pendingMethodId, response->DebugString().c_str());
     }
 
@@ -324,9 +328,12 @@ void RpcConnection::on_clientSock_dataAvail()
     }
     
     if (method != 13) {
-        qDebug("Server(%s): successfully received/parsed msg <----", __FUNCTION__);
-        qDebug("method = %d\n"
-               "req = \n%s---->",
+        OST_TRACE(kTraceRpc, kTraceDetail,
+                "Server(%s): successfully received/parsed msg <----", 
+                __FUNCTION__);
+        OST_TRACE(kTraceRpc, kTraceDetail,
+                "method = %d\n"
+                "req = \n%s---->",
                 method,
                 req->DebugString().c_str());
     }
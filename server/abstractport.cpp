@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "abstractport.h"
 
+#include "packetproducer.h"
+#include "../common/ostrace.h"
 #include "../common/streambase.h"
 #include "../common/abstractprotocol.h"
 
@@ -31,6 +33,66 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include <limits.h>
 #include <math.h>
 
+AbstractPort::Timeline AbstractPort::Timeline::fromRate(double perSec)
+{
+    double gap, nsec;
+    quint64 frac;
+
+    if (perSec <= 0)
+        return Timeline();
+
+    gap = 1e9/perSec;
+    nsec = floor(gap);
+
+    // A fraction that rounds up to 1 carries over into the nsecs
+    frac = quint64(ldexp(gap - nsec, 32) + 0.5);
+
+    return Timeline(quint64(nsec) + (frac >> 32), quint32(frac));
+}
+
+const double AbstractPort::RateProfile::kMinPercent = 0.001;
+
+void AbstractPort::RateProfile::append(double durationSec, 
+        double startPercent, double endPercent)
+{
+    Step step;
+
+    if (durationSec <= 0)
+        return;
+
+    step.startNsec = steps_.isEmpty() ? 0 : steps_.last().endNsec;
+    step.endNsec = step.startNsec + durationSec*1e9;
+    step.startPercent = qMax(startPercent, kMinPercent);
+    step.endPercent = qMax(endPercent, kMinPercent);
+
+    steps_.append(step);
+}
+
+void AbstractPort::RateProfile::update()
+{
+    while ((step_ < steps_.size()) && (now_ >= steps_.at(step_).endNsec))
+        step_++;
+
+    if (step_ >= steps_.size())
+    {
+        // Profile done - the last rate holds
+        scale_ = steps_.isEmpty() ? 1.0 : 100.0/steps_.last().endPercent;
+        nextUpdate_ = HUGE_VAL;
+        return;
+    }
+
+    const Step &step = steps_.at(step_);
+    double percent = step.startPercent 
+            + (step.endPercent - step.startPercent)
+                * (now_ - step.startNsec) / (step.endNsec - step.startNsec);
+
+    scale_ = 100.0/percent;
+    if (step.startPercent == step.endPercent)
+        nextUpdate_ = step.endNsec;
+    else
+        nextUpdate_ = qMin(now_ + kUpdateNsec, step.endNsec);
+}
+
 AbstractPort::AbstractPort(int id, const char *device)
 {
     isUsable_ = true;
@@ -45,6 +107,7 @@ AbstractPort::AbstractPort(int id, const char *device)
     isSendQueueDirty_ = false;
     linkState_ = OstProto::LinkStateUnknown;
     minPacketSetSize_ = 1;
+    producer_ = NULL;
 
     maxStatsValue_ = ULLONG_MAX; // assume 64-bit stats
     memset((void*) &stats_, 0, sizeof(stats_));
@@ -53,6 +116,7 @@ AbstractPort::AbstractPort(int id, const char *device)
 
 AbstractPort::~AbstractPort()
 {
+    delete producer_;
 }    
 
 void AbstractPort::init()
@@ -76,6 +140,22 @@ bool AbstractPort::modify(const OstProto::Port &port)
     if (port.has_transmit_mode())
         data_.set_transmit_mode(port.transmit_mode());
 
+    // Takes effect at the next start of transmit
+    if (port.has_rate_profile())
+    {
+        const OstProto::RateProfile &profile = port.rate_profile();
+
+        rateProfile_.clear();
+        for (int i = 0; i < profile.step_size(); i++)
+            rateProfile_.append(profile.step(i).duration(), 
+                    profile.step(i).start_rate(), profile.step(i).end_rate());
+        data_.mutable_rate_profile()->CopyFrom(profile);
+    }
+
+    // Takes effect at the next start of capture
+    if (port.has_capture_config())
+        data_.mutable_capture_config()->CopyFrom(port.capture_config());
+
     return ret;
 }    
 
@@ -155,25 +235,48 @@ void AbstractPort::addNote(QString note)
 
 void AbstractPort::updatePacketList()
 {
+    bool isBuilt = false;
+
+    // The producer is shared with the transmitter, so it can't be 
+    // changed underneath it - the update happens at the next start
+    if (isTransmitOn() && !canUpdateWhileTransmitting())
+    {
+        qWarning("port %d: can't update packet list while transmitting", 
+                id());
+        return;
+    }
+
     switch(data_.transmit_mode())
     {
     case OstProto::kSequentialTransmit:
-        updatePacketListSequential();
+        isBuilt = updatePacketListSequential();
         break;
     case OstProto::kInterleavedTransmit:
-        updatePacketListInterleaved();
+        isBuilt = updatePacketListInterleaved();
         break;
     default:
         Q_ASSERT(false); // Unreachable!!!
         break;
     }
+
+    // If no new list was built, the transmitter must continue with the
+    // active one - committing would hand it a stale (or its own) list
+    if (isBuilt)
+        commitPacketList();
 }
 
-void AbstractPort::updatePacketListSequential()
+/*
+  Returns false if a new packet list could not be built - the current
+  list (if any) is left as is and the port remains dirty
+*/
+bool AbstractPort::updatePacketListSequential()
 {
-    quint64    sec = 0; 
-    quint64    nsec = 0;
+    Timeline now;
+    Timeline lastTs;
     quint64 totalPkts = 0;
+    bool isContinuous = false;
+    QList<int> segmentOf; // packet list segment of each stream
+    int segmentCount = 0;
 
     qDebug("In %s", __FUNCTION__);
 
@@ -183,6 +286,8 @@ void AbstractPort::updatePacketListSequential()
     // Calculate total number of packets in packetList
     for (int i = 0; i < streamList_.size(); i++)
     {
+        segmentOf.append(streamList_[i]->isEnabled() ? segmentCount++ : -1);
+
         if (streamList_[i]->isEnabled())
         {
             ulong frameVariableCount = streamList_[i]->frameVariableCount();
@@ -197,10 +302,9 @@ void AbstractPort::updatePacketListSequential()
             case OstProto::StreamControl::e_su_bursts:
                 burstSize = streamList_[i]->burstSize();
                 x = AbstractProtocol::lcm(frameVariableCount, burstSize);
-                n = ulong(burstSize * streamList_[i]->burstRate() 
-                            * streamList_[i]->numBursts()) / x;
-                y = ulong(burstSize * streamList_[i]->burstRate() 
-                            * streamList_[i]->numBursts()) % x;
+                // Same count as StreamBase::frameCount() and the producer
+                n = (ulong(streamList_[i]->numBursts()) * burstSize) / x;
+                y = (ulong(streamList_[i]->numBursts()) * burstSize) % x;
                 break;
             case OstProto::StreamControl::e_su_packets:
                 x = frameVariableCount;
@@ -209,6 +313,7 @@ void AbstractPort::updatePacketListSequential()
                     x = frameVariableCount*n++;
                 n = streamList_[i]->numPackets() / x;
                 y = streamList_[i]->numPackets() % x;
+                burstSize = 1;
                 break;
             default:
                 qWarning("Unhandled stream control unit %d",
@@ -216,13 +321,41 @@ void AbstractPort::updatePacketListSequential()
                 continue;
             }
 
-            qDebug("[%d] n = %lu, x = %lu, y = %lu, burstSz = %lu fvc = %lu\n",
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "[%d] n = %lu, x = %lu, y = %lu, burstSz = %lu fvc = %lu\n",
                     i, n, x, y, burstSize, frameVariableCount);
 
             totalPkts += (x+y);
+
+            if (streamList_[i]->sendMode() == StreamBase::e_sm_continuous)
+                isContinuous = true;
+        }
+    }
+
+    // Continuous streams can't be materialized and neither should very
+    // large packet lists - generate such packets on the fly instead
+    if (isContinuous || (totalPkts > kMaxPacketListSize))
+    {
+        if (isTransmitOn())
+        {
+            qWarning("port %d: can't switch to a producer while "
+                    "transmitting", id());
+            return false;
         }
+
+        clearPacketList();
+        qDebug("Using producer: continuous = %d, totalPkts = %" PRIu64,
+                isContinuous, totalPkts);
+        if (!producer_)
+            producer_ = new PacketProducer;
+        producer_->setStreams(streamList_);
+        isSendQueueDirty_ = false;
+        return true;
     }
 
+    delete producer_;
+    producer_ = NULL;
+
     clearPacketList();
     setPacketListSize(totalPkts);
 
@@ -233,15 +366,14 @@ void AbstractPort::updatePacketListSequential()
             int len = 0;
             ulong n, x, y;
             ulong burstSize;
-            double ibg = 0;
-            quint64 ibg1 = 0, ibg2 = 0;
-            quint64 nb1 = 0, nb2 = 0;
-            double ipg = 0;
-            quint64 ipg1 = 0, ipg2 = 0;
-            quint64 npx1 = 0, npx2 = 0;
-            quint64 npy1 = 0, npy2 = 0;
-            quint64 loopDelay, loopDelaySec;
+            Timeline ibg, ipg;
             ulong frameVariableCount = streamList_[i]->frameVariableCount();
+            int nextSegment = -1;
+
+            // Each stream is a packet list segment - when transmit 
+            // finishes this stream, it continues with the segment of the
+            // stream we goto next
+            startPacketListSegment();
 
             // We derive n, x, y such that
             // n * x + y = total number of packets to be sent
@@ -252,19 +384,10 @@ void AbstractPort::updatePacketListSequential()
             case OstProto::StreamControl::e_su_bursts:
                 burstSize = streamList_[i]->burstSize();
                 x = AbstractProtocol::lcm(frameVariableCount, burstSize);
-                n = ulong(burstSize * streamList_[i]->burstRate() 
-                            * streamList_[i]->numBursts()) / x;
-                y = ulong(burstSize * streamList_[i]->burstRate() 
-                            * streamList_[i]->numBursts()) % x;
-                if (streamList_[i]->burstRate() > 0)
-                {
-                    ibg = 1e9/double(streamList_[i]->burstRate());
-                    ibg1 = quint64(ceil(ibg));
-                    ibg2 = quint64(floor(ibg));
-                    nb1  = quint64((ibg - double(ibg2)) * double(x));
-                    nb2  = x - nb1;
-                }
-                loopDelay = ibg2;
+                // Same count as StreamBase::frameCount() and the producer
+                n = (ulong(streamList_[i]->numBursts()) * burstSize) / x;
+                y = (ulong(streamList_[i]->numBursts()) * burstSize) % x;
+                ibg = Timeline::fromRate(streamList_[i]->burstRate());
                 break;
             case OstProto::StreamControl::e_su_packets:
                 x = frameVariableCount;
@@ -273,18 +396,8 @@ void AbstractPort::updatePacketListSequential()
                     x = frameVariableCount*n++;
                 n = streamList_[i]->numPackets() / x;
                 y = streamList_[i]->numPackets() % x;
-                burstSize = x + y;
-                if (streamList_[i]->packetRate() > 0)
-                {
-                    ipg = 1e9/double(streamList_[i]->packetRate());
-                    ipg1 = quint64(ceil(ipg));
-                    ipg2 = quint64(floor(ipg));
-                    npx1  = quint64((ipg - double(ipg2)) * double(x));
-                    npx2  = x - npx1;
-                    npy1  = quint64((ipg - double(ipg2)) * double(y));
-                    npy2  = y - npy1;
-                }
-                loopDelay = ipg2;
+                burstSize = 1;
+                ipg = Timeline::fromRate(streamList_[i]->packetRate());
                 break;
             default:
                 qWarning("Unhandled stream control unit %d",
@@ -292,33 +405,46 @@ void AbstractPort::updatePacketListSequential()
                 continue;
             }
 
-            loopDelaySec = 0;
-            while (loopDelay >= long(1e9))
-            {
-                loopDelaySec++;
-                loopDelay -= long(1e9);
-            }
-
-            qDebug("\nframeVariableCount = %lu", frameVariableCount);
-            qDebug("n = %lu, x = %lu, y = %lu, burstSize = %lu",
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "\nframeVariableCount = %lu", frameVariableCount);
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "n = %lu, x = %lu, y = %lu, burstSize = %lu",
                     n, x, y, burstSize);
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "ibg = %" PRIu64 " + %u/2^32", ibg.nsec(), ibg.frac());
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "ipg = %" PRIu64 " + %u/2^32", ipg.nsec(), ipg.frac());
+
+            // The set of x packets is repeated n times - the set period is
+            // computed in fixed point so that the repeat delay (from the
+            // last packet of the set to the first packet of the next repeat)
+            // carries the fractional nsecs over to the transmitter
+            Timeline setStart = now;
+            Timeline setPeriod;
 
-            qDebug("ibg  = %g", ibg);
-            qDebug("ibg1 = %" PRIu64, ibg1);
-            qDebug("nb1  = %" PRIu64, nb1);
-            qDebug("ibg2 = %" PRIu64, ibg2);
-            qDebug("nb2  = %" PRIu64 "\n", nb2);
+            if (n > 1)
+            {
+                Timeline setLast = now;
+                Timeline repeatDelay;
 
-            qDebug("ipg  = %g", ipg);
-            qDebug("ipg1 = %" PRIu64, ipg1);
-            qDebug("npx1 = %" PRIu64, npx1);
-            qDebug("npy1 = %" PRIu64, npy1);
-            qDebug("ipg2 = %" PRIu64, ipg2);
-            qDebug("npx2 = %" PRIu64, npx2);
-            qDebug("npy2 = %" PRIu64 "\n", npy2);
+                if (streamList_[i]->sendUnit() == StreamBase::e_su_bursts)
+                {
+                    setPeriod = ibg.scaled(x/burstSize);
+                    setLast.advance(ibg.scaled(x/burstSize - 1));
+                }
+                else
+                {
+                    setPeriod = ipg.scaled(x);
+                    setLast.advance(ipg.scaled(x - 1));
+                }
+                repeatDelay = setPeriod.since(
+                        Timeline(setLast.nsec() - now.nsec(), 0));
 
-            if (n > 1)
-                loopNextPacketSet(x, n, loopDelaySec, loopDelay);
+                OST_TRACE(kTraceBuild, kTraceInfo,
+                        "repeat delay = %" PRIu64 " + %u/2^32",
+                        repeatDelay.nsec(), repeatDelay.frac());
+                loopNextPacketSet(x, n, repeatDelay.nsec(), repeatDelay.frac());
+            }
             else if (n == 0)
                 x = 0;
 
@@ -330,62 +456,58 @@ void AbstractPort::updatePacketListSequential()
                     len = streamList_[i]->frameValue(
                             pktBuf_, sizeof(pktBuf_), j);
                 }
-                if (len <= 0)
-                    continue;
-
-                qDebug("q(%d, %d) sec = %" PRIu64 " nsec = %" PRIu64,
-                        i, j, sec, nsec);
+                if (len > 0)
+                {
+                    OST_TRACE(kTraceBuild, kTraceDetail,
+                            "q(%d, %d) ts = %" PRIu64, i, j, now.nsec());
 
-                appendToPacketList(long(sec), long(nsec), pktBuf_, len); 
+                    appendToPacketList(now.nsec(), pktBuf_, len); 
+                    lastTs = Timeline(now.nsec(), 0);
 
-                if ((j > 0) && (((j+1) % burstSize) == 0))
-                {
-                    nsec += (j < nb1) ? ibg1 : ibg2;
-                    while (nsec >= long(1e9))
-                    {
-                        sec++;
-                        nsec -= long(1e9);
-                    }
+                    if (((j+1) % burstSize) == 0)
+                        now.advance(ibg);
+                    now.advance(ipg);
                 }
-                else
-                {
-                    if (j < x)
-                        nsec += (j < npx1) ? ipg1 : ipg2;
-                    else
-                        nsec += ((j-x) < npy1) ? ipg1 : ipg2;
 
-                    while (nsec >= long(1e9))
-                    {
-                        sec++;
-                        nsec -= long(1e9);
-                    }
+                // At the end of a repeated set, the transmitter has waited
+                // for the repeat delay after the last repeat - so that is
+                // our current position on the timeline
+                if ((n > 1) && (j == (x - 1)))
+                {
+                    now = setStart;
+                    now.advance(setPeriod.scaled(n));
+                    lastTs = now;
                 }
             }
 
             switch(streamList_[i]->nextWhat())
             {
                 case ::OstProto::StreamControl::e_nw_stop:
-                    goto _stop_no_more_pkts;
+                    nextSegment = -1;
+                    break;
 
                 case ::OstProto::StreamControl::e_nw_goto_id:
-                    /*! \todo (MED): define and use 
-                    streamList_[i].d.control().goto_stream_id(); */
-
-                    /*! \todo (MED): assumes goto Id is less than current!!!! 
-                     To support goto to any id, do
-                     if goto_id > curr_id then 
-                         i = goto_id;
-                         goto restart;
-                     else
-                         returnToQIdx = 0;
-                     */
-
-                    setPacketListLoopMode(true, 0, 
-                            streamList_[i]->sendUnit() == 
-                                StreamBase::e_su_bursts ? ibg1 : ipg1);
-                    goto _stop_no_more_pkts;
+                    // Goto the first stream, unless told otherwise
+                    nextSegment = 0;
+                    if (streamList_[i]->hasGotoStreamId())
+                    {
+                        for (int k = 0; k < streamList_.size(); k++)
+                        {
+                            if ((streamList_[k]->id() 
+                                    == streamList_[i]->gotoStreamId())
+                                    && (segmentOf.at(k) >= 0))
+                            {
+                                nextSegment = segmentOf.at(k);
+                                break;
+                            }
+                        }
+                    }
+                    break;
 
                 case ::OstProto::StreamControl::e_nw_goto_next:
+                    nextSegment = segmentOf.at(i) + 1;
+                    if (nextSegment >= segmentCount)
+                        nextSegment = -1;
                     break;
 
                 default:
@@ -394,24 +516,32 @@ void AbstractPort::updatePacketListSequential()
                     break;
             }
 
+            // The first packet of the next segment is the new timestamp
+            // reference, so the delay to it is from our last packet
+            Timeline nextDelay = now.since(lastTs);
+            OST_TRACE(kTraceBuild, kTraceInfo,
+                    "segment %d -> %d, delay = %" PRIu64 " + %u/2^32",
+                    segmentOf.at(i), nextSegment, 
+                    nextDelay.nsec(), nextDelay.frac());
+            setPacketListSegmentNext(segmentOf.at(i), nextSegment,
+                    nextDelay.nsec(), nextDelay.frac());
+            lastTs = now;
+
         } // if (stream is enabled)
     } // for (numStreams)
 
-_stop_no_more_pkts:
     isSendQueueDirty_ = false;
+    return true;
 }
 
-void AbstractPort::updatePacketListInterleaved()
+bool AbstractPort::updatePacketListInterleaved()
 {
     int numStreams = 0;
     quint64 minGap = ULLONG_MAX;
     quint64 duration = quint64(1e9);
-    QList<quint64> ibg1, ibg2;
-    QList<quint64> nb1, nb2;
-    QList<quint64> ipg1, ipg2;
-    QList<quint64> np1, np2;
-    QList<ulong> schedSec, schedNsec;
-    QList<ulong> pktCount, burstCount;
+    QList<Timeline> ibg, ipg;
+    QList<Timeline> schedule;
+    QList<ulong> pktCount;
     QList<ulong> burstSize;
     QList<bool> isVariable;
     QList<QByteArray> pktBuf;
@@ -419,6 +549,9 @@ void AbstractPort::updatePacketListInterleaved()
 
     qDebug("In %s", __FUNCTION__);
 
+    delete producer_;
+    producer_ = NULL;
+
     // First sort the streams by ordinalValue
     qSort(streamList_.begin(), streamList_.end(), StreamBase::StreamLessThan);
 
@@ -426,45 +559,30 @@ void AbstractPort::updatePacketListInterleaved()
 
     // TODO: setPacketListSize();
 
+    // The schedule is a single segment that loops back to itself
+    startPacketListSegment();
+
     for (int i = 0; i < streamList_.size(); i++)
     {
         if (!streamList_[i]->isEnabled())
             continue;
 
-        double numBursts = 0;
-        double numPackets = 0;
-
         quint64 _burstSize = 0;
-        double ibg = 0;
-        quint64 _ibg1 = 0, _ibg2 = 0;
-        quint64 _nb1 = 0, _nb2 = 0;
-        double ipg = 0;
-        quint64 _ipg1 = 0, _ipg2 = 0;
-        quint64 _np1 = 0, _np2 = 0;
+        Timeline _ibg, _ipg;
 
         switch (streamList_[i]->sendUnit())
         {
         case OstProto::StreamControl::e_su_bursts:
-            numBursts = streamList_[i]->burstRate();
             if (streamList_[i]->burstRate() > 0)
             {
-                ibg = 1e9/double(streamList_[i]->burstRate());
-                _ibg1 = quint64(ceil(ibg));
-                _ibg2 = quint64(floor(ibg));
-                _nb1 = quint64((ibg - double(_ibg2)) * double(numBursts));
-                _nb2 = quint64(numBursts) - _nb1;
+                _ibg = Timeline::fromRate(streamList_[i]->burstRate());
                 _burstSize = streamList_[i]->burstSize();
             }
             break;
         case OstProto::StreamControl::e_su_packets:
-            numPackets = streamList_[i]->packetRate();
             if (streamList_[i]->packetRate() > 0)
             {
-                ipg = 1e9/double(streamList_[i]->packetRate());
-                _ipg1 = llrint(ceil(ipg));
-                _ipg2 = quint64(floor(ipg));
-                _np1 = quint64((ipg - double(_ipg2)) * double(numPackets));
-                _np2 = quint64(numPackets) - _np1;
+                _ipg = Timeline::fromRate(streamList_[i]->packetRate());
                 _burstSize = 1;
             }
             break;
@@ -473,60 +591,31 @@ void AbstractPort::updatePacketListInterleaved()
                 streamList_[i]->sendUnit());
             continue;
         }
-        qDebug("numBursts = %g, numPackets = %g\n", numBursts, numPackets);
 
-        qDebug("ibg  = %g", ibg);
-        qDebug("ibg1 = %" PRIu64, _ibg1);
-        qDebug("nb1  = %" PRIu64, _nb1);
-        qDebug("ibg2 = %" PRIu64, _ibg2);
-        qDebug("nb2  = %" PRIu64 "\n", _nb2);
+        OST_TRACE(kTraceBuild, kTraceInfo,
+                "ibg = %" PRIu64 " + %u/2^32", _ibg.nsec(), _ibg.frac());
+        OST_TRACE(kTraceBuild, kTraceInfo,
+                "ipg = %" PRIu64 " + %u/2^32", _ipg.nsec(), _ipg.frac());
 
-        qDebug("ipg  = %g", ipg);
-        qDebug("ipg1 = %" PRIu64, _ipg1);
-        qDebug("np1  = %" PRIu64, _np1);
-        qDebug("ipg2 = %" PRIu64, _ipg2);
-        qDebug("np2  = %" PRIu64 "\n", _np2);
+        if (_ibg.nsec() && (_ibg.nsec() < minGap))
+            minGap = _ibg.nsec();
 
+        if (_ibg.nsec() + 1 > duration)
+            duration = _ibg.nsec() + 1;
 
-        if (_ibg2 && (_ibg2 < minGap))
-            minGap = _ibg2;
+        if (_ipg.nsec() && (_ipg.nsec() < minGap))
+            minGap = _ipg.nsec();
 
-        if (_ibg1 && (_ibg1 > duration))
-            duration = _ibg1;
+        if (_ipg.nsec() + 1 > duration)
+            duration = _ipg.nsec() + 1;
 
-        ibg1.append(_ibg1);
-        ibg2.append(_ibg2);
-
-        nb1.append(_nb1);
-        nb2.append(_nb1);
+        ibg.append(_ibg);
+        ipg.append(_ipg);
 
         burstSize.append(_burstSize);
 
-        if (_ipg2 && (_ipg2 < minGap))
-            minGap = _ipg2;
-
-        if (_np1)
-        {
-            if (_ipg1 && (_ipg1 > duration))
-                duration = _ipg1;
-        }
-        else
-        {
-            if (_ipg2 && (_ipg2 > duration))
-                duration = _ipg2;
-        }
-
-        ipg1.append(_ipg1);
-        ipg2.append(_ipg2);
-
-        np1.append(_np1);
-        np2.append(_np1);
-
-        schedSec.append(0);
-        schedNsec.append(0);
-
+        schedule.append(Timeline());
         pktCount.append(0);
-        burstCount.append(0);
 
         if (streamList_[i]->isFrameVariable())
         {
@@ -546,23 +635,25 @@ void AbstractPort::updatePacketListInterleaved()
         numStreams++;
     } // for i
 
-    qDebug("minGap   = %" PRIu64, minGap);
-    qDebug("duration = %" PRIu64, duration);
+    OST_TRACE(kTraceBuild, kTraceInfo, "minGap   = %" PRIu64, minGap);
+    OST_TRACE(kTraceBuild, kTraceInfo, "duration = %" PRIu64, duration);
+
+    if ((numStreams == 0) || (minGap == ULLONG_MAX))
+    {
+        isSendQueueDirty_ = false;
+        return true;
+    }
 
     uchar* buf;
     int len;
-    quint64 durSec = duration/ulong(1e9);
-    quint64 durNsec = duration % ulong(1e9);
-    quint64 sec = 0; 
-    quint64 nsec = 0;
-    quint64 lastPktTxSec = 0;
+    quint64 now = 0;
     quint64 lastPktTxNsec = 0;
     do
     {
         for (int i = 0; i < numStreams; i++)
         {
             // If a packet is not scheduled yet, look at the next stream
-            if ((schedSec.at(i) > sec) || (schedNsec.at(i) > nsec))
+            if (schedule.at(i).nsec() > now)
                 continue;
 
             for (uint j = 0; j < burstSize[i]; j++)
@@ -582,49 +673,26 @@ void AbstractPort::updatePacketListInterleaved()
                 if (len <= 0)
                     continue;
 
-                qDebug("q(%d) sec = %" PRIu64 " nsec = %" PRIu64, i, sec, nsec);
-                appendToPacketList(sec, nsec, buf, len); 
-                lastPktTxSec = sec;
-                lastPktTxNsec = nsec;
+                OST_TRACE(kTraceBuild, kTraceDetail,
+                        "q(%d) ts = %" PRIu64, i, now);
+                appendToPacketList(now, buf, len); 
+                lastPktTxNsec = now;
 
                 pktCount[i]++;
-                schedNsec[i] += (pktCount.at(i) < np1.at(i)) ? 
-                    ipg1.at(i) : ipg2.at(i);
-                while (schedNsec.at(i) >= 1e9)
-                {
-                    schedSec[i]++;
-                    schedNsec[i] -= long(1e9);
-                }
+                schedule[i].advance(ipg.at(i));
             }
 
-            burstCount[i]++;
-            schedNsec[i] += (burstCount.at(i) < nb1.at(i)) ? 
-                    ibg1.at(i) : ibg2.at(i);
-            while (schedNsec.at(i) >= 1e9)
-            {
-                schedSec[i]++;
-                schedNsec[i] -= long(1e9);
-            }
+            schedule[i].advance(ibg.at(i));
         } 
 
-        nsec += minGap;
-        while (nsec >= 1e9)
-        {
-            sec++;
-            nsec -= long(1e9);
-        }
-    } while ((sec < durSec) || (nsec < durNsec));
+        now += minGap;
+    } while (now < duration);
 
-    qint64 delaySec = durSec - lastPktTxSec;
-    qint64 delayNsec = durNsec - lastPktTxNsec;
-    while (delayNsec < 0)
-    {
-        delayNsec += long(1e9);
-        delaySec--;
-    }
-    qDebug("loop Delay = %" PRId64 "/%" PRId64, delaySec, delayNsec);
-    setPacketListLoopMode(true, delaySec, delayNsec); 
+    OST_TRACE(kTraceBuild, kTraceInfo,
+            "loop Delay = %" PRIu64, duration - lastPktTxNsec);
+    setPacketListSegmentNext(0, 0, duration - lastPktTxNsec, 0); 
     isSendQueueDirty_ = false;
+    return true;
 }
 
 void AbstractPort::stats(PortStats *stats)
@@ -659,4 +727,9 @@ void AbstractPort::stats(PortStats *stats)
     stats->rxFrameErrors = (stats_.rxFrameErrors >= epochStats_.rxFrameErrors) ?
                         stats_.rxFrameErrors - epochStats_.rxFrameErrors :
                         stats_.rxFrameErrors + (maxStatsValue_ - epochStats_.rxFrameErrors);
+
+    // Counted by us (not the platform), so never wraps around
+    stats->captureDrops = stats_.captureDrops - epochStats_.captureDrops;
+    stats->txLatePkts = stats_.txLatePkts - epochStats_.txLatePkts;
+    stats->txMaxLateNsec = txMaxLate_.value();
 }
@@ -20,12 +20,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #ifndef _SERVER_ABSTRACT_PORT_H
 #define _SERVER_ABSTRACT_PORT_H
 
+#include <QAtomicInt>
 #include <QList>
 #include <QtGlobal>
 
 #include "../common/protocol.pb.h"
 
 class StreamBase;
+class PacketProducer;
 class QIODevice;
 
 class AbstractPort
@@ -43,10 +45,180 @@ public:
         quint64    rxFifoErrors;
         quint64    rxFrameErrors;
 
+        quint64    captureDrops;
+
         quint64    txPkts;
         quint64    txBytes;
         quint64    txPps;
         quint64    txBps;
+
+        quint64    txLatePkts;
+        quint64    txMaxLateNsec;
+    };
+
+    /*!
+      Error diffusing nanosecond timeline
+
+      A gap (the reciprocal of a rate) is in general not an integral number
+      of nanoseconds - so it is kept as an integral nsec part and a 32-bit
+      binary fraction (units of 2^-32 nsec). advance() carries the fraction
+      over, so that after N advances by gap, nsec() is exactly
+      floor(N * gap) i.e. rounding errors never accumulate
+    */
+    class Timeline
+    {
+    public:
+        Timeline() : nsec_(0), frac_(0) {}
+        Timeline(quint64 nsec, quint32 frac) : nsec_(nsec), frac_(frac) {}
+
+        quint64 nsec() const { return nsec_; }
+        quint32 frac() const { return frac_; }
+
+        void advance(quint64 nsec, quint32 frac = 0) {
+            quint64 f = quint64(frac_) + frac;
+            nsec_ += nsec + (f >> 32);
+            frac_ = quint32(f);
+        }
+        void advance(const Timeline &gap) {
+            advance(gap.nsec_, gap.frac_);
+        }
+
+        //! Returns (this - earlier); clamped to zero if earlier is later
+        Timeline since(const Timeline &earlier) const {
+            if ((nsec_ < earlier.nsec_)
+                    || ((nsec_ == earlier.nsec_) && (frac_ < earlier.frac_)))
+                return Timeline();
+            quint64 nsec = nsec_ - earlier.nsec_;
+            if (frac_ < earlier.frac_)
+                nsec--;
+            return Timeline(nsec, frac_ - earlier.frac_);
+        }
+
+        //! Returns the gap multiplied by count (exact in fixed point)
+        Timeline scaled(quint64 count) const {
+            quint64 f = quint64(frac_) * count;
+            return Timeline(nsec_ * count + (f >> 32), quint32(f));
+        }
+
+        static Timeline fromRate(double perSec);
+
+        //! Returns the whole nsecs to delay for a (nsec, frac) delay,
+        //! accumulating the binary fraction in fracAcc so that the 
+        //! fractional parts are not lost across repeated delays
+        static quint64 fracDelay(quint64 nsec, quint32 frac, 
+                quint32 &fracAcc) {
+            quint64 sum = quint64(fracAcc) + frac;
+            fracAcc = quint32(sum);
+            return nsec + (sum >> 32);
+        }
+
+    private:
+        quint64 nsec_;
+        quint32 frac_;
+    };
+
+    /*!
+      Max of a stat (e.g. tx lateness) updated by one thread and reset by
+      another
+
+      Unlike a counter, a max can't be reset against epochStats_ - so 
+      reset() only starts a new epoch and the updating thread restarts the
+      max when it next sees a new epoch; until then, value() is 0
+    */
+    class MaxStat
+    {
+    public:
+        MaxStat() : max_(0) {}
+
+        //! Must be called by the updating thread only
+        void update(quint64 value) {
+            int epoch = epoch_;
+            if (epoch != int(seen_)) {
+                max_ = 0;
+                seen_.fetchAndStoreRelease(epoch);
+            }
+            if (value > max_)
+                max_ = value;
+        }
+        void reset() { epoch_.ref(); }
+        quint64 value() {
+            if (seen_.fetchAndAddAcquire(0) != int(epoch_))
+                return 0;
+            return max_;
+        }
+
+    private:
+        QAtomicInt epoch_;  // bumped by reset()
+        QAtomicInt seen_;   // epoch of max_
+        volatile quint64 max_;
+    };
+
+    /*!
+      Time varying transmit rate
+
+      A rate profile is a list of steps, each with a duration and a rate 
+      (percentage of the configured rate) which changes linearly from its
+      start to its end value over the step; the rate of the last step holds
+      once the profile is done. The packet list is built at the configured
+      rate and the transmitter scales each gap in it as per the profile, so
+      a whole profile runs off a single packet list
+
+      advance() is called by the transmitter for every gap - to keep that
+      cheap, the scale factor is recomputed only every kUpdateNsec during
+      a ramp (and at step boundaries)
+    */
+    class RateProfile
+    {
+    public:
+        RateProfile() { reset(); }
+
+        void clear() { steps_.clear(); }
+        void append(double durationSec, double startPercent, 
+                double endPercent);
+        bool isEmpty() const { return steps_.isEmpty(); }
+
+        //! Rewinds to the start of the profile
+        void reset() {
+            step_ = 0;
+            now_ = 0;
+            scale_ = 1.0;
+            nextUpdate_ = 0;
+        }
+
+        //! Returns nsecs since start when a packet nominally nsec after 
+        //! the previous one is due
+        quint64 advance(quint64 nsec) {
+            if (now_ >= nextUpdate_)
+                update();
+            now_ += nsec * scale_;
+            return quint64(now_);
+        }
+        quint64 now() const { return quint64(now_); }
+
+        //! Same as advance() but returns the actual (scaled) gap
+        quint64 scaled(quint64 nsec) {
+            quint64 start = now();
+            return advance(nsec) - start;
+        }
+
+    private:
+        static const int kUpdateNsec = 1000000; // 1ms
+        static const double kMinPercent;
+
+        struct Step {
+            double startNsec;
+            double endNsec;
+            double startPercent;
+            double endPercent;
+        };
+
+        void update();
+
+        QList<Step> steps_;
+        int step_;
+        double now_;        // nsecs since start (with fraction)
+        double scale_;      // multiplier for nominal gaps
+        double nextUpdate_; // when scale_ has to be recomputed
     };
 
     AbstractPort(int id, const char *device);
@@ -76,16 +248,42 @@ public:
     bool isDirty() { return isSendQueueDirty_; }
     void setDirty() { isSendQueueDirty_ = true; }
 
-    // TODO: convert all timestamp/delay to quint64 from long?
+    // All packet list timestamps are nsecs relative to the start of
+    // transmit; delays are nsecs plus a 32-bit binary fraction of a nsec
+    // which the transmitter carries over (see Timeline) so that repeating
+    // a packet set or looping the list doesn't drift. After the last repeat
+    // of a packet set (and its repeat delay), the next packet is sent
+    // right away and becomes the new timestamp reference
+    //
+    // The packet list is divided into segments (one per stream for
+    // sequential transmit) numbered in the order they are started; packets
+    // appended before any segment is started go into segment 0. After the
+    // last packet of a segment and its delay, transmit continues with the
+    // first packet of the next segment (which is the new timestamp 
+    // reference) - by default there is none i.e. transmit stops
+    //
+    // If transmit is on, the new packet list is built alongside the one
+    // being transmitted and takes effect only when committed - the 
+    // transmitter switches over to it at the next packet set boundary
+    // without stopping; if transmit is off, commit is a no-op. The switch
+    // keeps the position on the segment timeline - segments (streams) 
+    // already done are not sent again, and the one being transmitted 
+    // continues from the same packet set and repeat in the new list if its
+    // packet sets are unchanged, else the switch is deferred to the end of
+    // the segment - so no packet is sent twice; if the new list has no
+    // such next segment, transmit continues from segment 0
     virtual void clearPacketList() = 0;
     virtual void setPacketListSize(quint64 /*size*/){} //FIXME: mk pure virtual
+    virtual void startPacketListSegment() = 0;
     virtual void loopNextPacketSet(qint64 size, qint64 repeats,
-            long repeatDelaySec, long repeatDelayNsec) = 0;
-    virtual bool appendToPacketList(long sec, long nsec, const uchar *packet, 
+            quint64 repeatDelayNsec, quint32 repeatDelayFrac) = 0;
+    virtual bool appendToPacketList(quint64 tsNsec, const uchar *packet,
             int length) = 0;
-    virtual void setPacketListLoopMode(bool loop, 
-            quint64 secDelay, quint64 nsecDelay) = 0;
+    virtual void setPacketListSegmentNext(int segment, int nextSegment,
+            quint64 delayNsec, quint32 delayFrac) = 0;
+    virtual void commitPacketList() = 0;
     void updatePacketList();
+    bool canUpdateWhileTransmitting() { return producer_ == NULL; }
 
     virtual void startTransmit() = 0;
     virtual void stopTransmit() = 0;
@@ -95,28 +293,44 @@ public:
     virtual void stopCapture() = 0;
     virtual bool isCaptureOn() = 0;
     virtual QIODevice* captureData() = 0;
+    virtual bool isCaptureConfigValid(
+            const OstProto::CaptureConfig& /*config*/,
+            QString& /*result*/) { return true; }
 
     void stats(PortStats *stats);
-    void resetStats() { epochStats_ = stats_; }
+    void resetStats() {
+        txMaxLate_.reset(); // a max, not a counter
+        epochStats_ = stats_;
+    }
 
 protected:
     void addNote(QString note);
 
-    void updatePacketListSequential();
-    void updatePacketListInterleaved();
+    bool updatePacketListSequential();
+    bool updatePacketListInterleaved();
 
     bool isUsable_;
     OstProto::Port          data_;
     OstProto::LinkState     linkState_;
     ulong minPacketSetSize_;
 
+    // Non-NULL if packets are to be generated on the fly by a producer
+    // instead of being transmitted from the packet list
+    PacketProducer *producer_;
+
+    RateProfile rateProfile_;
+
     quint64 maxStatsValue_;
     struct PortStats    stats_;
+    MaxStat txMaxLate_;     // nsecs; reported as stats_.txMaxLateNsec
     //! \todo Need lock for stats access/update
 
 private:
     bool    isSendQueueDirty_;
 
+    // Max packets in a packet list beyond which we switch to a producer
+    static const quint64 kMaxPacketListSize = 1 << 20;
+
     static const int kMaxPktSize = 16384;
     uchar   pktBuf_[kMaxPktSize];
 
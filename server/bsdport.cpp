@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include <QByteArray>
 #include <QHash>
+#include <QSet>
 #include <QTime>
 
 #include <errno.h>
@@ -45,17 +46,16 @@ BsdPort::StatsMonitor *BsdPort::monitor_;
 
 const quint32 kMaxValue32 = 0xffffffff;
 
-BsdPort::BsdPort(int id, const char *device)
-    : PcapPort(id, device) 
+/*!
+  Rx/Tx stats are the interface counters, unless useMonitors is true in
+  which case they are counted per packet by the port's own monitors
+*/
+BsdPort::BsdPort(int id, const char *device, bool useMonitors)
+    : PcapPort(id, device, useMonitors) 
 {
     isPromisc_ = true;
     clearPromisc_ = false;
 
-    // We don't need per port Rx/Tx monitors for Bsd
-    delete monitorRx_;
-    delete monitorTx_;
-    monitorRx_ = monitorTx_ = NULL;
-
     // We have one monitor for both Rx/Tx of all ports
     if (!monitor_)
         monitor_ = new StatsMonitor();
@@ -118,6 +118,12 @@ void BsdPort::init()
 
     monitor_->waitForSetupFinished();
 
+    if (hasMonitors())
+    {
+        updateNotes();
+        startMonitors();
+    }
+
     if (!isPromisc_)
         addNote("Non Promiscuous Mode");
 }
@@ -147,6 +153,7 @@ void BsdPort::StatsMonitor::run()
     const int mibLen = sizeof(mib)/sizeof(mib[0]);
     QHash<uint, PortStats*> portStats;
     QHash<uint, OstProto::LinkState*> linkState;
+    QSet<uint> isMonitored; // Rx/Tx counted by the port's own monitors
     int sd;
     QByteArray buf;
     size_t len;
@@ -202,6 +209,8 @@ void BsdPort::StatsMonitor::run()
                     Q_ASSERT(ifm->ifm_index == sdl->sdl_index);
                     portStats[uint(ifm->ifm_index)] = &(port->stats_);
                     linkState[uint(ifm->ifm_index)] = &(port->linkState_);
+                    if (port->hasMonitors())
+                        isMonitored.insert(uint(ifm->ifm_index));
 
                     // Set promisc mode, if not already set
                     strncpy(ifr.ifr_name, port->name(), sizeof(ifr.ifr_name));
@@ -292,31 +301,35 @@ void BsdPort::StatsMonitor::run()
                 *state = (OstProto::LinkState) ifd->ifi_link_state;
 #endif
 
-                in_packets = ifd->ifi_ipackets + ifd->ifi_noproto;
-                stats->rxPps = 
-                    ((in_packets >= stats->rxPkts) ?
-                         in_packets - stats->rxPkts :
-                         in_packets + (kMaxValue32 - stats->rxPkts))
-                     / kRefreshFreq_;
-                stats->rxBps  = 
-                    ((ifd->ifi_ibytes >= stats->rxBytes) ?
-                         ifd->ifi_ibytes - stats->rxBytes :
-                         ifd->ifi_ibytes + (kMaxValue32 - stats->rxBytes))
-                     / kRefreshFreq_;
-                stats->rxPkts  = in_packets;
-                stats->rxBytes = ifd->ifi_ibytes;
-                stats->txPps  = 
-                    ((ifd->ifi_opackets >= stats->txPkts) ?
-                         ifd->ifi_opackets - stats->txPkts :
-                         ifd->ifi_opackets + (kMaxValue32 - stats->txPkts))
-                     / kRefreshFreq_;
-                stats->txBps  = 
-                    ((ifd->ifi_obytes >= stats->txBytes) ?
-                         ifd->ifi_obytes - stats->txBytes :
-                         ifd->ifi_obytes + (kMaxValue32 - stats->txBytes))
-                     / kRefreshFreq_;
-                stats->txPkts  = ifd->ifi_opackets;
-                stats->txBytes = ifd->ifi_obytes;
+                // Rx/Tx of a monitored port are counted by its monitors
+                if (!isMonitored.contains(ifm->ifm_index))
+                {
+                    in_packets = ifd->ifi_ipackets + ifd->ifi_noproto;
+                    stats->rxPps = 
+                        ((in_packets >= stats->rxPkts) ?
+                             in_packets - stats->rxPkts :
+                             in_packets + (kMaxValue32 - stats->rxPkts))
+                         / kRefreshFreq_;
+                    stats->rxBps  = 
+                        ((ifd->ifi_ibytes >= stats->rxBytes) ?
+                             ifd->ifi_ibytes - stats->rxBytes :
+                             ifd->ifi_ibytes + (kMaxValue32 - stats->rxBytes))
+                         / kRefreshFreq_;
+                    stats->rxPkts  = in_packets;
+                    stats->rxBytes = ifd->ifi_ibytes;
+                    stats->txPps  = 
+                        ((ifd->ifi_opackets >= stats->txPkts) ?
+                             ifd->ifi_opackets - stats->txPkts :
+                             ifd->ifi_opackets + (kMaxValue32 - stats->txPkts))
+                         / kRefreshFreq_;
+                    stats->txBps  = 
+                        ((ifd->ifi_obytes >= stats->txBytes) ?
+                             ifd->ifi_obytes - stats->txBytes :
+                             ifd->ifi_obytes + (kMaxValue32 - stats->txBytes))
+                         / kRefreshFreq_;
+                    stats->txPkts  = ifd->ifi_opackets;
+                    stats->txBytes = ifd->ifi_obytes;
+                }
 
                 stats->rxDrops = ifd->ifi_iqdrops;
                 stats->rxErrors = ifd->ifi_ierrors;
@@ -330,6 +343,7 @@ _try_later:
 
     portStats.clear();
     linkState.clear();
+    isMonitored.clear();
 }
 
 void BsdPort::StatsMonitor::stop()
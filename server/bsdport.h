@@ -29,7 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 class BsdPort : public PcapPort
 {
 public:
-    BsdPort(int id, const char *device);
+    BsdPort(int id, const char *device, bool useMonitors = false);
     ~BsdPort();
 
     void init();
@@ -0,0 +1,245 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "capturewriter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <pcap.h>
+
+struct PcapRecordHeader {
+    quint32 tsSec;
+    quint32 tsUsec;
+    quint32 caplen;
+    quint32 length;
+};
+
+CaptureWriter::CaptureWriter()
+{
+    snapLen_ = 0;
+    isOpen_ = false;
+    file_ = NULL;
+    segmentCount_ = 0;
+    segmentBytes_ = 0;
+    segmentPackets_ = 0;
+    segment_ = 0;
+    segmentsUsed_ = 0;
+    bytes_ = 0;
+    packets_ = 0;
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+/*!
+  Sets up the next open() to write a ring of count segments of upto
+  bytes (file size) and/or packets each; a count of 0 or 1 or no size
+  means a single (unbounded) file
+*/
+void CaptureWriter::setSegments(int count, quint64 bytes, quint64 packets)
+{
+    segmentCount_ = count;
+    segmentBytes_ = bytes;
+    segmentPackets_ = packets;
+}
+
+bool CaptureWriter::open(const QString &fileName, int snapLen)
+{
+    close();
+
+    fileName_ = fileName;
+    snapLen_ = snapLen;
+    segmentsUsed_ = 0;
+    buf_.reserve(kBufferSize + snapLen + sizeof(PcapRecordHeader));
+
+    isOpen_ = openSegment(0);
+    return isOpen_;
+}
+
+/*!
+  Writes out all appended packets and closes the file - for a ring, the
+  retained segments are merged into the capture file
+*/
+bool CaptureWriter::close()
+{
+    bool ret = true;
+
+    if (!isOpen_)
+        return true;
+
+    ret = flush();
+    if (file_)
+        fclose(file_);
+    file_ = NULL;
+    isOpen_ = false;
+
+    if (isRing() && !merge())
+        ret = false;
+
+    return ret;
+}
+
+void CaptureWriter::append(quint32 tsSec, quint32 tsUsec, int caplen,
+        int length, const uchar *data)
+{
+    PcapRecordHeader hdr;
+    quint64 size = sizeof(hdr) + caplen;
+
+    if (isRing() && packets_
+            && ((segmentBytes_ && (bytes_ + size > segmentBytes_))
+                || (segmentPackets_ && (packets_ >= segmentPackets_))))
+    {
+        flush();
+        openSegment((segment_ + 1) % segmentCount_);
+    }
+
+    hdr.tsSec = tsSec;
+    hdr.tsUsec = tsUsec;
+    hdr.caplen = caplen;
+    hdr.length = length;
+    buf_.append((const char*) &hdr, sizeof(hdr));
+    buf_.append((const char*) data, caplen);
+    bytes_ += size;
+    packets_++;
+
+    if (buf_.size() >= kBufferSize)
+        flush();
+}
+
+/*!
+  Writes out all appended packets with a single write
+*/
+bool CaptureWriter::flush()
+{
+    if (buf_.isEmpty())
+        return true;
+
+    // e.g. the segment couldn't be opened
+    if (!file_)
+    {
+        buf_.resize(0);
+        return false;
+    }
+
+    if (fwrite(buf_.constData(), buf_.size(), 1, file_) != 1)
+    {
+        qWarning("%s: error writing cap file: %s", __FUNCTION__,
+                strerror(errno));
+        buf_.resize(0);
+        return false;
+    }
+
+    buf_.resize(0);
+    return true;
+}
+
+/*
+  Truncates and starts writing the segment at index (the only "segment"
+  is the capture file itself, if not a ring)
+*/
+bool CaptureWriter::openSegment(int index)
+{
+    struct pcap_file_header fileHdr;
+    QString name = isRing() ? segmentName(index) : fileName_;
+
+    if (file_)
+        fclose(file_);
+
+    buf_.resize(0);
+    file_ = fopen(name.toAscii().constData(), "wb");
+    if (!file_)
+    {
+        qWarning("%s: unable to open %s: %s", __FUNCTION__,
+                name.toAscii().constData(), strerror(errno));
+        return false;
+    }
+
+    // We do our own buffering
+    setvbuf(file_, NULL, _IONBF, 0);
+
+    memset(&fileHdr, 0, sizeof(fileHdr));
+    fileHdr.magic = 0xa1b2c3d4;
+    fileHdr.version_major = PCAP_VERSION_MAJOR;
+    fileHdr.version_minor = PCAP_VERSION_MINOR;
+    fileHdr.snaplen = snapLen_;
+    fileHdr.linktype = DLT_EN10MB;
+    buf_.append((const char*) &fileHdr, sizeof(fileHdr));
+
+    segment_ = index;
+    segmentsUsed_ = qMax(segmentsUsed_, index + 1);
+    bytes_ = sizeof(fileHdr);
+    packets_ = 0;
+
+    return true;
+}
+
+/*
+  Concatenates the segments, oldest first, into the capture file and
+  removes them
+*/
+bool CaptureWriter::merge()
+{
+    FILE *out = fopen(fileName_.toAscii().constData(), "wb");
+    int first = (segmentsUsed_ < segmentCount_) ? 0 : segment_ + 1;
+    bool ret = (out != NULL);
+
+    if (!out)
+        qWarning("%s: unable to open %s: %s", __FUNCTION__,
+                fileName_.toAscii().constData(), strerror(errno));
+
+    buf_.resize(kBufferSize);
+    for (int i = 0; i < segmentsUsed_; i++)
+    {
+        QString name = segmentName((first + i) % segmentCount_);
+        FILE *in = fopen(name.toAscii().constData(), "rb");
+        size_t n;
+
+        if (!in)
+        {
+            ret = false;
+            continue;
+        }
+
+        // Only the first segment's file header is retained
+        if (i && (fseek(in, sizeof(struct pcap_file_header), SEEK_SET) < 0))
+            ret = false;
+
+        while (out && (n = fread(buf_.data(), 1, buf_.size(), in)) > 0)
+        {
+            if (fwrite(buf_.constData(), n, 1, out) != 1)
+            {
+                qWarning("%s: error writing cap file: %s", __FUNCTION__,
+                        strerror(errno));
+                ret = false;
+                break;
+            }
+        }
+
+        fclose(in);
+        remove(name.toAscii().constData());
+    }
+    buf_.resize(0);
+
+    if (out)
+        fclose(out);
+
+    return ret;
+}
@@ -0,0 +1,87 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_CAPTURE_WRITER_H
+#define _SERVER_CAPTURE_WRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include <stdio.h>
+
+/*!
+  Writes captured packets as a (ethernet) pcap file
+
+  Packets are appended to a buffer which is written out with a single
+  write when it is full or at flush() - so a capture engine which gets
+  packets in batches can flush() once per batch
+
+  If setup as a ring of segments, packets are written to the segments in
+  turn - once a segment is full (as per the segment size in bytes and/or
+  packets), the next one is truncated and written to; so only the last
+  segments are retained and the disk used is bounded. At close(), the
+  retained segments are merged (oldest first) into the capture file.
+  The last (partially written) segment is also retained, so between
+  (count - 1) and count segments worth of packets are retained
+*/
+class CaptureWriter
+{
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    void setSegments(int count, quint64 bytes, quint64 packets);
+    bool open(const QString &fileName, int snapLen);
+    bool close();
+    bool isOpen() const { return isOpen_; }
+
+    void append(quint32 tsSec, quint32 tsUsec, int caplen, int length,
+            const uchar *data);
+    bool flush();
+
+private:
+    static const int kBufferSize = 1024*1024;
+
+    bool isRing() const {
+        return (segmentCount_ > 1) && (segmentBytes_ || segmentPackets_);
+    }
+    QString segmentName(int index) const {
+        return QString("%1.%2").arg(fileName_).arg(index);
+    }
+    bool openSegment(int index);
+    bool merge();
+
+    QString fileName_;
+    int snapLen_;
+    bool isOpen_;
+    FILE *file_;
+    QByteArray buf_;
+
+    int segmentCount_;
+    quint64 segmentBytes_;
+    quint64 segmentPackets_;
+
+    int segment_;           // current segment
+    int segmentsUsed_;      // segments written to, so far
+    quint64 bytes_;         // in the current segment (incl. buf_)
+    quint64 packets_;       // in the current segment (incl. buf_)
+};
+
+#endif
@@ -19,6 +19,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "dpdkport.h"
 
+#include "packetproducer.h"
+#include "../common/ostrace.h"
+
 #include <rte_cycles.h>
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
@@ -26,6 +29,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 static struct rte_eth_conf eth_conf; // FIXME: move to DpdkPort?
 const quint64 kMaxValue64 = ULLONG_MAX;
 
+// Converts nsecs to TSC ticks - split to avoid overflowing the intermediate
+// product (we don't have a 128-bit type on all our targets)
+static inline quint64 nsecToTsc(quint64 nsec, quint64 hz)
+{
+    return (nsec/quint64(1e9))*hz + ((nsec % quint64(1e9))*hz)/quint64(1e9);
+}
+
 int DpdkPort::baseId_ = -1;
 QList<DpdkPort*> DpdkPort::allPorts_;
 DpdkPort::StatsMonitor *DpdkPort::monitor_;
@@ -50,6 +60,8 @@ DpdkPort::DpdkPort(int id, const char *device, struct rte_mempool *mbufPool)
     dpdkPortId_ = id - baseId_;
 
     transmitLcoreId_ = -1;
+    buildList_ = activeList_ = &packetList_[0];
+    committedList_ = NULL;
 
     rte_eth_dev_info_get(dpdkPortId_, &devInfo);
 
@@ -185,66 +197,149 @@ bool DpdkPort::setExclusiveControl(bool exclusive)
 
 void DpdkPort::clearPacketList()
 {
-    for (uint i = 0; i < packetList_.size; i++) {
-        struct rte_mbuf *mbuf = packetList_.packets[i].mbuf;
-        qDebug("refcnt = %u", rte_mbuf_refcnt_read(mbuf));
+    // Find out if the lcore has switched to the list we last committed -
+    // if it hasn't, it won't anymore
+    if (committedList_) {
+        if (!__sync_bool_compare_and_swap(&txInfo_.pendingList, 
+                    committedList_, NULL))
+            activeList_ = committedList_;
+        committedList_ = NULL;
+    }
+
+    if (isTransmitOn()) {
+        // Build the new list while the active one (and the one still 
+        // being transmitted, if different) is in use by the lcore
+        DpdkPacketList *txList = txInfo_.txList;
+
+        for (int i = 0; i < kPacketListCount; i++) {
+            buildList_ = &packetList_[i];
+            if ((buildList_ != activeList_) && (buildList_ != txList))
+                break;
+        }
+        freePacketList(buildList_);
+    }
+    else {
+        for (int i = 0; i < kPacketListCount; i++)
+            freePacketList(&packetList_[i]);
+        buildList_ = activeList_ = &packetList_[0];
+    }
+}
+
+// Makes the newly built packet list the one to be transmitted - if 
+// transmit is on, the lcore switches over to it at the next packet set
+// boundary without stopping
+void DpdkPort::commitPacketList()
+{
+    if (!isTransmitOn())
+        return; // will be used at the next startTransmit()
+
+    committedList_ = buildList_;
+
+    // the list must be complete before the lcore can see it
+    __sync_synchronize();
+    txInfo_.pendingList = buildList_;
+}
+
+void DpdkPort::freePacketList(DpdkPacketList *list)
+{
+    for (uint i = 0; i < list->size; i++) {
+        struct rte_mbuf *mbuf = list->packets[i].mbuf;
+        OST_TRACE(kTraceTx, kTraceDetail,
+                "refcnt = %u", rte_mbuf_refcnt_read(mbuf));
         rte_pktmbuf_free(mbuf);
     }
-    rte_free(packetList_.packets);
-    rte_free(packetList_.packetSet);
-    packetList_.reset();
+    rte_free(list->packets);
+    rte_free(list->packetSet);
+    rte_free(list->segment);
+    list->reset();
 }
 
 void DpdkPort::setPacketListSize(quint64 size)
 {
-    Q_ASSERT(packetList_.packets == NULL);
-    packetList_.size = 0;
-    packetList_.maxSize = size;
+    Q_ASSERT(buildList_->packets == NULL);
+    buildList_->size = 0;
+    buildList_->maxSize = size;
 
     if (size == 0)
         return;
 
-    packetList_.packets = (DpdkPacket*) rte_calloc("pktList", size, 
+    buildList_->packets = (DpdkPacket*) rte_calloc("pktList", size, 
                                                     sizeof(DpdkPacket), 64);
-    if (!packetList_.packets)
+    if (!buildList_->packets)
         qWarning("failed to alloc packetList");
 
     // syncTransmit() may access max of 1 packetSet beyond the last one, so 
     // we play safe and allocate an extra one
-    packetList_.packetSet = (DpdkPacketSet*) rte_calloc("pktSet", 
+    buildList_->packetSet = (DpdkPacketSet*) rte_calloc("pktSet", 
             activeStreamCount()+1, sizeof(DpdkPacketSet), 64);
 
-    if (!packetList_.packetSet)
+    if (!buildList_->packetSet)
         qWarning("failed to alloc packetSet");
 
-    packetList_.packetSet[0].startOfs = 0;
-    packetList_.packetSet[0].endOfs = size - 1;
-    packetList_.packetSet[0].loopCount = 1;
-    packetList_.packetSet[0].repeatDelayUsec = 0;
+    buildList_->packetSet[0].startOfs = 0;
+    buildList_->packetSet[0].endOfs = size - 1;
+    buildList_->packetSet[0].loopCount = 1;
+    buildList_->packetSet[0].repeatDelayNsec = 0;
+    buildList_->packetSet[0].repeatDelayFrac = 0;
     // TODO: return sucess/fail result from function
 }
 
+void DpdkPort::startPacketListSegment()
+{
+    DpdkPacketSegment *segment;
+
+    if (!buildList_->segment) {
+        // one segment per stream for sequential and one for interleaved
+        buildList_->maxSegmentSize = activeStreamCount() + 1;
+        buildList_->segment = (DpdkPacketSegment*) rte_calloc("pktSegment",
+                buildList_->maxSegmentSize, sizeof(DpdkPacketSegment), 64);
+        if (!buildList_->segment) {
+            qWarning("failed to alloc packetSegment");
+            return;
+        }
+    }
+
+    if (buildList_->segmentSize >= buildList_->maxSegmentSize) {
+        qWarning("%s: too many segments", __FUNCTION__);
+        return;
+    }
+
+    segment = &(buildList_->segment[buildList_->segmentSize]);
+    segment->startOfs = buildList_->size;
+    segment->size = 0;
+    segment->firstSet = buildList_->setSize;
+    segment->next = -1;
+    segment->delayNsec = 0;
+    segment->delayFrac = 0;
+
+    buildList_->segmentSize++;
+}
+
 void DpdkPort::loopNextPacketSet(qint64 size, qint64 repeats,
-                               long repeatDelaySec, long repeatDelayNsec)
+                               quint64 repeatDelayNsec, quint32 repeatDelayFrac)
 {
-    DpdkPacketSet *set = &(packetList_.packetSet[packetList_.setSize]);
-    set->startOfs = packetList_.size;
+    if (!buildList_->segmentSize)
+        startPacketListSegment();
+
+    DpdkPacketSet *set = &(buildList_->packetSet[buildList_->setSize]);
+    set->startOfs = buildList_->size;
     set->endOfs = set->startOfs + size - 1;
     set->loopCount = repeats;
-    set->repeatDelayUsec = quint64(repeatDelaySec)*1e6 
-                            + quint64(repeatDelayNsec)/1e3;
+    set->repeatDelayNsec = repeatDelayNsec;
+    set->repeatDelayFrac = repeatDelayFrac;
 
-    qDebug("%s: [%llu] (%llu - %llu)x%llu delay = %llu usec", __FUNCTION__,
-            packetList_.setSize, set->startOfs, set->endOfs, 
-            set->loopCount, set->repeatDelayUsec);
+    OST_TRACE(kTraceBuild, kTraceInfo,
+            "%s: [%llu] (%llu - %llu)x%llu delay = %llu nsec", __FUNCTION__,
+            buildList_->setSize, set->startOfs, set->endOfs, 
+            set->loopCount, set->repeatDelayNsec);
 
-    packetList_.setSize++;
+    buildList_->setSize++;
 
-    if (set->repeatDelayUsec)
-        packetList_.topSpeedTransmit = false;
+    if (set->repeatDelayNsec || set->repeatDelayFrac)
+        buildList_->topSpeedTransmit = false;
 }
 
-bool DpdkPort::appendToPacketList(long sec, long nsec, const uchar *packet, 
+bool DpdkPort::appendToPacketList(quint64 tsNsec, const uchar *packet, 
                                 int length)
 {
     struct rte_mbuf *mbuf = rte_pktmbuf_alloc(mbufPool_);
@@ -255,6 +350,9 @@ bool DpdkPort::appendToPacketList(long sec, long nsec, const uchar *packet,
     if (!mbuf)
         return false;
 
+    if (!buildList_->segmentSize)
+        startPacketListSegment();
+
 #if 0
     // Maximize buffer utilization by removing the headroom
     rte_pktmbuf_prepend(mbuf, rte_pktmbuf_headroom(mbuf));
@@ -274,25 +372,28 @@ bool DpdkPort::appendToPacketList(long sec, long nsec, const uchar *packet,
     }
 
     rte_memcpy(pktData, packet, length);
-    packetList_.packets[packetList_.size].mbuf = mbuf;
-    packetList_.packets[packetList_.size].tsSec = sec;
-    packetList_.packets[packetList_.size].tsNsec = nsec;
-    packetList_.size++;
+    buildList_->packets[buildList_->size].mbuf = mbuf;
+    buildList_->packets[buildList_->size].tsNsec = tsNsec;
+    buildList_->size++;
+    buildList_->segment[buildList_->segmentSize - 1].size++;
 
     //rte_pktmbuf_dump(mbuf, 188);
 
-    if (packetList_.loopDelaySec || packetList_.loopDelayNsec)
-        packetList_.topSpeedTransmit = false;
-
     return true;
 }
 
-void DpdkPort::setPacketListLoopMode(bool loop, 
-                                   quint64 secDelay, quint64 nsecDelay)
+void DpdkPort::setPacketListSegmentNext(int segment, int nextSegment,
+                                      quint64 delayNsec, quint32 delayFrac)
 {
-    packetList_.loop = loop;
-    packetList_.loopDelaySec = secDelay;
-    packetList_.loopDelayNsec = nsecDelay;
+    if (quint64(segment) >= buildList_->segmentSize)
+        return;
+
+    buildList_->segment[segment].next = nextSegment;
+    buildList_->segment[segment].delayNsec = delayNsec;
+    buildList_->segment[segment].delayFrac = delayFrac;
+
+    if (delayNsec || delayFrac)
+        buildList_->topSpeedTransmit = false;
 }
 
 void DpdkPort::startTransmit()
@@ -315,9 +416,21 @@ void DpdkPort::startTransmit()
     txInfo_.portId = dpdkPortId_;
     txInfo_.stopTx = false;
     txInfo_.pool = mbufPool_;
-    txInfo_.list = &packetList_;
-    ret = rte_eal_remote_launch(DpdkPort::syncTransmit, &txInfo_, 
-                transmitLcoreId_);
+    txInfo_.list = txInfo_.txList = activeList_ = buildList_;
+    txInfo_.pendingList = NULL;
+    committedList_ = NULL;
+    txInfo_.producer = producer_;
+    txInfo_.rateProfile = rateProfile_;
+    txInfo_.rateProfile.reset();
+
+    if (producer_) {
+        producer_->start();
+        ret = rte_eal_remote_launch(DpdkPort::producerTransmit, &txInfo_, 
+                    transmitLcoreId_);
+    }
+    else
+        ret = rte_eal_remote_launch(DpdkPort::syncTransmit, &txInfo_, 
+                    transmitLcoreId_);
     if (ret < 0)
         rte_exit(EXIT_FAILURE, "Failed to launch transmit\n");
 }
@@ -326,6 +439,9 @@ void DpdkPort::stopTransmit()
 {
     txInfo_.stopTx = true;
     rte_eal_wait_lcore(transmitLcoreId_);
+
+    if (txInfo_.producer)
+        txInfo_.producer->stop();
 }
 
 bool DpdkPort::isTransmitOn()
@@ -465,69 +581,233 @@ void DpdkPort::StatsMonitor::run()
 int DpdkPort::syncTransmit(void *arg)
 {
     TxInfo *txInfo = (TxInfo*)arg;
-    DpdkPacket *packets = txInfo->list->packets;
-    DpdkPacketSet *packetSet = txInfo->list->packetSet;
-    quint64 loopDelay = txInfo->list->loop ? 
-        txInfo->list->loopDelaySec*1E6 + txInfo->list->loopDelayNsec/1E3 : 0;
-    quint64 lastSec = 0, lastNsec = 0;
-    quint64 n = packetSet->loopCount;
-    uint i = 0;
-
-    qDebug("%s: list sz = %llu", __FUNCTION__, txInfo->list->size);
-    qDebug("%s: set = (%llu-%llu)x%llu delay = %llu", __FUNCTION__, 
-            packetSet->startOfs, packetSet->endOfs, 
-            n, packetSet->repeatDelayUsec);
-
-    while (!txInfo->stopTx) {
-        quint64 sec = packets[i].tsSec;
-        quint64 nsec = packets[i].tsNsec;
-        struct rte_mbuf *mbuf = packets[i].mbuf;
-        quint64 usec = (sec - lastSec)*1e6 + (nsec - lastNsec)/1E3;
+    DpdkPacketList *list = txInfo->list;
+    DpdkPacketList *newList;
+    DpdkPacketList *deferredList = NULL;
+    DpdkPacket *packets = list->packets;
+    RateProfile &profile = txInfo->rateProfile;
+    quint64 hz = rte_get_tsc_hz();
+    quint64 startTsc;
+    quint64 due = 0; // nsecs since startTsc when the next pkt is due
+    quint32 fracAcc = 0;
+    int seg = 0;
+
+    OST_TRACE(kTraceTx, kTraceInfo, "%s: list sz = %llu, segments = %llu",
+            __FUNCTION__, list->size, list->segmentSize);
+
+    if (!list->size || !list->segmentSize)
+        return 0;
+
+    startTsc = rte_rdtsc();
+
+    // Every packet is sent at an absolute deadline relative to startTsc
+    // instead of after a relative delay - so time spent in transmit and
+    // in the loop itself doesn't add up as drift
+    while (!txInfo->stopTx && list->size
+            && (seg >= 0) && (quint64(seg) < list->segmentSize)) {
+        DpdkPacketSegment *segment = &list->segment[seg];
+        DpdkPacketSet *packetSet = &list->packetSet[segment->firstSet];
+        quint64 n = packetSet->loopCount;
+        quint64 i = segment->startOfs;
+        quint64 end = segment->startOfs + segment->size;
+        quint64 lastTs = 0;
+
+        // The first packet of a segment is the timestamp reference
+        if (i < end)
+            lastTs = packets[i].tsNsec;
+
+        while ((i < end) && !txInfo->stopTx) {
+            struct rte_mbuf *mbuf = packets[i].mbuf;
+            quint64 dueTsc;
+
+            due = profile.advance(packets[i].tsNsec - lastTs);
+            lastTs = packets[i].tsNsec;
+
+            dueTsc = startTsc + nsecToTsc(due, hz);
+            while ((rte_rdtsc() < dueTsc) && !txInfo->stopTx)
+                ;
+
+            // increment refcnt so that mbuf is not free'd after tx
+            rte_mbuf_refcnt_update(mbuf, 1);
+            //qDebug("refcnt = %u", rte_mbuf_refcnt_read(mbuf));
+            rte_eth_tx_burst(txInfo->portId, 0, &mbuf, 1);
 
-#if 0
-        qDebug("%s: %u, sec/nsec= %llu/%llu => usecs = %llu", __FUNCTION__, 
-                i, sec, nsec, usec);
-#endif
-        // TODO: define and use rte_delay_nsec()
-        if (usec)
-            rte_delay_us(usec);
-
-        // increment refcnt so that mbuf is not free'd after tx
-        rte_mbuf_refcnt_update(mbuf, 1);
-        //qDebug("refcnt = %u", rte_mbuf_refcnt_read(mbuf));
-        rte_eth_tx_burst(txInfo->portId, 0, &mbuf, 1);
-
-        if (i == packetSet->endOfs) {
-            if (packetSet->repeatDelayUsec)
-                rte_delay_us(packetSet->repeatDelayUsec);
-            n--;
-            if (n > 0) {
-                i = packetSet->startOfs;
-                lastSec = packets[i].tsSec;
-                lastNsec = packets[i].tsNsec;
-                continue;
-            }
-            else {
-                packetSet++;
-                n = packetSet->loopCount;
+            if (i == packetSet->endOfs) {
+                due = profile.advance(Timeline::fracDelay(
+                        packetSet->repeatDelayNsec, 
+                        packetSet->repeatDelayFrac, fracAcc));
+                n--;
+                if (n > 0) {
+                    i = packetSet->startOfs;
+                    lastTs = packets[i].tsNsec;
+                    continue;
+                }
+                else {
+                    packetSet++;
+                    n = packetSet->loopCount;
+
+                    // The packet following a set is due right after the 
+                    // set's repeat delay and is the new timestamp reference
+                    if ((i + 1) < end)
+                        lastTs = packets[i + 1].tsNsec;
+
+                    // Switch over to a new packet list (if any) at this
+                    // packet set boundary - the current segment continues
+                    // from the same position in the new list if its
+                    // layout is unchanged, else the switch is deferred to
+                    // the end of the segment so that no packet is sent twice
+                    if (txInfo->pendingList) {
+                        newList = __sync_lock_test_and_set(
+                                        &txInfo->pendingList, NULL);
+                        if (newList
+                                && isSameSegmentLayout(list, newList, seg)) {
+                            DpdkPacketSegment *newSegment = 
+                                                &newList->segment[seg];
+
+                            packetSet = &newList->packetSet[
+                                newSegment->firstSet 
+                                + (packetSet 
+                                    - &list->packetSet[segment->firstSet])];
+                            i = newSegment->startOfs 
+                                    + (i - segment->startOfs);
+                            end = newSegment->startOfs + newSegment->size;
+                            segment = newSegment;
+                            list = newList;
+                            packets = list->packets;
+                            txInfo->txList = list;
+                            deferredList = NULL;
+                            if ((i + 1) < end)
+                                lastTs = packets[i + 1].tsNsec;
+                        }
+                        else if (newList)
+                            deferredList = newList;
+                    }
+                }
             }
+
+            i++;
+        }
+
+        due = profile.advance(Timeline::fracDelay(segment->delayNsec, 
+                    segment->delayFrac, fracAcc));
+        seg = segment->next;
+
+        // The new list (if any) continues with the next segment
+        newList = deferredList;
+        if (txInfo->pendingList) {
+            DpdkPacketList *pendingList = __sync_lock_test_and_set(
+                                                &txInfo->pendingList, NULL);
+            if (pendingList)
+                newList = pendingList;
+        }
+        if (newList) {
+            list = newList;
+            packets = list->packets;
+            txInfo->txList = list;
+            deferredList = NULL;
+            if ((seg >= 0) && (quint64(seg) >= list->segmentSize))
+                seg = 0;
         }
+    }
+
+    qDebug("finished syncTransmit");
+
+    return 0;
+}
+
+// Returns true if segment seg has the same packet sets (offsets relative
+// to the segment start and loop counts) in both lists, so that a transmit
+// in progress can continue from the same position in list2
+bool DpdkPort::isSameSegmentLayout(const DpdkPacketList *list1,
+        const DpdkPacketList *list2, int seg)
+{
+    if ((quint64(seg) >= list1->segmentSize) 
+            || (quint64(seg) >= list2->segmentSize))
+        return false;
 
-        lastSec = sec;
-        lastNsec = nsec;
+    const DpdkPacketSegment *segment1 = &list1->segment[seg];
+    const DpdkPacketSegment *segment2 = &list2->segment[seg];
+    quint64 lastSet1 = (quint64(seg + 1) < list1->segmentSize) ?
+                        list1->segment[seg + 1].firstSet : list1->setSize;
+    quint64 lastSet2 = (quint64(seg + 1) < list2->segmentSize) ?
+                        list2->segment[seg + 1].firstSet : list2->setSize;
 
-        if (++i >= txInfo->list->size) {
-            i = 0;
-            packetSet = txInfo->list->packetSet;
-            n = packetSet->loopCount;
-            if (loopDelay)
-                rte_delay_us(loopDelay);
-            else
+    if ((segment1->size != segment2->size)
+            || ((lastSet1 - segment1->firstSet) 
+                    != (lastSet2 - segment2->firstSet)))
+        return false;
+
+    for (quint64 k = 0; k < (lastSet1 - segment1->firstSet); k++) {
+        const DpdkPacketSet *set1 = &list1->packetSet[segment1->firstSet + k];
+        const DpdkPacketSet *set2 = &list2->packetSet[segment2->firstSet + k];
+
+        if (((set1->startOfs - segment1->startOfs) 
+                    != (set2->startOfs - segment2->startOfs))
+                || ((set1->endOfs - segment1->startOfs) 
+                    != (set2->endOfs - segment2->startOfs))
+                || (set1->loopCount != set2->loopCount))
+            return false;
+    }
+
+    return true;
+}
+
+// Transmits packets generated on the fly by the producer at absolute
+// deadlines same as syncTransmit(); unlike the packet list, the producer's
+// buffers are reused, so each packet is copied into a fresh mbuf
+int DpdkPort::producerTransmit(void *arg)
+{
+    TxInfo *txInfo = (TxInfo*)arg;
+    PacketProducer *producer = txInfo->producer;
+    RateProfile &profile = txInfo->rateProfile;
+    quint64 hz = rte_get_tsc_hz();
+    quint64 startTsc = rte_rdtsc();
+    quint64 due = 0;
+    quint64 lastTs = 0;
+
+    while (!txInfo->stopTx) {
+        const PacketProducer::Packet *pkt = producer->peek();
+        struct rte_mbuf *mbuf;
+        quint64 dueTsc;
+        char *pktData;
+        int len;
+
+        if (!pkt) {
+            if (producer->isDone())
                 break;
+            producer->waitForPackets(); // producer is behind
+            continue;
         }
+
+        mbuf = rte_pktmbuf_alloc(txInfo->pool);
+        if (!mbuf)
+            continue; // retry after the driver frees up some mbufs
+
+        // Truncate packet data if our mbuf is not big enough
+        // TODO: use segments!
+        len = pkt->length;
+        if (len > rte_pktmbuf_tailroom(mbuf))
+            len = rte_pktmbuf_tailroom(mbuf);
+        pktData = rte_pktmbuf_append(mbuf, len);
+        rte_memcpy(pktData, pkt->data, len);
+
+        due = profile.advance(pkt->tsNsec - lastTs);
+        lastTs = pkt->tsNsec;
+        dueTsc = startTsc + nsecToTsc(due, hz);
+        while ((rte_rdtsc() < dueTsc) && !txInfo->stopTx)
+            ;
+
+        while (!rte_eth_tx_burst(txInfo->portId, 0, &mbuf, 1)) {
+            if (txInfo->stopTx) {
+                rte_pktmbuf_free(mbuf);
+                break;
+            }
+        }
+
+        producer->pop();
     }
 
-    qDebug("finished syncTransmit");
+    qDebug("finished producerTransmit");
 
     return 0;
 }
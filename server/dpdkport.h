@@ -43,12 +43,16 @@ public:
 
     virtual void clearPacketList();
             void setPacketListSize(quint64 size);
+    virtual void startPacketListSegment();
     virtual void loopNextPacketSet(qint64 size, qint64 repeats,
-                                   long repeatDelaySec, long repeatDelayNsec);
-    virtual bool appendToPacketList(long sec, long nsec, const uchar *packet, 
+                                   quint64 repeatDelayNsec, 
+                                   quint32 repeatDelayFrac);
+    virtual bool appendToPacketList(quint64 tsNsec, const uchar *packet, 
                                     int length);
-    virtual void setPacketListLoopMode(bool loop, 
-                                       quint64 secDelay, quint64 nsecDelay);
+    virtual void setPacketListSegmentNext(int segment, int nextSegment,
+                                          quint64 delayNsec, 
+                                          quint32 delayFrac);
+    virtual void commitPacketList();
     virtual void startTransmit();
     virtual void stopTransmit();
     virtual bool isTransmitOn();
@@ -65,6 +69,7 @@ public:
 
     static int topSpeedTransmit(void *arg);
     static int syncTransmit(void *arg);
+    static int producerTransmit(void *arg);
 
 private:
     class StatsMonitor: public QThread
@@ -82,36 +87,46 @@ private:
 
     typedef struct DpdkPacket {
         struct rte_mbuf *mbuf;
-        long tsSec;
-        long tsNsec;
+        quint64 tsNsec;
     } DpdkPacket;
 
     typedef struct DpdkPacketSet {
         quint64 startOfs;
         quint64 endOfs;
         quint64 loopCount;
-        quint64 repeatDelayUsec;   // valid only if loopCount > 0
+        quint64 repeatDelayNsec;   // valid only if loopCount > 0
+        quint32 repeatDelayFrac;   // valid only if loopCount > 0
 
         DpdkPacketSet()
         {
             startOfs = endOfs = 0;
             loopCount = 1;
-            repeatDelayUsec = 0;
+            repeatDelayNsec = 0;
+            repeatDelayFrac = 0;
         }
     } DpdkPacketSet;
 
+    typedef struct DpdkPacketSegment {
+        quint64 startOfs;
+        quint64 size;       // count of packets in the segment
+        quint64 firstSet;   // first packetSet at or after startOfs
+        int next;           // next segment, -1 => stop
+        quint64 delayNsec;  // delay before the next segment
+        quint32 delayFrac;
+    } DpdkPacketSegment;
+
     typedef struct DpdkPacketList {
         DpdkPacket *packets;
         quint64 size; // current count of elements in packets[]
         quint64 maxSize; // max number of elements in packets[]
 
-        bool loop;
-        quint64 loopDelaySec;   // valid only if loop == true
-        quint64 loopDelayNsec;  // valid only if loop == true
-
         DpdkPacketSet *packetSet;
         quint64 setSize; // current count of elements in packetSet[]
 
+        DpdkPacketSegment *segment;
+        quint64 segmentSize; // current count of elements in segment[]
+        quint64 maxSegmentSize; // max number of elements in segment[]
+
         bool topSpeedTransmit;
 
         DpdkPacketList()
@@ -123,10 +138,11 @@ private:
             packets = NULL;
             size = 0;
             maxSize = 0;
-            loop = false;
-            loopDelaySec = loopDelayNsec = 0;
             packetSet = NULL;
             setSize = 0;
+            segment = NULL;
+            segmentSize = 0;
+            maxSegmentSize = 0;
             topSpeedTransmit = true;
         }
     } DpdkPacketList;
@@ -136,6 +152,10 @@ private:
         bool stopTx;
         struct rte_mempool *pool;
         DpdkPacketList *list;
+        DpdkPacketList * volatile pendingList; // taken over by the lcore
+        DpdkPacketList * volatile txList; // being transmitted by the lcore
+        PacketProducer *producer;
+        RateProfile rateProfile;
 
         TxInfo() 
         {
@@ -143,6 +163,9 @@ private:
             stopTx = true;
             pool = NULL;
             list = NULL;
+            pendingList = NULL;
+            txList = NULL;
+            producer = NULL;
         }
     } TxInfo;
 
@@ -152,8 +175,22 @@ private:
     struct rte_eth_txconf txConf_;
 
     int transmitLcoreId_;
+    void freePacketList(DpdkPacketList *list);
+    static bool isSameSegmentLayout(const DpdkPacketList *list1,
+            const DpdkPacketList *list2, int seg);
+
     TxInfo txInfo_;
-    DpdkPacketList packetList_;
+
+    // The packet list is buffered so that it can be rebuilt while the
+    // lcore is transmitting - buildList_ is the one being built and
+    // activeList_ the one last handed over to the lcore (same if not
+    // transmitting); the lcore may take a list but keep transmitting
+    // txInfo_.txList till the end of the segment - hence a third list
+    static const int kPacketListCount = 3;
+    DpdkPacketList packetList_[kPacketListCount];
+    DpdkPacketList *buildList_;
+    DpdkPacketList *activeList_;
+    DpdkPacketList *committedList_;
 
     static int baseId_;
     static QList<DpdkPort*> allPorts_;
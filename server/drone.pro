@@ -28,6 +28,7 @@ win32 {
 }
 unix: include(dpdk.pri)
 LIBS += -lm
+linux*:LIBS += -lrt
 LIBS += -lprotobuf
 HEADERS += drone.h 
 SOURCES += \
@@ -36,11 +37,18 @@ SOURCES += \
     portmanager.cpp \
     dpdk.cpp \
     abstractport.cpp \
+    packetproducer.cpp \
     pcapport.cpp \
     bsdport.cpp \
+    capturewriter.cpp \
     dpdkport.cpp \
     linuxport.cpp \
-    winpcapport.cpp 
+    linuxrxring.cpp \
+    linuxtxmmsg.cpp \
+    linuxtxring.cpp \
+    linuxxsk.cpp \
+    winpcapport.cpp \
+    xdpport.cpp 
 SOURCES += myservice.cpp 
 SOURCES += pcapextra.cpp 
 
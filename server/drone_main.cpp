@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include "drone.h"
 
 #include "dpdk.h"
+#include "../common/ostrace.h"
 #include "../common/protocolmanager.h"
 
 #include <google/protobuf/stubs/common.h>
@@ -83,6 +84,8 @@ int main(int argc, char *argv[])
     exitCode = app.exec();
 
 _exit:
+    ostTraceDump();
+
     delete drone;
     delete OstProtocolManager;
 
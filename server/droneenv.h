@@ -0,0 +1,72 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_DRONE_ENV_H
+#define _SERVER_DRONE_ENV_H
+
+#include <QByteArray>
+#include <QList>
+#include <QtGlobal>
+
+/*
+  Drone run-time options which are set via environment variables - all
+  of them are read here (except OST_TRACE - see common/ostrace.h), so
+  that they are documented in one place
+
+  OST_XDP_PORTS       Comma separated list of interfaces to be used as
+                      AF_XDP ports (Linux) - see XdpPort
+  OST_MONITOR_PORTS   Comma separated list of interfaces whose Rx/Tx 
+                      stats are counted per packet (direction accurate)
+                      instead of the interface counters (Linux, BSD)
+  OST_STATS_INTERVAL  Interval (in msecs) at which the interface stats
+                      and rates are refreshed (Linux) - default 1000,
+                      min 10
+*/
+
+/*
+  Returns the comma separated list in the environment variable var (an
+  empty list if not set)
+*/
+inline QList<QByteArray> droneEnvList(const char *var)
+{
+    QByteArray env = qgetenv(var);
+
+    if (env.isEmpty())
+        return QList<QByteArray>();
+
+    return env.split(',');
+}
+
+inline QList<QByteArray> droneXdpPorts()
+{
+    return droneEnvList("OST_XDP_PORTS");
+}
+
+inline QList<QByteArray> droneMonitorPorts()
+{
+    return droneEnvList("OST_MONITOR_PORTS");
+}
+
+// Returns 0 if not set
+inline int droneStatsInterval()
+{
+    return qgetenv("OST_STATS_INTERVAL").toInt();
+}
+
+#endif
@@ -21,13 +21,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #ifdef Q_OS_LINUX
 
+#include "droneenv.h"
+#include "linuxtxmmsg.h"
+#include "linuxtxring.h"
+
 #include <QByteArray>
 #include <QHash>
+#include <QSet>
 #include <QTime>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <net/if.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -40,18 +46,33 @@ QList<LinuxPort*> LinuxPort::allPorts_;
 LinuxPort::StatsMonitor *LinuxPort::monitor_;
 
 const quint32 kMaxValue32 = 0xffffffff;
+const quint64 kMaxValue64 = ~Q_UINT64_C(0);
 
-LinuxPort::LinuxPort(int id, const char *device)
-    : PcapPort(id, device) 
+static inline qint64 monotonicUsecs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
+// Returns the increment of a counter which wraps around after max
+static inline quint64 counterDelta(quint64 curr, quint64 prev, quint64 max)
+{
+    return (curr >= prev) ? curr - prev : curr + (max - prev) + 1;
+}
+
+/*!
+  Rx/Tx stats are the interface counters, unless useMonitors is true in
+  which case they are counted per packet by the port's own monitors
+  (other stats e.g. drops and errors are still the interface counters)
+*/
+LinuxPort::LinuxPort(int id, const char *device, bool useMonitors)
+    : PcapPort(id, device, useMonitors) 
 {
     isPromisc_ = true;
     clearPromisc_ = false;
 
-    // We don't need per port Rx/Tx monitors for Linux
-    delete monitorRx_;
-    delete monitorTx_;
-    monitorRx_ = monitorTx_ = NULL;
-
     // We have one monitor for both Rx/Tx of all ports
     if (!monitor_)
         monitor_ = new StatsMonitor();
@@ -62,7 +83,9 @@ LinuxPort::LinuxPort(int id, const char *device)
     qDebug("adding dev to LinuxPort|allPorts list <%s>", device);
     allPorts_.append(this);
 
-    maxStatsValue_ = 0xffffffff;
+    // 64 bit netlink stats; lowered by StatsMonitor if it falls back to 
+    // 32 bit stats
+    maxStatsValue_ = kMaxValue64;
 }
 
 LinuxPort::~LinuxPort()
@@ -103,15 +126,72 @@ LinuxPort::~LinuxPort()
 
 void LinuxPort::init()
 {
+    LinuxTxQueue *txQueue;
+
     if (!monitor_->isRunning())
         monitor_->start();
 
     monitor_->waitForSetupFinished();
 
+    if (hasMonitors())
+    {
+        updateNotes();
+        startMonitors();
+    }
+
+    // Transmit packets in batches instead of one syscall per packet
+    txQueue = createTxQueue();
+    if (txQueue)
+        transmitter()->setTxQueue(txQueue);
+
     if (!isPromisc_)
         addNote("Non Promiscuous Mode");
 }
 
+/*!
+  Returns a new (open) transmit queue for the port or NULL if none can
+  be opened - a PACKET_MMAP tx ring, if possible, else sendmmsg() (e.g.
+  for virtual interfaces which don't support a tx ring)
+*/
+LinuxTxQueue* LinuxPort::createTxQueue()
+{
+    LinuxTxRing *txRing = new LinuxTxRing;
+    LinuxTxMmsg *txMmsg;
+
+    if (txRing->open(name()))
+        return txRing;
+    delete txRing;
+
+    txMmsg = new LinuxTxMmsg;
+    if (txMmsg->open(name()))
+        return txMmsg;
+    delete txMmsg;
+
+    return NULL;
+}
+
+/*!
+  Transmitted packets bypass the qdisc layer (if supported by the tx 
+  queue) unless capture is on or the port has monitors - bypassed packets
+  are not seen by capture or the tx monitor
+*/
+void LinuxPort::startTransmit()
+{
+    transmitter()->setQdiscBypass(!hasMonitors() && !isCaptureOn());
+    PcapPort::startTransmit();
+}
+
+/*!
+  Stops bypassing the qdisc layer for transmit, so that capture sees the
+  transmitted packets too - bypass is re-evaluated at the next 
+  startTransmit()
+*/
+void LinuxPort::startCapture()
+{
+    transmitter()->setQdiscBypass(false);
+    PcapPort::startCapture();
+}
+
 OstProto::LinkState LinuxPort::linkState()
 {
     return linkState_; 
@@ -134,6 +214,14 @@ LinuxPort::StatsMonitor::StatsMonitor()
 {
     stop_ = false;
     setupDone_ = false;
+
+    // Finer grained rates, if required, with a shorter interval
+    refreshInterval_ = droneStatsInterval();
+    if (refreshInterval_ <= 0)
+        refreshInterval_ = kRefreshInterval_;
+    refreshInterval_ = qMax(refreshInterval_, kMinRefreshInterval_);
+    qDebug("stats refresh interval = %d msecs", refreshInterval_);
+
     ioctlSocket_ = socket(AF_INET, SOCK_DGRAM, 0);
     Q_ASSERT(ioctlSocket_ >= 0);
 }
@@ -155,6 +243,7 @@ void LinuxPort::StatsMonitor::run()
 void LinuxPort::StatsMonitor::procStats()
 {
     PortStats **portStats;
+    bool *isMonitored; // Rx/Tx counted by the port's own monitors
     int fd;
     QByteArray buf;
     int len;
@@ -211,6 +300,8 @@ void LinuxPort::StatsMonitor::procStats()
 
     portStats = (PortStats**) calloc(count, sizeof(PortStats));
     Q_ASSERT(portStats != NULL);
+    isMonitored = (bool*) calloc(count, sizeof(bool));
+    Q_ASSERT(isMonitored != NULL);
 
     //
     // Populate the port stats array
@@ -247,6 +338,8 @@ void LinuxPort::StatsMonitor::procStats()
                 if (strncmp(port->name(), p, int(q-p)) == 0)
                 {
                     portStats[index] = &(port->stats_);
+                    isMonitored[index] = port->hasMonitors();
+                    port->maxStatsValue_ = kMaxValue32;
 
                     if (setPromisc(port->name()))
                         port->clearPromisc_ = true;
@@ -330,33 +423,37 @@ void LinuxPort::StatsMonitor::procStats()
             if (index < count)
             {
                 AbstractPort::PortStats *stats = portStats[index];
-                if (stats)
+
+                // Rx/Tx of a monitored port are counted by its monitors
+                if (stats && !isMonitored[index])
                 {
                     stats->rxPps = 
                         ((rxPkts >= stats->rxPkts) ? 
                                 rxPkts - stats->rxPkts : 
                                 rxPkts + (kMaxValue32 - stats->rxPkts))
-                        / kRefreshFreq_;
+                        * 1000 / refreshInterval_;
                     stats->rxBps = 
                         ((rxBytes >= stats->rxBytes) ? 
                                 rxBytes - stats->rxBytes : 
                                 rxBytes + (kMaxValue32 - stats->rxBytes))
-                        / kRefreshFreq_;
+                        * 1000 / refreshInterval_;
                     stats->rxPkts  = rxPkts;
                     stats->rxBytes = rxBytes;
                     stats->txPps = 
                         ((txPkts >= stats->txPkts) ? 
                                 txPkts - stats->txPkts : 
                                 txPkts + (kMaxValue32 - stats->txPkts))
-                        / kRefreshFreq_;
+                        * 1000 / refreshInterval_;
                     stats->txBps = 
                         ((txBytes >= stats->txBytes) ? 
                                 txBytes - stats->txBytes : 
                                 txBytes + (kMaxValue32 - stats->txBytes))
-                        / kRefreshFreq_;
+                        * 1000 / refreshInterval_;
                     stats->txPkts  = txPkts;
                     stats->txBytes = txBytes;
-
+                }
+                if (stats)
+                {
                     stats->rxDrops = rxDrops;
                     stats->rxErrors = rxErrors;
                     stats->rxFifoErrors = rxFifo;
@@ -369,16 +466,19 @@ void LinuxPort::StatsMonitor::procStats()
             p++;
             index++;
         }
-        QThread::sleep(kRefreshFreq_);
+        QThread::msleep(refreshInterval_);
     }
 
     free(portStats);
+    free(isMonitored);
 }
 
 int LinuxPort::StatsMonitor::netlinkStats()
 {
     QHash<uint, PortStats*> portStats;
     QHash<uint, OstProto::LinkState*> linkState;
+    QHash<uint, quint64*> maxStatsValue;
+    QSet<uint> isMonitored; // Rx/Tx counted by the port's own monitors
     int fd;
     struct sockaddr_nl local;
     struct sockaddr_nl kernel;
@@ -392,6 +492,11 @@ int LinuxPort::StatsMonitor::netlinkStats()
     struct msghdr msg;
     struct nlmsghdr *nlm;
     bool done = false;
+    int group = RTNLGRP_LINK;
+    quint32 seq = 0;            // of the last stats poll
+    bool isPollPending = false;
+    qint64 nextPoll, lastPoll;  // in usecs
+    qint64 elapsed = 0;         // since the previous poll, in usecs
 
     //
     // We first setup stuff before we start polling for stats
@@ -537,7 +642,7 @@ _retry:
 
         ifi = (struct ifinfomsg*) NLMSG_DATA(nlm);
         rta = IFLA_RTA(ifi);
-        rtaLen = len - NLMSG_LENGTH(sizeof(*ifi));
+        rtaLen = IFLA_PAYLOAD(nlm);
         while (RTA_OK(rta, rtaLen))
         {
             if (rta->rta_type == IFLA_IFNAME)
@@ -556,6 +661,9 @@ _retry:
             {
                 portStats[uint(ifi->ifi_index)] = &(port->stats_);
                 linkState[uint(ifi->ifi_index)] = &(port->linkState_);
+                maxStatsValue[uint(ifi->ifi_index)] = &(port->maxStatsValue_);
+                if (port->hasMonitors())
+                    isMonitored.insert(uint(ifi->ifi_index));
 
                 if (setPromisc(port->name()))
                     port->clearPromisc_ = true;
@@ -582,27 +690,85 @@ _retry:
     qDebug("stats for %d ports setup", count);
     setupDone_ = true;
 
+    // Link state changes are notified as they happen instead of being
+    // picked up only at the next poll
+    if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                &group, sizeof(group)) < 0)
+        qWarning("Unable to subscribe to link events (errno %d)", errno);
+
     //
     // We are all set - Let's start polling for stats!
     //
+    nextPoll = monotonicUsecs();
+    lastPoll = nextPoll - refreshInterval_*1000;
     while (!stop_)
     {
-        if (send(fd, (void*)&ifListReq, sizeof(ifListReq), 0) < 0)
+        qint64 now = monotonicUsecs();
+        struct pollfd pfd;
+        int ret;
+
+        if (now >= nextPoll)
         {
-            qWarning("Unable to send GETLINK request (errno %d)", errno);
-            goto _try_later;
+            // A poll whose reply was lost is given up on (its late reply,
+            // if any, is ignored as it won't match seq) so that stats
+            // don't stop being updated
+            if (isPollPending
+                    && ((now - lastPoll) >= 2*refreshInterval_*1000))
+            {
+                qDebug("previous stats poll timed out");
+                isPollPending = false;
+            }
+
+            if (isPollPending)
+                qDebug("previous stats poll not done - skipping this one");
+            else
+            {
+                ifListReq.nlh.nlmsg_seq = ++seq;
+                if (send(fd, (void*)&ifListReq, sizeof(ifListReq), 0) < 0)
+                    qWarning("Unable to send GETLINK request (errno %d)", errno);
+                else
+                {
+                    // Rates are over the actual (not nominal) interval
+                    elapsed = now - lastPoll;
+                    lastPoll = now;
+                    isPollPending = true;
+                }
+            }
+
+            nextPoll += refreshInterval_*1000;
+            if (nextPoll <= now) // too late to catch up
+                nextPoll = now + refreshInterval_*1000;
         }
 
-        done = false;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, int((nextPoll - now + 999)/1000));
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            qWarning("netlink poll error %d", errno);
+            break;
+        }
+        else if (ret == 0)
+            continue;
 
-_retry_recv:
         msg.msg_flags = 0;
-        len = recvmsg(fd, &msg, 0);
+        len = recvmsg(fd, &msg, MSG_DONTWAIT);
 
         if (len < 0)
         {
             if (errno == EINTR || errno == EAGAIN)
-                goto _retry_recv;
+                continue;
+            // Lost link events or (part of) the reply to our poll - the
+            // next poll catches up
+            if (errno == ENOBUFS)
+            {
+                qDebug("netlink link events overrun");
+                isPollPending = false;
+                continue;
+            }
             qWarning("netlink recv error %d", errno);
             break;
         }
@@ -615,105 +781,138 @@ _retry_recv:
         nlm = (struct nlmsghdr*) buf.data();
         while (NLMSG_OK(nlm, (uint)len))
         {
-            struct ifinfomsg *ifi;
-            struct rtattr *rta;
-            int rtaLen;
-
-            if (nlm->nlmsg_type == NLMSG_DONE) 
-            {
-                done = true;
-                break;
-            }
-
-            if (nlm->nlmsg_type == NLMSG_ERROR)
+            if ((nlm->nlmsg_type == NLMSG_DONE) 
+                    || (nlm->nlmsg_type == NLMSG_ERROR))
             {
-                struct nlmsgerr *err = (struct nlmsgerr*) NLMSG_DATA(nlm);
-                qDebug("RTNETLINK error: %s", strerror(-err->error));
-                done = true;
-                break;
+                if (nlm->nlmsg_type == NLMSG_ERROR)
+                {
+                    struct nlmsgerr *err = (struct nlmsgerr*) NLMSG_DATA(nlm);
+                    qDebug("RTNETLINK error: %s", strerror(-err->error));
+                }
+                if (nlm->nlmsg_seq == seq)
+                    isPollPending = false;
             }
-
-            Q_ASSERT(nlm->nlmsg_type == RTM_NEWLINK);
-
-            ifi = (struct ifinfomsg*) NLMSG_DATA(nlm);
-            rta = IFLA_RTA(ifi);
-            rtaLen = len - NLMSG_LENGTH(sizeof(*ifi));
-            while (RTA_OK(rta, rtaLen))
+            else if (nlm->nlmsg_type == RTM_NEWLINK)
             {
-                // TODO: IFLA_STATS64
-                if (rta->rta_type == IFLA_STATS)
-                {
-                    struct rtnl_link_stats *rtnlStats = 
-                            (struct rtnl_link_stats*) RTA_DATA(rta);
-                    AbstractPort::PortStats *stats = portStats[ifi->ifi_index];
-                    OstProto::LinkState *state = linkState[ifi->ifi_index];
-
-                    if (!stats)
-                        break;
+                struct ifinfomsg *ifi = (struct ifinfomsg*) NLMSG_DATA(nlm);
+                AbstractPort::PortStats *stats = 
+                        portStats.value(uint(ifi->ifi_index));
+                OstProto::LinkState *state = 
+                        linkState.value(uint(ifi->ifi_index));
 
-                    stats->rxPps = 
-                        ((rtnlStats->rx_packets >= stats->rxPkts) ?
-                            rtnlStats->rx_packets - stats->rxPkts :
-                            rtnlStats->rx_packets + (kMaxValue32 
-                                                        - stats->rxPkts))
-                        / kRefreshFreq_;
-                    stats->rxBps = 
-                        ((rtnlStats->rx_bytes >= stats->rxBytes) ?
-                            rtnlStats->rx_bytes - stats->rxBytes :
-                            rtnlStats->rx_bytes + (kMaxValue32 
-                                                        - stats->rxBytes))
-                        / kRefreshFreq_;
-                    stats->rxPkts  = rtnlStats->rx_packets;
-                    stats->rxBytes = rtnlStats->rx_bytes;
-                    stats->txPps = 
-                        ((rtnlStats->tx_packets >= stats->txPkts) ?
-                            rtnlStats->tx_packets - stats->txPkts :
-                            rtnlStats->tx_packets + (kMaxValue32 
-                                                        - stats->txPkts))
-                        / kRefreshFreq_;
-                    stats->txBps = 
-                        ((rtnlStats->tx_bytes >= stats->txBytes) ?
-                            rtnlStats->tx_bytes - stats->txBytes :
-                            rtnlStats->tx_bytes + (kMaxValue32 
-                                                        - stats->txBytes))
-                        / kRefreshFreq_;
-                    stats->txPkts  = rtnlStats->tx_packets;
-                    stats->txBytes = rtnlStats->tx_bytes;
-
-                    // TODO: export detailed error stats
-                    stats->rxDrops =   rtnlStats->rx_dropped 
-                                     + rtnlStats->rx_missed_errors;
-                    stats->rxErrors = rtnlStats->rx_errors;
-                    stats->rxFifoErrors = rtnlStats->rx_fifo_errors;
-                    stats->rxFrameErrors =   rtnlStats->rx_crc_errors
-                                           + rtnlStats->rx_length_errors
-                                           + rtnlStats->rx_over_errors
-                                           + rtnlStats->rx_frame_errors;
-
-                    Q_ASSERT(state);  
+                if (state)
                     *state = ifi->ifi_flags & IFF_RUNNING ?
                         OstProto::LinkStateUp : OstProto::LinkStateDown;
 
-                    break;
-                }
-                rta = RTA_NEXT(rta, rtaLen);
+                // Stats are taken only from our polls (and not from link 
+                // events) so that the rates are over the poll interval
+                if (stats && (nlm->nlmsg_seq == seq))
+                    updateStats(stats, nlm, elapsed,
+                                isMonitored.contains(ifi->ifi_index),
+                                maxStatsValue.value(uint(ifi->ifi_index)));
             }
             nlm = NLMSG_NEXT(nlm, len);
         }
-
-        if (!done)
-            goto _retry_recv;
-
-_try_later:
-        QThread::sleep(kRefreshFreq_);
     }
 
+    close(fd);
+
     portStats.clear();
     linkState.clear();
+    maxStatsValue.clear();
+    isMonitored.clear();
 
     return 0;
 }
 
+/*
+  Updates stats from the IFLA_STATS64 (or if not available, the 32 bit
+  IFLA_STATS) of the RTM_NEWLINK msg nlm; rates are over elapsed usecs
+
+  The max value of the counters used (for wrap around) is set in 
+  *maxStatsValue
+*/
+void LinuxPort::StatsMonitor::updateStats(AbstractPort::PortStats *stats,
+        struct nlmsghdr *nlm, qint64 elapsed, bool isMonitored,
+        quint64 *maxStatsValue)
+{
+    struct rtnl_link_stats64 rtnlStats;
+    quint64 maxValue = 0;
+    struct rtattr *rta;
+    int rtaLen;
+
+    memset(&rtnlStats, 0, sizeof(rtnlStats));
+
+    rta = IFLA_RTA((struct ifinfomsg*) NLMSG_DATA(nlm));
+    rtaLen = IFLA_PAYLOAD(nlm);
+    while (RTA_OK(rta, rtaLen))
+    {
+        if (rta->rta_type == IFLA_STATS64)
+        {
+            // Not necessarily 64 bit aligned; size varies with the kernel
+            memset(&rtnlStats, 0, sizeof(rtnlStats));
+            memcpy(&rtnlStats, RTA_DATA(rta), 
+                    qMin(size_t(RTA_PAYLOAD(rta)), sizeof(rtnlStats)));
+            maxValue = kMaxValue64;
+            break;
+        }
+        else if (rta->rta_type == IFLA_STATS)
+        {
+            struct rtnl_link_stats *stats32 = 
+                    (struct rtnl_link_stats*) RTA_DATA(rta);
+
+            rtnlStats.rx_packets = stats32->rx_packets;
+            rtnlStats.rx_bytes = stats32->rx_bytes;
+            rtnlStats.tx_packets = stats32->tx_packets;
+            rtnlStats.tx_bytes = stats32->tx_bytes;
+            rtnlStats.rx_dropped = stats32->rx_dropped;
+            rtnlStats.rx_missed_errors = stats32->rx_missed_errors;
+            rtnlStats.rx_errors = stats32->rx_errors;
+            rtnlStats.rx_fifo_errors = stats32->rx_fifo_errors;
+            rtnlStats.rx_crc_errors = stats32->rx_crc_errors;
+            rtnlStats.rx_length_errors = stats32->rx_length_errors;
+            rtnlStats.rx_over_errors = stats32->rx_over_errors;
+            rtnlStats.rx_frame_errors = stats32->rx_frame_errors;
+            maxValue = kMaxValue32;
+            // continue looking for IFLA_STATS64
+        }
+        rta = RTA_NEXT(rta, rtaLen);
+    }
+
+    if (maxValue && maxStatsValue)
+        *maxStatsValue = maxValue;
+
+    if (!maxValue || (elapsed <= 0))
+        return;
+
+    // Rx/Tx of a monitored port are counted by its monitors
+    if (!isMonitored)
+    {
+        stats->rxPps = counterDelta(rtnlStats.rx_packets, stats->rxPkts, 
+                                    maxValue) * 1000000 / elapsed;
+        stats->rxBps = counterDelta(rtnlStats.rx_bytes, stats->rxBytes, 
+                                    maxValue) * 1000000 / elapsed;
+        stats->rxPkts  = rtnlStats.rx_packets;
+        stats->rxBytes = rtnlStats.rx_bytes;
+        stats->txPps = counterDelta(rtnlStats.tx_packets, stats->txPkts, 
+                                    maxValue) * 1000000 / elapsed;
+        stats->txBps = counterDelta(rtnlStats.tx_bytes, stats->txBytes, 
+                                    maxValue) * 1000000 / elapsed;
+        stats->txPkts  = rtnlStats.tx_packets;
+        stats->txBytes = rtnlStats.tx_bytes;
+    }
+
+    // TODO: export detailed error stats
+    stats->rxDrops =   rtnlStats.rx_dropped 
+                     + rtnlStats.rx_missed_errors;
+    stats->rxErrors = rtnlStats.rx_errors;
+    stats->rxFifoErrors = rtnlStats.rx_fifo_errors;
+    stats->rxFrameErrors =   rtnlStats.rx_crc_errors
+                           + rtnlStats.rx_length_errors
+                           + rtnlStats.rx_over_errors
+                           + rtnlStats.rx_frame_errors;
+}
+
 int LinuxPort::StatsMonitor::setPromisc(const char * portName)
 { 
     struct ifreq ifr;
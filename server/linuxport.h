@@ -29,16 +29,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 class LinuxPort : public PcapPort
 {
 public:
-    LinuxPort(int id, const char *device);
+    LinuxPort(int id, const char *device, bool useMonitors = false);
     ~LinuxPort();
 
     void init();
 
+    virtual void startTransmit();
+    virtual void startCapture();
+
     virtual OstProto::LinkState linkState();
     virtual bool hasExclusiveControl();
     virtual bool setExclusiveControl(bool exclusive);
 
 protected:
+    virtual LinuxTxQueue* createTxQueue();
+
     class StatsMonitor: public QThread
     {
     public:
@@ -49,10 +54,15 @@ protected:
         bool waitForSetupFinished(int msecs = 10000);
     private:
         int netlinkStats();
+        void updateStats(AbstractPort::PortStats *stats,
+                struct nlmsghdr *nlm, qint64 elapsed, bool isMonitored,
+                quint64 *maxStatsValue);
         void procStats();
         int setPromisc(const char* portName);
 
-        static const int kRefreshFreq_ = 1; // in seconds
+        static const int kRefreshInterval_ = 1000; // default, in msecs
+        static const int kMinRefreshInterval_ = 10;
+        int refreshInterval_;   // in msecs (OST_STATS_INTERVAL)
         bool stop_;
         bool setupDone_;
         int ioctlSocket_;
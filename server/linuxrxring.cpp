@@ -0,0 +1,259 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "linuxrxring.h"
+
+#ifdef Q_OS_LINUX
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+static inline struct tpacket_block_desc* blockDesc(uchar *block)
+{
+    return (struct tpacket_block_desc*) block;
+}
+
+LinuxRxRing::LinuxRxRing()
+{
+    fd_ = -1;
+    ring_ = NULL;
+    ringSize_ = 0;
+    snapLen_ = 0;
+    isPromisc_ = false;
+    current_ = 0;
+    packetsLeft_ = 0;
+    next_ = NULL;
+}
+
+LinuxRxRing::~LinuxRxRing()
+{
+    close();
+}
+
+/*!
+  Sets up the receive ring for all packets (in promiscuous mode, if
+  possible) on device - returns false if the ring could not be setup 
+  (e.g. insufficient privileges or an old kernel)
+
+  Packets are truncated to snapLen; if a (classic BPF) filter is given,
+  it is run by the kernel and only the packets accepted by it are copied
+  into the ring - the filter is attached before the ring is setup, so no
+  unfiltered packet is ever seen
+*/
+bool LinuxRxRing::open(const char *device, int snapLen,
+        const struct sock_fprog *filter)
+{
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    struct sockaddr_ll addr;
+    struct packet_mreq mreq;
+
+    close();
+
+    // Protocol 0 until bound - else we get packets from all interfaces
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0)
+        goto _error;
+
+    if (filter && (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER,
+                        filter, sizeof(*filter)) < 0))
+        goto _error;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION,
+                &version, sizeof(version)) < 0)
+        goto _error;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = kBlockSize;
+    req.tp_block_nr = kBlockCount;
+    req.tp_frame_size = kFrameSize;
+    req.tp_frame_nr = (kBlockSize/kFrameSize) * kBlockCount;
+    req.tp_retire_blk_tov = kBlockTimeoutMsec;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+        goto _error;
+
+    ringSize_ = req.tp_block_size * req.tp_block_nr;
+    ring_ = (uchar*) mmap(NULL, ringSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if (ring_ == MAP_FAILED)
+    {
+        ring_ = (uchar*) mmap(NULL, ringSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd_, 0);
+        if (ring_ == MAP_FAILED)
+        {
+            ring_ = NULL;
+            goto _error;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_nametoindex(device);
+    if (!addr.sll_ifindex)
+        goto _error;
+
+    if (bind(fd_, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+        goto _error;
+
+    // Promiscuous mode is reverted by the kernel when the socket is closed
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = addr.sll_ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    isPromisc_ = (setsockopt(fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                    &mreq, sizeof(mreq)) == 0);
+    if (!isPromisc_)
+        qDebug("%s:can't set promiscuous mode, trying non-promisc", device);
+
+    snapLen_ = snapLen;
+    current_ = 0;
+    packetsLeft_ = 0;
+    next_ = NULL;
+
+    // Discard the drops counted before we were setup
+    drops();
+
+    qDebug("%s: %s: %d blocks of %d bytes", __FUNCTION__, device,
+            kBlockCount, kBlockSize);
+    return true;
+
+_error:
+    qDebug("%s: %s: unable to setup rx ring: %s", __FUNCTION__, device,
+            strerror(errno));
+    close();
+    return false;
+}
+
+void LinuxRxRing::close()
+{
+    if (ring_)
+    {
+        munmap(ring_, ringSize_);
+        ring_ = NULL;
+    }
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    isPromisc_ = false;
+    packetsLeft_ = 0;
+    next_ = NULL;
+}
+
+/*!
+  Waits upto timeoutMsec for the kernel to hand over the next block -
+  returns the count of packets in the block, 0 on timeout and -1 on error
+*/
+int LinuxRxRing::nextBlock(int timeoutMsec)
+{
+    struct tpacket_block_desc *desc = blockDesc(block(current_));
+
+    if (!(desc->hdr.bh1.block_status & TP_STATUS_USER))
+    {
+        struct pollfd pfd;
+
+        pfd.fd = fd_;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, timeoutMsec) < 0) && (errno != EINTR))
+            return -1;
+
+        if (!(desc->hdr.bh1.block_status & TP_STATUS_USER))
+            return 0;
+    }
+
+    // block contents must be read only after its status
+    __sync_synchronize();
+
+    packetsLeft_ = desc->hdr.bh1.num_pkts;
+    next_ = block(current_) + desc->hdr.bh1.offset_to_first_pkt;
+
+    return packetsLeft_;
+}
+
+/*!
+  Returns the next packet in the current block in packet - returns false
+  if there are no more packets
+*/
+bool LinuxRxRing::nextPacket(Packet *packet)
+{
+    const struct tpacket3_hdr *hdr = (const struct tpacket3_hdr*) next_;
+
+    if (packetsLeft_ <= 0)
+        return false;
+
+    packet->data = next_ + hdr->tp_mac;
+    packet->caplen = qMin(int(hdr->tp_snaplen), snapLen_);
+    packet->length = hdr->tp_len;
+    packet->tsSec = hdr->tp_sec;
+    packet->tsNsec = hdr->tp_nsec;
+
+    next_ += hdr->tp_next_offset;
+    packetsLeft_--;
+
+    return true;
+}
+
+/*!
+  Hands over the current block back to the kernel
+*/
+void LinuxRxRing::releaseBlock()
+{
+    __sync_synchronize();
+    blockDesc(block(current_))->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+    current_ = (current_ + 1 == kBlockCount) ? 0 : current_ + 1;
+    packetsLeft_ = 0;
+    next_ = NULL;
+}
+
+/*!
+  Returns the count of packets dropped by the kernel (because the ring
+  was full) since the last call
+*/
+quint64 LinuxRxRing::drops()
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    if (fd_ < 0)
+        return 0;
+
+    // The kernel resets the stats when read
+    memset(&stats, 0, sizeof(stats));
+    if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0)
+        return 0;
+
+    return stats.tp_drops;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_LINUX_RX_RING_H
+#define _SERVER_LINUX_RX_RING_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+
+struct sock_fprog;
+
+/*!
+  AF_PACKET (PACKET_MMAP) TPACKET_V3 receive ring for a Linux interface
+
+  The kernel fills large blocks of variable length frames and hands over
+  a block when it is full or on a timeout - so a capture processes a 
+  whole block of packets per poll() instead of one packet per 
+  pcap_next_ex() call
+
+  A block returned by nextBlock() must be iterated with nextPacket() and
+  then released with releaseBlock() before the next nextBlock()
+*/
+class LinuxRxRing
+{
+public:
+    struct Packet {
+        const uchar *data;
+        int caplen;
+        int length;
+        quint32 tsSec;
+        quint32 tsNsec;
+    };
+
+    LinuxRxRing();
+    ~LinuxRxRing();
+
+    bool open(const char *device, int snapLen,
+            const struct sock_fprog *filter = NULL);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+    bool isPromiscuous() const { return isPromisc_; }
+
+    int nextBlock(int timeoutMsec);
+    bool nextPacket(Packet *packet);
+    void releaseBlock();
+
+    quint64 drops();
+
+    int blockSize() const { return kBlockSize; }
+
+private:
+    static const int kBlockSize = 1024*1024;
+    static const int kBlockCount = 64;
+    static const int kFrameSize = 2048;
+    static const int kBlockTimeoutMsec = 100;
+
+    uchar* block(int index) const { return ring_ + index*kBlockSize; }
+
+    int fd_;
+    uchar *ring_;
+    int ringSize_;
+    int snapLen_;
+    bool isPromisc_;
+
+    int current_;       // current block
+    int packetsLeft_;   // in the current block
+    const uchar *next_; // next packet in the current block
+};
+
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "linuxtxmmsg.h"
+
+#ifdef Q_OS_LINUX
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/if_packet.h>
+
+LinuxTxMmsg::LinuxTxMmsg()
+{
+    fd_ = -1;
+    buffer_ = NULL;
+    used_ = 0;
+    pending_ = 0;
+    droppedPackets_ = 0;
+    droppedBytes_ = 0;
+
+    memset(msgs_, 0, sizeof(msgs_));
+    for (int i = 0; i < kBatchSize; i++)
+    {
+        msgs_[i].msg_hdr.msg_iov = &iov_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+LinuxTxMmsg::~LinuxTxMmsg()
+{
+    close();
+}
+
+/*!
+  Opens a packet socket bound to device - returns false if the socket 
+  could not be opened (e.g. insufficient privileges)
+*/
+bool LinuxTxMmsg::open(const char *device)
+{
+    struct sockaddr_ll addr;
+
+    close();
+
+    // Protocol 0 - we only transmit, so don't receive anything
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0)
+        goto _error;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = 0;
+    addr.sll_ifindex = if_nametoindex(device);
+    if (!addr.sll_ifindex)
+        goto _error;
+
+    if (bind(fd_, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+        goto _error;
+
+    buffer_ = new uchar[kBufferSize];
+    used_ = 0;
+    pending_ = 0;
+
+    qDebug("%s: %s: batches of %d packets", __FUNCTION__, device, 
+            kBatchSize);
+    return true;
+
+_error:
+    qDebug("%s: %s: unable to open packet socket: %s", __FUNCTION__, 
+            device, strerror(errno));
+    close();
+    return false;
+}
+
+void LinuxTxMmsg::close()
+{
+    if (fd_ >= 0)
+    {
+        flush();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    delete[] buffer_;
+    buffer_ = NULL;
+    used_ = 0;
+    pending_ = 0;
+}
+
+/*!
+  Queues the packet for transmit - the packet is actually transmitted
+  only when a batch of packets has been queued or at the next flush()
+
+  The packet is copied, so the caller may reuse the packet buffer once 
+  this returns. Returns 0 on success, -1 if the packet could not be 
+  queued (i.e. it is larger than the batch buffer); caller should flush()
+  before sending it by any other means to maintain the packet order
+*/
+int LinuxTxMmsg::send(const uchar *packet, int length)
+{
+    uchar *data;
+
+    if (!buffer_ || (length > kBufferSize))
+        return -1;
+
+    if ((pending_ == kBatchSize) || (used_ + length > kBufferSize))
+        flush();
+
+    data = buffer_ + used_;
+    memcpy(data, packet, length);
+    iov_[pending_].iov_base = data;
+    iov_[pending_].iov_len = length;
+
+    used_ += length;
+    pending_++;
+
+    return 0;
+}
+
+/*!
+  Transmits all queued packets with as few sendmmsg() calls as possible
+  and returns the count of packets transmitted
+
+  If the device queue is full, the remaining packets are retried for upto
+  kWaitTimeoutMsec without any progress and dropped thereafter - same as 
+  a failed pcap_sendpacket(); dropped packets are counted till 
+  takeDropped()
+*/
+int LinuxTxMmsg::flush()
+{
+    int sent = 0;
+    bool isWaiting = false;
+    struct timespec start, now;
+
+    while (sent < pending_)
+    {
+        int n = sendmmsg(fd_, msgs_ + sent, pending_ - sent, 0);
+
+        if (n > 0)
+        {
+            sent += n;
+            isWaiting = false;
+            continue;
+        }
+
+        if ((n < 0) && (errno == EINTR))
+            continue;
+
+        // device queue full - wait for room
+        if ((n == 0) || (errno == ENOBUFS) || (errno == EAGAIN))
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (!isWaiting)
+            {
+                start = now;
+                isWaiting = true;
+            }
+
+            if ((now.tv_sec - start.tv_sec)*1000 
+                    + (now.tv_nsec - start.tv_nsec)/1000000 
+                    < kWaitTimeoutMsec)
+            {
+                struct pollfd pfd;
+
+                // POLLOUT reports room in the socket buffer (EAGAIN) but
+                // not in the device queue (ENOBUFS) - so if the socket is
+                // writable, back off briefly instead of retrying at once
+                pfd.fd = fd_;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, 1) > 0)
+                {
+                    struct timespec delay = {0, kRetryDelayUsec*1000};
+                    nanosleep(&delay, NULL);
+                }
+                continue;
+            }
+        }
+
+        qDebug("%s: sendmmsg failed: %s, dropped %d packets", __FUNCTION__,
+                strerror(errno), pending_ - sent);
+        for (int i = sent; i < pending_; i++)
+        {
+            droppedPackets_++;
+            droppedBytes_ += iov_[i].iov_len;
+        }
+        break;
+    }
+
+    used_ = 0;
+    pending_ = 0;
+
+    return sent;
+}
+
+/*!
+  Returns the count of packets (and their bytes) dropped by flush() since
+  the last call
+*/
+void LinuxTxMmsg::takeDropped(quint64 &packets, quint64 &bytes)
+{
+    packets = droppedPackets_;
+    bytes = droppedBytes_;
+    droppedPackets_ = 0;
+    droppedBytes_ = 0;
+}
+
+/*!
+  Transmits packets straight to the driver bypassing the qdisc layer if
+  bypass is true - see LinuxTxRing::setQdiscBypass()
+*/
+void LinuxTxMmsg::setQdiscBypass(bool bypass)
+{
+#ifdef PACKET_QDISC_BYPASS
+    int val = bypass;
+
+    if (fd_ < 0)
+        return;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_QDISC_BYPASS,
+                &val, sizeof(val)) < 0)
+        qDebug("%s: qdisc bypass not available", __FUNCTION__);
+#else
+    Q_UNUSED(bypass);
+#endif
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_LINUX_TX_MMSG_H
+#define _SERVER_LINUX_TX_MMSG_H
+
+#include "linuxtxqueue.h"
+
+#ifdef Q_OS_LINUX
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*!
+  Batched transmit via sendmmsg() on an AF_PACKET socket for a Linux 
+  interface
+
+  Portable fallback for LinuxTxRing where PACKET_MMAP is not usable - 
+  packets are copied into a batch buffer by send() and transmitted with
+  a single sendmmsg() by flush() (or when the batch is full) instead of 
+  one syscall per packet as with pcap_sendpacket()
+
+  send() and flush() must be called from a single (transmit) thread
+*/
+class LinuxTxMmsg : public LinuxTxQueue
+{
+public:
+    LinuxTxMmsg();
+    virtual ~LinuxTxMmsg();
+
+    virtual bool open(const char *device);
+    virtual void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+    virtual int send(const uchar *packet, int length);
+    virtual int flush();
+    virtual void takeDropped(quint64 &packets, quint64 &bytes);
+
+    virtual void setQdiscBypass(bool bypass);
+
+private:
+    static const int kBatchSize = 64;           // packets per sendmmsg()
+    static const int kBufferSize = 256*1024;    // batch buffer
+    static const int kWaitTimeoutMsec = 100;    // on ENOBUFS/EAGAIN
+    static const int kRetryDelayUsec = 50;      // between sendmmsg() retries
+
+    int fd_;
+    uchar *buffer_;
+    int used_;      // bytes of buffer_ in use
+    int pending_;   // packets queued but not yet sent
+    quint64 droppedPackets_;
+    quint64 droppedBytes_;
+
+    struct iovec iov_[kBatchSize];
+    struct mmsghdr msgs_[kBatchSize];
+};
+
+#endif
+
+#endif
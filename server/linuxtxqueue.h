@@ -0,0 +1,68 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_LINUX_TX_QUEUE_H
+#define _SERVER_LINUX_TX_QUEUE_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+
+/*!
+  Interface for a Linux transmit path which queues packets and transmits
+  them in batches - see LinuxTxRing and LinuxTxMmsg
+
+  send() queues a packet (transmitting the queued batch if it is full) 
+  and returns 0 or -1 if the packet can't be queued - in which case the 
+  caller should flush() and transmit the packet by other means; flush()
+  transmits all queued packets and returns the count of packets handed
+  over for transmit (or -1 on error) - packets which couldn't be, are 
+  dropped and counted till takeDropped()
+
+  A queue may also support preload() - packets within a preloaded buffer
+  are transmitted without being copied, until clearPreload()
+
+  A queue may also support setQdiscBypass() - packets which bypass the
+  qdisc layer are not seen by packet taps i.e. by any capture on the 
+  interface, including the port's own capture and monitors, so bypass is
+  off unless enabled
+*/
+class LinuxTxQueue
+{
+public:
+    virtual ~LinuxTxQueue() {}
+
+    virtual bool open(const char *device) = 0;
+    virtual void close() = 0;
+
+    virtual int send(const uchar *packet, int length) = 0;
+    virtual int flush() = 0;
+    virtual void takeDropped(quint64 &packets, quint64 &bytes) {
+        packets = bytes = 0;
+    }
+
+    virtual void preload(const uchar* /*buffer*/, int /*length*/) {}
+    virtual void clearPreload() {}
+
+    virtual void setQdiscBypass(bool /*bypass*/) {}
+};
+
+#endif
+
+#endif
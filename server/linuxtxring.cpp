@@ -0,0 +1,257 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "linuxtxring.h"
+
+#ifdef Q_OS_LINUX
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/if_packet.h>
+
+// Offset of the packet data in a ring frame (w/o PACKET_TX_HAS_OFF)
+static const int kDataOffset = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+
+static const int kPollTimeoutMsec = 10;
+static const int kWaitTimeoutMsec = 1000;
+
+static inline quint32 frameStatus(const uchar *frame)
+{
+    return ((volatile struct tpacket2_hdr*) frame)->tp_status;
+}
+
+LinuxTxRing::LinuxTxRing()
+{
+    fd_ = -1;
+    ring_ = NULL;
+    ringSize_ = 0;
+    frameCount_ = 0;
+    maxPacketSize_ = 0;
+    head_ = 0;
+    pending_ = 0;
+}
+
+LinuxTxRing::~LinuxTxRing()
+{
+    close();
+}
+
+/*!
+  Sets up the transmit ring for device - returns false if the ring
+  could not be setup (e.g. insufficient privileges or an old kernel)
+*/
+bool LinuxTxRing::open(const char *device)
+{
+    int version = TPACKET_V2;
+    int one = 1;
+    struct tpacket_req req;
+    struct sockaddr_ll addr;
+
+    close();
+
+    // Protocol 0 - we only transmit, so don't receive anything
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0)
+        goto _error;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION,
+                &version, sizeof(version)) < 0)
+        goto _error;
+
+    // Skip (instead of stopping at) malformed frames
+    setsockopt(fd_, SOL_PACKET, PACKET_LOSS, &one, sizeof(one));
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = kBlockSize;
+    req.tp_block_nr = kBlockCount;
+    req.tp_frame_size = kFrameSize;
+    req.tp_frame_nr = (kBlockSize/kFrameSize) * kBlockCount;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+        goto _error;
+
+    ringSize_ = req.tp_block_size * req.tp_block_nr;
+    ring_ = (uchar*) mmap(NULL, ringSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd_, 0);
+    if (ring_ == MAP_FAILED)
+    {
+        ring_ = NULL;
+        goto _error;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = 0;
+    addr.sll_ifindex = if_nametoindex(device);
+    if (!addr.sll_ifindex)
+        goto _error;
+
+    if (bind(fd_, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+        goto _error;
+
+    frameCount_ = req.tp_frame_nr;
+    maxPacketSize_ = kFrameSize - kDataOffset;
+    head_ = 0;
+    pending_ = 0;
+
+    qDebug("%s: %s: %d frames of %d bytes", __FUNCTION__, device,
+            frameCount_, kFrameSize);
+    return true;
+
+_error:
+    qDebug("%s: %s: unable to setup tx ring: %s", __FUNCTION__, device,
+            strerror(errno));
+    close();
+    return false;
+}
+
+void LinuxTxRing::close()
+{
+    if (ring_)
+    {
+        flush();
+        munmap(ring_, ringSize_);
+        ring_ = NULL;
+    }
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    frameCount_ = 0;
+    maxPacketSize_ = 0;
+}
+
+/*!
+  Queues the packet for transmit - the packet is actually transmitted
+  only when a batch of packets has been queued or at the next flush()
+
+  Returns 0 on success, -1 if the packet could not be queued (e.g. it is
+  larger than maxPacketSize()); caller should flush() before sending it
+  by any other means to maintain the packet order
+*/
+int LinuxTxRing::send(const uchar *packet, int length)
+{
+    uchar *f;
+    struct tpacket2_hdr *hdr;
+
+    if (!ring_ || (length > maxPacketSize_))
+        return -1;
+
+    f = frame(head_);
+    if ((frameStatus(f) != TP_STATUS_AVAILABLE) && (waitForFrame(head_) < 0))
+        return -1;
+
+    hdr = (struct tpacket2_hdr*) f;
+    memcpy(f + kDataOffset, packet, length);
+    hdr->tp_len = length;
+
+    // the frame must be complete before the kernel can see it
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+    head_ = (head_ + 1 == frameCount_) ? 0 : head_ + 1;
+    if (++pending_ >= kBatchSize)
+        flush();
+
+    return 0;
+}
+
+/*!
+  Hands over all queued packets to the kernel for transmit and returns 
+  their count - doesn't wait for the transmit to complete
+*/
+int LinuxTxRing::flush()
+{
+    int count = pending_;
+
+    if (!pending_)
+        return 0;
+
+    pending_ = 0;
+    if ((sendto(fd_, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0)
+            && (errno != EAGAIN) && (errno != ENOBUFS))
+    {
+        qDebug("%s: sendto failed: %s", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    return count;
+}
+
+/*!
+  Transmits packets straight to the driver bypassing the qdisc layer if
+  bypass is true - such packets are not seen by any capture on the 
+  interface; can be changed while transmitting
+*/
+void LinuxTxRing::setQdiscBypass(bool bypass)
+{
+#ifdef PACKET_QDISC_BYPASS
+    int val = bypass;
+
+    if (fd_ < 0)
+        return;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_QDISC_BYPASS,
+                &val, sizeof(val)) < 0)
+        qDebug("%s: qdisc bypass not available", __FUNCTION__);
+#else
+    Q_UNUSED(bypass);
+#endif
+}
+
+/*!
+  Waits for the kernel to be done with the frame at index i.e. the ring
+  is full - frames are kicked again in case an earlier flush() couldn't
+  hand over all of them
+*/
+int LinuxTxRing::waitForFrame(int index)
+{
+    struct pollfd pfd;
+
+    for (int t = 0; t < kWaitTimeoutMsec; t += kPollTimeoutMsec)
+    {
+        pending_ = 1;
+        flush();
+
+        if (frameStatus(frame(index)) == TP_STATUS_AVAILABLE)
+            return 0;
+
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, kPollTimeoutMsec) < 0) && (errno != EINTR))
+            break;
+
+        if (frameStatus(frame(index)) == TP_STATUS_AVAILABLE)
+            return 0;
+    }
+
+    qDebug("%s: timeout waiting for a free frame", __FUNCTION__);
+    return -1;
+}
+
+#endif
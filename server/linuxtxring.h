@@ -0,0 +1,76 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_LINUX_TX_RING_H
+#define _SERVER_LINUX_TX_RING_H
+
+#include "linuxtxqueue.h"
+
+#ifdef Q_OS_LINUX
+
+/*!
+  AF_PACKET (PACKET_MMAP) TPACKET_V2 transmit ring for a Linux interface
+
+  Packets are copied into the memory mapped ring by send() and handed
+  over to the kernel in batches by flush() (or when a batch is full) -
+  so a single sendto() transmits many packets instead of one syscall per
+  packet as with pcap_sendpacket(). The qdisc may be bypassed, if 
+  supported by the kernel (3.14+) - see setQdiscBypass().
+
+  send() and flush() must be called from a single (transmit) thread
+*/
+class LinuxTxRing : public LinuxTxQueue
+{
+public:
+    LinuxTxRing();
+    virtual ~LinuxTxRing();
+
+    virtual bool open(const char *device);
+    virtual void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+    virtual int send(const uchar *packet, int length);
+    virtual int flush();
+
+    virtual void setQdiscBypass(bool bypass);
+
+    int maxPacketSize() const { return maxPacketSize_; }
+
+private:
+    static const int kFrameSize = 2048;
+    static const int kBlockSize = 64*1024;
+    static const int kBlockCount = 64;      // 2048 frames
+    static const int kBatchSize = 256;      // frames per kick
+
+    uchar* frame(int index) const { return ring_ + index*kFrameSize; }
+    int waitForFrame(int index);
+
+    int fd_;
+    uchar *ring_;
+    int ringSize_;
+    int frameCount_;
+    int maxPacketSize_;
+
+    int head_;      // next frame to fill
+    int pending_;   // frames filled but not yet kicked
+};
+
+#endif
+
+#endif
@@ -0,0 +1,826 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "linuxxsk.h"
+
+#ifdef Q_OS_LINUX
+
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/rtnetlink.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+static const int kPollTimeoutMsec = 10;
+static const int kWaitTimeoutMsec = 1000;
+static const int kMaxKicks = 1000;
+
+static const quint64 kAddrMask = 
+    (Q_UINT64_C(1) << XSK_UNALIGNED_BUF_OFFSET_SHIFT) - 1;
+
+static inline quint32 loadAcquire(const quint32 *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeRelease(quint32 *p, quint32 value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+// In unaligned mode, the data offset is in the upper bits of a rx addr
+static inline quint64 dataAddr(quint64 addr)
+{
+    return (addr & kAddrMask) + (addr >> XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+}
+
+static inline int bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+  Attaches (or detaches, if progFd is -1) an XDP program to an interface
+  via rtnetlink - returns 0 on success, -errno otherwise
+*/
+static int setXdpFd(int ifindex, int progFd, quint32 flags)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+        char attrs[64];
+    } req;
+    char buf[1024];
+    struct rtattr *xdp, *rta;
+    struct nlmsghdr *nlh;
+    int fd, len;
+    int ret = -EIO;
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd < 0)
+        return -errno;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nlh.nlmsg_type = RTM_SETLINK;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    req.ifi.ifi_index = ifindex;
+
+    // IFLA_XDP { IFLA_XDP_FD, IFLA_XDP_FLAGS }
+    xdp = (struct rtattr*) ((char*) &req + NLMSG_ALIGN(req.nlh.nlmsg_len));
+    xdp->rta_type = IFLA_XDP | NLA_F_NESTED;
+    xdp->rta_len = RTA_LENGTH(0);
+
+    rta = (struct rtattr*) ((char*) xdp + RTA_ALIGN(xdp->rta_len));
+    rta->rta_type = IFLA_XDP_FD;
+    rta->rta_len = RTA_LENGTH(sizeof(progFd));
+    memcpy(RTA_DATA(rta), &progFd, sizeof(progFd));
+    xdp->rta_len = RTA_ALIGN(xdp->rta_len) + RTA_ALIGN(rta->rta_len);
+
+    rta = (struct rtattr*) ((char*) xdp + xdp->rta_len);
+    rta->rta_type = IFLA_XDP_FLAGS;
+    rta->rta_len = RTA_LENGTH(sizeof(flags));
+    memcpy(RTA_DATA(rta), &flags, sizeof(flags));
+    xdp->rta_len += RTA_ALIGN(rta->rta_len);
+
+    req.nlh.nlmsg_len = NLMSG_ALIGN(req.nlh.nlmsg_len) + xdp->rta_len;
+
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0)
+    {
+        ret = -errno;
+        goto _exit;
+    }
+
+    len = recv(fd, buf, sizeof(buf), 0);
+    if (len < 0)
+    {
+        ret = -errno;
+        goto _exit;
+    }
+
+    nlh = (struct nlmsghdr*) buf;
+    if (NLMSG_OK(nlh, len) && (nlh->nlmsg_type == NLMSG_ERROR))
+        ret = ((struct nlmsgerr*) NLMSG_DATA(nlh))->error;
+
+_exit:
+    close(fd);
+    return ret;
+}
+
+LinuxXsk::LinuxXsk()
+{
+    fd_ = -1;
+    ifindex_ = 0;
+    umem_ = NULL;
+    umemSize_ = 0;
+    isHugePage_ = false;
+    isZeroCopy_ = false;
+
+    memset(&fill_, 0, sizeof(fill_));
+    memset(&comp_, 0, sizeof(comp_));
+    memset(&rx_, 0, sizeof(rx_));
+    memset(&tx_, 0, sizeof(tx_));
+
+    mapFd_ = -1;
+    progFd_ = -1;
+    xdpFlags_ = 0;
+
+    txFreeCount_ = 0;
+    outstanding_ = 0;
+    pending_ = 0;
+    lastRegion_ = 0;
+    preloadUsed_ = 0;
+    isPreloadSkipLogged_ = false;
+
+    rxPeeked_ = 0;
+}
+
+LinuxXsk::~LinuxXsk()
+{
+    close();
+}
+
+/*!
+  Sets up the UMEM, the socket and its rings for queue 0 of device and
+  attaches an XDP program to redirect received packets to the socket
+
+  Returns false if any of these could not be setup (e.g. insufficient
+  privileges, an old kernel or device already has an XDP program)
+*/
+bool LinuxXsk::open(const char *device)
+{
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct xdp_options opts;
+    struct sockaddr_xdp addr;
+    socklen_t optlen;
+    int ringSize = kFrameCount;
+
+    close();
+
+    ifindex_ = if_nametoindex(device);
+    if (!ifindex_)
+        goto _error;
+
+    // Zero-copy needs physically contiguous packet buffers - so try for
+    // hugepages first
+    umemSize_ = quint64(kPreloadSize) + 2*quint64(kFrameCount)*kChunkSize;
+    umem_ = (uchar*) mmap(NULL, umemSize_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    isHugePage_ = (umem_ != MAP_FAILED);
+    if (!isHugePage_)
+        umem_ = (uchar*) mmap(NULL, umemSize_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (umem_ == MAP_FAILED)
+    {
+        umem_ = NULL;
+        goto _error;
+    }
+
+    fd_ = socket(AF_XDP, SOCK_RAW, 0);
+    if (fd_ < 0)
+        goto _error;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = quintptr(umem_);
+    reg.len = umemSize_;
+    reg.chunk_size = kChunkSize;
+    reg.headroom = 0;
+    reg.flags = XDP_UMEM_UNALIGNED_CHUNK_FLAG;
+    if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+        goto _error;
+
+    if ((setsockopt(fd_, SOL_XDP, XDP_UMEM_FILL_RING,
+                    &ringSize, sizeof(ringSize)) < 0)
+            || (setsockopt(fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING,
+                    &ringSize, sizeof(ringSize)) < 0)
+            || (setsockopt(fd_, SOL_XDP, XDP_RX_RING,
+                    &ringSize, sizeof(ringSize)) < 0)
+            || (setsockopt(fd_, SOL_XDP, XDP_TX_RING,
+                    &ringSize, sizeof(ringSize)) < 0))
+        goto _error;
+
+    optlen = sizeof(off);
+    if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+        goto _error;
+
+    if (!mapRing(&fill_, XDP_UMEM_PGOFF_FILL_RING, &off.fr, sizeof(quint64))
+            || !mapRing(&comp_, XDP_UMEM_PGOFF_COMPLETION_RING, &off.cr,
+                    sizeof(quint64))
+            || !mapRing(&rx_, XDP_PGOFF_RX_RING, &off.rx, 
+                    sizeof(struct xdp_desc))
+            || !mapRing(&tx_, XDP_PGOFF_TX_RING, &off.tx,
+                    sizeof(struct xdp_desc)))
+        goto _error;
+
+    // UMEM layout: preload area, tx frames, rx frames
+    for (int i = 0; i < kFrameCount; i++)
+    {
+        txFree_[i] = kPreloadSize + quint64(i)*kChunkSize;
+        ((quint64*) fill_.descs)[i] = kPreloadSize 
+                        + quint64(kFrameCount + i)*kChunkSize;
+    }
+    txFreeCount_ = kFrameCount;
+    fill_.head = kFrameCount;
+    storeRelease(fill_.producer, fill_.head);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sxdp_family = AF_XDP;
+    addr.sxdp_ifindex = ifindex_;
+    addr.sxdp_queue_id = 0;
+    addr.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    if (!isHugePage_)
+        addr.sxdp_flags |= XDP_COPY;
+    if (bind(fd_, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+        goto _error;
+
+    optlen = sizeof(opts);
+    if (getsockopt(fd_, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0)
+        isZeroCopy_ = (opts.flags & XDP_OPTIONS_ZEROCOPY);
+
+    if (!setupXdpProgram())
+        goto _error;
+
+    qDebug("%s: %s: %s mode, umem = %llu bytes%s", __FUNCTION__, device,
+            isZeroCopy_ ? "zero-copy" : "copy", umemSize_,
+            isHugePage_ ? " (hugepages)" : "");
+    return true;
+
+_error:
+    qDebug("%s: %s: unable to setup AF_XDP socket: %s", __FUNCTION__,
+            device, strerror(errno));
+    close();
+    return false;
+}
+
+void LinuxXsk::close()
+{
+    if (fd_ >= 0)
+        flush();
+
+    removeXdpProgram();
+
+    unmapRing(&fill_);
+    unmapRing(&comp_);
+    unmapRing(&rx_);
+    unmapRing(&tx_);
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    if (umem_)
+    {
+        munmap(umem_, umemSize_);
+        umem_ = NULL;
+    }
+
+    isZeroCopy_ = false;
+    txFreeCount_ = 0;
+    outstanding_ = 0;
+    pending_ = 0;
+    regions_.clear();
+    lastRegion_ = 0;
+    preloadUsed_ = 0;
+    isPreloadSkipLogged_ = false;
+    rxPeeked_ = 0;
+}
+
+/*!
+  Queues the packet for transmit - the packet is actually transmitted
+  only when a batch of packets has been queued or at the next flush()
+
+  Packets within a preloaded buffer are queued by reference, others are
+  copied. Returns 0 on success, -1 if the packet could not be queued
+  (e.g. it is larger than a UMEM chunk); caller should flush() before
+  sending it by any other means to maintain the packet order
+*/
+int LinuxXsk::send(const uchar *packet, int length)
+{
+    struct xdp_desc *desc;
+    qint64 addr;
+
+    if ((fd_ < 0) || (length > kChunkSize))
+        return -1;
+
+    addr = preloadedAddr(packet, length);
+    if (!isTxAvailable(addr < 0) && (waitForTx(addr < 0) < 0))
+        return -1;
+
+    if (addr < 0)
+    {
+        addr = txFree_[--txFreeCount_];
+        memcpy(umem_ + addr, packet, length);
+    }
+
+    desc = (struct xdp_desc*) tx_.descs + (tx_.head & (tx_.size - 1));
+    desc->addr = addr;
+    desc->len = length;
+    desc->options = 0;
+
+    tx_.head++;
+    outstanding_++;
+    if (++pending_ >= kBatchSize)
+        flush();
+
+    return 0;
+}
+
+/*!
+  Hands over all queued packets to the kernel for transmit and returns
+  their count - in copy mode, the packets have been transmitted when this
+  returns
+*/
+int LinuxXsk::flush()
+{
+    int count = pending_;
+
+    if (fd_ < 0)
+        return 0;
+
+    if (pending_)
+    {
+        storeRelease(tx_.producer, tx_.head);
+        pending_ = 0;
+    }
+
+    if (loadAcquire(tx_.consumer) != tx_.head)
+        kick();
+
+    reclaim();
+
+    return count;
+}
+
+/*!
+  Copies buffer into the UMEM (if not already there) so that packets 
+  within it can be transmitted without any copy
+
+  If buffer is larger than a hugepage or the preload area is full, the 
+  packets are transmitted by copy - this is logged once until the next
+  clearPreload()
+*/
+void LinuxXsk::preload(const uchar *buffer, int length)
+{
+    Region region;
+    quint64 addr;
+
+    if ((fd_ < 0) || (length <= 0))
+        return;
+
+    for (int i = 0; i < regions_.size(); i++)
+    {
+        if (regions_.at(i).buffer != buffer)
+            continue;
+
+        if (regions_.at(i).length == length)
+        {
+            lastRegion_ = i;
+            return;
+        }
+
+        // Buffer has changed - reload
+        regions_.remove(i);
+        lastRegion_ = 0;
+        break;
+    }
+
+    // A buffer must not straddle a hugepage to be contiguous
+    addr = preloadUsed_;
+    if ((addr % kHugePageSize) + length > quint64(kHugePageSize))
+        addr += kHugePageSize - (addr % kHugePageSize);
+
+    if ((length > kHugePageSize) || (addr + length > quint64(kPreloadSize)))
+    {
+        if (!isPreloadSkipLogged_)
+        {
+            qWarning("%s: buffer of %d bytes not preloaded (%s) - "
+                    "its packets will be copied", __FUNCTION__, length,
+                    length > kHugePageSize ? 
+                        "larger than a hugepage" : "preload area full");
+            isPreloadSkipLogged_ = true;
+        }
+        return;
+    }
+
+    memcpy(umem_ + addr, buffer, length);
+
+    region.buffer = buffer;
+    region.length = length;
+    region.addr = addr;
+    regions_.append(region);
+    lastRegion_ = regions_.size() - 1;
+    preloadUsed_ = addr + length;
+}
+
+/*!
+  Forgets all preloaded buffers - waits for any packets transmitted from
+  the preload area to complete, so that it can be reused
+*/
+void LinuxXsk::clearPreload()
+{
+    struct pollfd pfd;
+
+    if (fd_ < 0)
+        return;
+
+    flush();
+    for (int t = 0; (outstanding_ > 0) && (t < kWaitTimeoutMsec); t++)
+    {
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        poll(&pfd, 1, 1);
+        flush();
+    }
+
+    if (outstanding_ > 0)
+        qDebug("%s: %d packets not transmitted", __FUNCTION__, outstanding_);
+
+    regions_.clear();
+    lastRegion_ = 0;
+    preloadUsed_ = 0;
+    isPreloadSkipLogged_ = false;
+}
+
+/*!
+  Returns upto count received packets in packets - waiting upto 
+  timeoutMsec if none are available
+
+  The packets are valid only until release(), which must be called 
+  before the next receive()
+*/
+int LinuxXsk::receive(Packet *packets, int count, int timeoutMsec)
+{
+    quint32 avail;
+    int n;
+
+    Q_ASSERT(rxPeeked_ == 0);
+
+    if (fd_ < 0)
+        return -1;
+
+    avail = loadAcquire(rx_.producer) - rx_.head;
+    if (!avail)
+    {
+        struct pollfd pfd;
+
+        // poll() also wakes up the driver, if it needs to be
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeoutMsec) <= 0)
+            return 0;
+
+        avail = loadAcquire(rx_.producer) - rx_.head;
+    }
+
+    n = qMin(int(avail), count);
+    for (int i = 0; i < n; i++)
+    {
+        struct xdp_desc *desc = (struct xdp_desc*) rx_.descs 
+                                    + ((rx_.head + i) & (rx_.size - 1));
+
+        packets[i].data = umem_ + dataAddr(desc->addr);
+        packets[i].length = desc->len;
+    }
+    rxPeeked_ = n;
+
+    return n;
+}
+
+/*!
+  Releases the packets returned by the last receive() - their frames are
+  handed back to the kernel for receiving more packets
+*/
+void LinuxXsk::release()
+{
+    if (!rxPeeked_)
+        return;
+
+    for (int i = 0; i < rxPeeked_; i++)
+    {
+        struct xdp_desc *desc = (struct xdp_desc*) rx_.descs 
+                                    + ((rx_.head + i) & (rx_.size - 1));
+
+        ((quint64*) fill_.descs)[fill_.head++ & (fill_.size - 1)] =
+                desc->addr & kAddrMask;
+    }
+
+    rx_.head += rxPeeked_;
+    storeRelease(rx_.consumer, rx_.head);
+    storeRelease(fill_.producer, fill_.head);
+    rxPeeked_ = 0;
+}
+
+/*!
+  Returns the count of received packets dropped by the kernel because 
+  the socket's rx ring was full or there was no free frame
+*/
+quint64 LinuxXsk::rxDropped()
+{
+    struct xdp_statistics stats;
+    socklen_t optlen = sizeof(stats);
+
+    memset(&stats, 0, sizeof(stats));
+    if ((fd_ < 0) 
+            || (getsockopt(fd_, SOL_XDP, XDP_STATISTICS, &stats, &optlen) < 0))
+        return 0;
+
+    // rx_ring_full and later fields are not available on older kernels
+    if (optlen < offsetof(struct xdp_statistics, rx_ring_full) 
+                    + sizeof(stats.rx_ring_full))
+        return stats.rx_dropped;
+
+    return stats.rx_dropped + stats.rx_ring_full;
+}
+
+bool LinuxXsk::mapRing(Ring *ring, quint64 pgoff,
+        const struct xdp_ring_offset *offset, int descSize)
+{
+    uchar *base;
+
+    ring->size = kFrameCount;
+    ring->mapSize = offset->desc + kFrameCount*descSize;
+    ring->map = mmap(NULL, ring->mapSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, pgoff);
+    if (ring->map == MAP_FAILED)
+    {
+        ring->map = NULL;
+        return false;
+    }
+
+    base = (uchar*) ring->map;
+    ring->producer = (quint32*) (base + offset->producer);
+    ring->consumer = (quint32*) (base + offset->consumer);
+    ring->flags = (quint32*) (base + offset->flags);
+    ring->descs = base + offset->desc;
+    ring->head = 0;
+
+    return true;
+}
+
+void LinuxXsk::unmapRing(Ring *ring)
+{
+    if (ring->map)
+        munmap(ring->map, ring->mapSize);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/*!
+  Loads an XDP program which redirects packets received on a queue to 
+  the socket bound to that queue, if any (else passes them to the kernel)
+  and attaches it to the interface - native mode, if the driver supports
+  it, else generic mode
+*/
+bool LinuxXsk::setupXdpProgram()
+{
+    static char license[] = "GPL";
+    union bpf_attr attr;
+    int key = 0;
+    int ret;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = 1;
+    mapFd_ = bpf(BPF_MAP_CREATE, &attr);
+    if (mapFd_ < 0)
+        return false;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = mapFd_;
+    attr.key = quintptr(&key);
+    attr.value = quintptr(&fd_);
+    attr.flags = BPF_ANY;
+    if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+        return false;
+
+    {
+        struct bpf_insn prog[] = {
+            // r2 = ctx->rx_queue_index
+            { BPF_LDX | BPF_MEM | BPF_W, 2, 1,
+                offsetof(struct xdp_md, rx_queue_index), 0 },
+            // r1 = map (64-bit immediate - two insns)
+            { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapFd_ },
+            { 0, 0, 0, 0, 0 },
+            // r3 = action if there's no socket for the queue
+            { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+            // return bpf_redirect_map(r1, r2, r3)
+            { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+            { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 }
+        };
+
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insn_cnt = sizeof(prog)/sizeof(prog[0]);
+        attr.insns = quintptr(prog);
+        attr.license = quintptr(license);
+        progFd_ = bpf(BPF_PROG_LOAD, &attr);
+        if (progFd_ < 0)
+            return false;
+    }
+
+    // Don't replace any XDP program already attached by someone else
+    xdpFlags_ = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE;
+    ret = setXdpFd(ifindex_, progFd_, xdpFlags_);
+    if (ret < 0)
+    {
+        xdpFlags_ = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_SKB_MODE;
+        ret = setXdpFd(ifindex_, progFd_, xdpFlags_);
+    }
+
+    if (ret < 0)
+    {
+        errno = -ret;
+        xdpFlags_ = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void LinuxXsk::removeXdpProgram()
+{
+    if (xdpFlags_)
+    {
+        int ret = setXdpFd(ifindex_, -1, 
+                        xdpFlags_ & ~XDP_FLAGS_UPDATE_IF_NOEXIST);
+        if (ret < 0)
+            qDebug("%s: unable to detach XDP program: %s", __FUNCTION__,
+                    strerror(-ret));
+        xdpFlags_ = 0;
+    }
+
+    if (progFd_ >= 0)
+    {
+        ::close(progFd_);
+        progFd_ = -1;
+    }
+
+    if (mapFd_ >= 0)
+    {
+        ::close(mapFd_);
+        mapFd_ = -1;
+    }
+}
+
+/*
+  Returns the UMEM address of packet if it is within a preloaded buffer, 
+  -1 otherwise - packets are usually within the last used buffer
+*/
+qint64 LinuxXsk::preloadedAddr(const uchar *packet, int length)
+{
+    int count = regions_.size();
+
+    for (int j = 0; j < count; j++)
+    {
+        int i = (lastRegion_ + j) % count;
+        const Region &r = regions_.at(i);
+
+        if ((quintptr(packet) >= quintptr(r.buffer))
+                && (quintptr(packet + length) 
+                        <= quintptr(r.buffer + r.length)))
+        {
+            lastRegion_ = i;
+            return r.addr + (packet - r.buffer);
+        }
+    }
+
+    return -1;
+}
+
+bool LinuxXsk::isTxAvailable(bool needFrame)
+{
+    if ((tx_.head - loadAcquire(tx_.consumer)) >= tx_.size)
+        return false;
+
+    return !needFrame || (txFreeCount_ > 0);
+}
+
+/*!
+  Waits for a free tx descriptor (and a free tx frame if needFrame) i.e.
+  the tx ring is full or all tx frames are in flight
+*/
+int LinuxXsk::waitForTx(bool needFrame)
+{
+    struct pollfd pfd;
+
+    for (int t = 0; t < kWaitTimeoutMsec; t += kPollTimeoutMsec)
+    {
+        flush();
+        if (isTxAvailable(needFrame))
+            return 0;
+
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, kPollTimeoutMsec) < 0) && (errno != EINTR))
+            break;
+
+        reclaim();
+        if (isTxAvailable(needFrame))
+            return 0;
+    }
+
+    qDebug("%s: timeout waiting for a free descriptor", __FUNCTION__);
+    return -1;
+}
+
+/*
+  Wakes up the kernel to transmit descriptors on the tx ring - in copy
+  mode, the kernel transmits only a limited number of descriptors per 
+  wakeup, so we keep kicking till all of them are transmitted
+*/
+void LinuxXsk::kick()
+{
+    for (int i = 0; i < kMaxKicks; i++)
+    {
+        if (!isZeroCopy_ || (loadAcquire(tx_.flags) & XDP_RING_NEED_WAKEUP))
+        {
+            if ((sendto(fd_, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0)
+                    && (errno != EAGAIN) && (errno != EBUSY)
+                    && (errno != ENOBUFS))
+            {
+                qDebug("%s: sendto failed: %s", __FUNCTION__, 
+                        strerror(errno));
+                return;
+            }
+        }
+
+        if (isZeroCopy_)
+            return;
+
+        // completion ring may be full
+        reclaim();
+
+        if (loadAcquire(tx_.consumer) == tx_.head)
+            return;
+    }
+}
+
+/*
+  Processes the completion ring - returns tx frames to the free list
+*/
+int LinuxXsk::reclaim()
+{
+    const quint64 txFrameStart = kPreloadSize;
+    const quint64 txFrameEnd = kPreloadSize + quint64(kFrameCount)*kChunkSize;
+    quint32 avail = loadAcquire(comp_.producer) - comp_.head;
+
+    for (quint32 i = 0; i < avail; i++)
+    {
+        quint64 addr = ((quint64*) comp_.descs)
+                            [(comp_.head + i) & (comp_.size - 1)];
+
+        if ((addr >= txFrameStart) && (addr < txFrameEnd))
+            txFree_[txFreeCount_++] = addr;
+    }
+
+    if (avail)
+    {
+        comp_.head += avail;
+        storeRelease(comp_.consumer, comp_.head);
+        outstanding_ -= avail;
+    }
+
+    return avail;
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_LINUX_XSK_H
+#define _SERVER_LINUX_XSK_H
+
+#include "linuxtxqueue.h"
+
+#ifdef Q_OS_LINUX
+
+#include <QVector>
+
+struct xdp_ring_offset;
+
+/*!
+  AF_XDP socket (XSK) for queue 0 of a Linux interface
+
+  The UMEM is divided into a preload area, tx frames and rx frames and is
+  registered in unaligned chunk mode, so that a descriptor may point 
+  anywhere in the UMEM. preload() copies a packet buffer (a pcap send 
+  queue) into the preload area once; packets within a preloaded buffer
+  are then transmitted by descriptor only - other packets are copied
+  into a tx frame by send(). Zero-copy is used if the UMEM could be 
+  backed by hugepages and the driver supports it, copy mode otherwise.
+
+  An XDP program redirects all packets received on queue 0 to the socket
+  (packets on other queues are passed to the kernel as usual) - these 
+  must be drained with receive() and release().
+
+  send(), flush(), preload() and clearPreload() must be called from a 
+  single (transmit) thread and receive()/release() from a single 
+  (receive) thread
+*/
+class LinuxXsk : public LinuxTxQueue
+{
+public:
+    struct Packet {
+        const uchar *data;
+        int length;
+    };
+
+    LinuxXsk();
+    virtual ~LinuxXsk();
+
+    virtual bool open(const char *device);
+    virtual void close();
+    bool isOpen() const { return fd_ >= 0; }
+    bool isZeroCopy() const { return isZeroCopy_; }
+
+    virtual int send(const uchar *packet, int length);
+    virtual int flush();
+
+    virtual void preload(const uchar *buffer, int length);
+    virtual void clearPreload();
+
+    int receive(Packet *packets, int count, int timeoutMsec);
+    void release();
+
+    quint64 rxDropped();
+
+private:
+    struct Ring {
+        quint32 *producer;
+        quint32 *consumer;
+        quint32 *flags;
+        void *descs;
+        quint32 size;   // entries - power of 2
+        quint32 head;   // local producer (tx, fill) or consumer (rx, comp)
+        void *map;
+        size_t mapSize;
+    };
+
+    struct Region {
+        const uchar *buffer;
+        int length;
+        quint64 addr;
+    };
+
+    static const int kChunkSize = 4096;
+    static const int kFrameCount = 2048;    // each of tx and rx
+    static const int kPreloadSize = 32*1024*1024;
+    static const int kHugePageSize = 2*1024*1024;
+    static const int kBatchSize = 64;       // descriptors per kick
+
+    bool mapRing(Ring *ring, quint64 pgoff,
+            const struct xdp_ring_offset *offset, int descSize);
+    void unmapRing(Ring *ring);
+    bool setupXdpProgram();
+    void removeXdpProgram();
+
+    qint64 preloadedAddr(const uchar *packet, int length);
+    bool isTxAvailable(bool needFrame);
+    int waitForTx(bool needFrame);
+    void kick();
+    int reclaim();
+
+    int fd_;
+    int ifindex_;
+    uchar *umem_;
+    quint64 umemSize_;
+    bool isHugePage_;
+    bool isZeroCopy_;
+
+    Ring fill_;
+    Ring comp_;
+    Ring rx_;
+    Ring tx_;
+
+    // BPF
+    int mapFd_;
+    int progFd_;
+    quint32 xdpFlags_;
+
+    // Transmit
+    quint64 txFree_[kFrameCount];
+    int txFreeCount_;
+    int outstanding_;   // descriptors not yet completed
+    int pending_;       // descriptors not yet kicked
+    QVector<Region> regions_;
+    int lastRegion_;
+    quint64 preloadUsed_;
+    bool isPreloadSkipLogged_;
+
+    // Receive
+    int rxPeeked_;
+};
+
+#endif
+
+#endif
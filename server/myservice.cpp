@@ -29,15 +29,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include "../common/abstractprotocol.h"
 #endif
 
+#include "../common/ostrace.h"
 #include "../common/streambase.h"
 #include "../rpc/pbrpccontroller.h"
 #include "portmanager.h"
 
+#include <QFile>
 #include <QStringList>
 
 
 extern char *version;
 
+static const quint32 kMaxCaptureChunkSize = 16*1024*1024;
+
 MyService::MyService()
 {
     PortManager *portManager = PortManager::instance();
@@ -63,7 +67,7 @@ void MyService::getPortIdList(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::PortIdList* response,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     // No locks are needed here because the list does not change
     // and neither does the port_id
@@ -84,7 +88,7 @@ void MyService::getPortConfig(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::PortConfigList* response,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_id_size(); i++)
     {
@@ -105,12 +109,14 @@ void MyService::getPortConfig(::google::protobuf::RpcController* /*controller*/,
     done->Run();
 }
 
-void MyService::modifyPort(::google::protobuf::RpcController* /*controller*/,
+void MyService::modifyPort(::google::protobuf::RpcController* controller,
     const ::OstProto::PortConfigList* request,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    QString error;
+
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_size(); i++)
     {
@@ -121,12 +127,27 @@ void MyService::modifyPort(::google::protobuf::RpcController* /*controller*/,
         id = port.port_id().id();
         if (id < portInfo.size())
         {
+            QString result;
+
+            // Reject (all changes to) the port if its capture config is 
+            // invalid, else capture would fail to start later
+            if (port.has_capture_config() 
+                    && !portInfo[id]->isCaptureConfigValid(
+                            port.capture_config(), result))
+            {
+                error.append(QString("Port %1: %2\n").arg(id).arg(result));
+                continue;
+            }
+
             portLock[id]->lockForWrite();
             portInfo[id]->modify(port);
             portLock[id]->unlock();
         }
     }
 
+    if (!error.isEmpty())
+        controller->SetFailed(error.toStdString());
+
     //! \todo (LOW): fill-in response "Ack"????
     done->Run();
 }
@@ -138,7 +159,7 @@ void MyService::getStreamIdList(::google::protobuf::RpcController* controller,
 {
     int portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->id();
     if ((portId < 0) || (portId >= portInfo.size()))
@@ -170,7 +191,7 @@ void MyService::getStreamConfig(::google::protobuf::RpcController* controller,
 {
     int portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->port_id().id();
     if ((portId < 0) || (portId >= portInfo.size()))
@@ -207,7 +228,7 @@ void MyService::addStream(::google::protobuf::RpcController* controller,
 {
     int portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->port_id().id();
     if ((portId < 0) || (portId >= portInfo.size()))
@@ -257,7 +278,7 @@ void MyService::deleteStream(::google::protobuf::RpcController* controller,
 {
     int portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->port_id().id();
     if ((portId < 0) || (portId >= portInfo.size()))
@@ -292,13 +313,16 @@ void MyService::modifyStream(::google::protobuf::RpcController* controller,
 {
     int    portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->port_id().id();
     if ((portId < 0) || (portId >= portInfo.size()))
         goto _invalid_port;
 
-    if (portInfo[portId]->isTransmitOn())
+    // Streams may be modified while transmitting - the transmitter picks
+    // up the new packet list without stopping
+    if (portInfo[portId]->isTransmitOn() 
+            && !portInfo[portId]->canUpdateWhileTransmitting())
         goto _port_busy;
 
     portLock[portId]->lockForWrite();
@@ -337,7 +361,7 @@ void MyService::startTransmit(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_id_size(); i++)
     {
@@ -348,6 +372,9 @@ void MyService::startTransmit(::google::protobuf::RpcController* /*controller*/,
             continue;     //! \todo (LOW): partial RPC?
 
         portLock[portId]->lockForWrite();
+        // An update deferred while transmitting is done now
+        if (portInfo[portId]->isDirty())
+            portInfo[portId]->updatePacketList();
         portInfo[portId]->startTransmit();
         portLock[portId]->unlock();
     }
@@ -362,7 +389,7 @@ void MyService::stopTransmit(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_id_size(); i++)
     {
@@ -387,7 +414,7 @@ void MyService::startCapture(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_id_size(); i++)
     {
@@ -412,7 +439,7 @@ void MyService::stopCapture(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
     for (int i=0; i < request->port_id_size(); i++)
     {
         int portId;
@@ -438,7 +465,7 @@ void MyService::getCaptureBuffer(::google::protobuf::RpcController* controller,
 {
     int portId;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     portId = request->id();
     if ((portId < 0) || (portId >= portInfo.size()))
@@ -507,6 +534,11 @@ void MyService::getStats(::google::protobuf::RpcController* /*controller*/,
         s->set_rx_errors(stats.rxErrors);
         s->set_rx_fifo_errors(stats.rxFifoErrors);
         s->set_rx_frame_errors(stats.rxFrameErrors);
+
+        s->set_capture_drops(stats.captureDrops);
+
+        s->set_tx_late_pkts(stats.txLatePkts);
+        s->set_tx_max_late_nsec(stats.txMaxLateNsec);
     }
 
     done->Run();
@@ -517,7 +549,7 @@ void MyService::clearStats(::google::protobuf::RpcController* /*controller*/,
     ::OstProto::Ack* /*response*/,
     ::google::protobuf::Closure* done)
 {
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     for (int i = 0; i < request->port_id_size(); i++)
     {
@@ -546,7 +578,7 @@ void MyService::checkVersion(::google::protobuf::RpcController* controller,
     QString clientVersion;
     QStringList my, client;
 
-    qDebug("In %s", __PRETTY_FUNCTION__);
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
 
     my = myVersion.split('.');
 
@@ -579,3 +611,68 @@ _invalid_version:
     controller->SetFailed("invalid version information");
     done->Run();
 }
+
+void MyService::getCaptureChunk(::google::protobuf::RpcController* controller,
+    const ::OstProto::CaptureChunkRequest* request,
+    ::OstProto::CaptureChunk* response,
+    ::google::protobuf::Closure* done)
+{
+    int portId;
+    QIODevice *capture;
+    QFile *file;
+    QByteArray data;
+    quint64 offset = request->offset();
+    quint64 size;
+    quint64 length;
+
+    OST_TRACE(kTraceRpc, kTraceInfo, "In %s", __PRETTY_FUNCTION__);
+
+    portId = request->port_id().id();
+    if ((portId < 0) || (portId >= portInfo.size()))
+        goto _invalid_port;
+
+    // Capture is NOT stopped - the capture file is only appended to
+    // while capture is on, so whatever is read is valid
+    portLock[portId]->lockForWrite();
+    capture = portInfo[portId]->captureData();
+    if (!capture)
+    {
+        portLock[portId]->unlock();
+        goto _not_supported;
+    }
+
+    size = capture->size();
+    length = qMin(quint64(qMin(request->length(), kMaxCaptureChunkSize)),
+                offset < size ? size - offset : 0);
+    if (length && capture->seek(offset))
+        data = capture->read(length);
+
+    response->set_offset(offset);
+    response->set_length(data.size());
+    response->set_file_size(size);
+    response->set_is_capture_on(portInfo[portId]->isCaptureOn());
+
+    file = qobject_cast<QFile*>(capture);
+    if (file)
+        response->set_file_path(file->fileName().toStdString());
+    portLock[portId]->unlock();
+
+    if (request->compress() && !data.isEmpty())
+    {
+        data = qCompress(data);
+        response->set_is_compressed(true);
+    }
+    response->set_data(data.constData(), data.size());
+
+    done->Run();
+    return;
+
+_not_supported:
+    controller->SetFailed("capture not supported");
+    done->Run();
+    return;
+
+_invalid_port:
+    controller->SetFailed("invalid portid");
+    done->Run();
+}
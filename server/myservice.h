@@ -101,6 +101,10 @@ public:
         const ::OstProto::VersionInfo* request,
         ::OstProto::VersionCompatibility* response,
         ::google::protobuf::Closure* done);
+    virtual void getCaptureChunk(::google::protobuf::RpcController* controller,
+        const ::OstProto::CaptureChunkRequest* request,
+        ::OstProto::CaptureChunk* response,
+        ::google::protobuf::Closure* done);
 
 private:
     /* 
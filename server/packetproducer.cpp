@@ -0,0 +1,304 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "packetproducer.h"
+
+#include "abstractport.h"
+#include "../common/streambase.h"
+
+#include <QByteArray>
+
+PacketProducer::PacketProducer()
+{
+    ringBuf_ = NULL;
+    slotSize_ = 0;
+    head_ = 0;
+    tail_ = 0;
+    done_ = 0;
+    stop_ = false;
+}
+
+PacketProducer::~PacketProducer()
+{
+    if (isRunning())
+        stop();
+
+    qDeleteAll(streamList_);
+    delete[] ringBuf_;
+}
+
+/*!
+  Takes a snapshot of the enabled streams in streamList - the streams
+  are expected to be already sorted in transmit order
+
+  The snapshot is a deep copy, so the port's streams may be modified
+  (or deleted) once this returns
+*/
+void PacketProducer::setStreams(const QList<StreamBase*> &streamList)
+{
+    Q_ASSERT(!isRunning());
+
+    qDeleteAll(streamList_);
+    streamList_.clear();
+    slotSize_ = 0;
+
+    for (int i = 0; i < streamList.size(); i++)
+    {
+        StreamBase *stream = streamList.at(i);
+        StreamBase *copy;
+        OstProto::Stream s;
+        int maxLen;
+
+        if (!stream->isEnabled())
+            continue;
+
+        stream->protoDataCopyInto(s);
+        copy = new StreamBase;
+        copy->protoDataCopyFrom(s);
+        streamList_.append(copy);
+
+        maxLen = (copy->lenMode() == StreamBase::e_fl_fixed) ?
+                    copy->frameLen() : copy->frameLenMax();
+        if (maxLen > slotSize_)
+            slotSize_ = maxLen;
+    }
+
+    if (slotSize_ > kMaxPktSize)
+        slotSize_ = kMaxPktSize;
+
+    delete[] ringBuf_;
+    ringBuf_ = new uchar[kRingSize * slotSize_];
+    for (int i = 0; i < kRingSize; i++)
+    {
+        ring_[i].tsNsec = 0;
+        ring_[i].length = 0;
+        ring_[i].data = ringBuf_ + i*slotSize_;
+    }
+
+    qDebug("%s: streams = %d, slotSize = %d", __FUNCTION__,
+            streamList_.size(), slotSize_);
+}
+
+void PacketProducer::run()
+{
+    AbstractPort::Timeline now;
+    int emptyStreams = 0; // consecutive streams without any packets
+    int i = 0;
+
+    while ((i < streamList_.size()) && !stop_)
+    {
+        StreamBase *stream = streamList_.at(i);
+        AbstractPort::Timeline ibg, ipg;
+        quint64 burstSize, count;
+        bool isContinuous = (stream->sendMode() == StreamBase::e_sm_continuous);
+        int frameVariableCount = stream->frameVariableCount();
+        QByteArray frame;
+
+        switch (stream->sendUnit())
+        {
+        case StreamBase::e_su_bursts:
+            burstSize = stream->burstSize();
+            count = quint64(stream->numBursts()) * burstSize;
+            ibg = AbstractPort::Timeline::fromRate(stream->burstRate());
+            break;
+        case StreamBase::e_su_packets:
+            burstSize = 1;
+            count = stream->numPackets();
+            ipg = AbstractPort::Timeline::fromRate(stream->packetRate());
+            break;
+        default:
+            qWarning("Unhandled stream control unit %d", stream->sendUnit());
+            i++;
+            continue;
+        }
+
+        if (burstSize == 0)
+            burstSize = 1;
+
+        // Frames which don't vary are rendered only once
+        if (frameVariableCount <= 1)
+        {
+            frame.resize(slotSize_);
+            frame.resize(stream->frameValue((uchar*) frame.data(),
+                        frame.size(), 0));
+        }
+
+        for (quint64 j = 0; isContinuous || (j < count); j++)
+        {
+            Packet *pkt = nextFreeSlot();
+
+            if (!pkt)
+                goto _exit; // stopped
+
+            if (frameVariableCount > 1)
+                pkt->length = stream->frameValue(pkt->data, slotSize_,
+                                        int(j % frameVariableCount));
+            else
+            {
+                memcpy(pkt->data, frame.constData(), frame.size());
+                pkt->length = frame.size();
+            }
+
+            if (pkt->length <= 0)
+                continue;
+
+            pkt->tsNsec = now.nsec();
+            publish();
+            emptyStreams = 0;
+
+            if (((j+1) % burstSize) == 0)
+                now.advance(ibg);
+            now.advance(ipg);
+        }
+
+        // Don't spin forever if we keep going around streams which
+        // don't generate any packet
+        if (++emptyStreams > streamList_.size())
+            goto _exit;
+
+        switch (stream->nextWhat())
+        {
+        case StreamBase::e_nw_stop:
+            goto _exit;
+
+        case StreamBase::e_nw_goto_id:
+            // Goto the first stream, unless told otherwise
+            i = 0;
+            if (stream->hasGotoStreamId())
+            {
+                for (int k = 0; k < streamList_.size(); k++)
+                {
+                    if (streamList_.at(k)->id() == stream->gotoStreamId())
+                    {
+                        i = k;
+                        break;
+                    }
+                }
+            }
+            break;
+
+        case StreamBase::e_nw_goto_next:
+        default:
+            i++;
+            break;
+        }
+    }
+
+_exit:
+    done_.fetchAndStoreRelease(1);
+    qDebug("%s: producer done", __FUNCTION__);
+}
+
+/*!
+  Rewinds and starts generating packets from the first stream
+
+  Returns once the ring has been primed (or a short timeout), so that
+  the transmitter doesn't start off with an empty ring
+*/
+void PacketProducer::start()
+{
+    if (isRunning())
+        stop();
+
+    head_ = 0;
+    tail_ = 0;
+    done_ = 0;
+    stop_ = false;
+
+    QThread::start(QThread::HighPriority);
+
+    for (int t = 0; t < kPrimeTimeoutMsec; t++)
+    {
+        if ((count() == (kRingSize - 1)) || int(done_))
+            break;
+        QThread::msleep(1);
+    }
+}
+
+void PacketProducer::stop()
+{
+    stop_ = true;
+    wait();
+}
+
+/*!
+  Returns the next packet to be transmitted or NULL if the ring is empty
+  (the producer is either behind or done - see isDone())
+*/
+const PacketProducer::Packet* PacketProducer::peek()
+{
+    int tail = tail_;
+
+    if (tail == head_.fetchAndAddAcquire(0))
+        return NULL;
+
+    return &ring_[tail];
+}
+
+/*!
+  Releases the packet returned by peek() back to the producer
+*/
+void PacketProducer::pop()
+{
+    tail_.fetchAndStoreRelease((int(tail_) + 1) & (kRingSize - 1));
+}
+
+/*!
+  Returns true if the producer has no more packets to generate and all
+  generated packets have been consumed
+*/
+bool PacketProducer::isDone()
+{
+    // done_ must be read before head_
+    if (!done_.fetchAndAddAcquire(0))
+        return false;
+
+    return (int(tail_) == head_.fetchAndAddAcquire(0));
+}
+
+/*!
+  Pauses briefly if the ring is (still) empty - called by the consumer 
+  when peek() returns NULL, so that waiting on a producer which is behind 
+  doesn't keep a cpu busy
+*/
+void PacketProducer::waitForPackets()
+{
+    if ((int(tail_) == head_.fetchAndAddAcquire(0)) && !int(done_))
+        QThread::usleep(kRingEmptySleepUsec);
+}
+
+PacketProducer::Packet* PacketProducer::nextFreeSlot()
+{
+    int head = head_;
+    int next = (head + 1) & (kRingSize - 1);
+
+    while (next == tail_.fetchAndAddAcquire(0))
+    {
+        if (stop_)
+            return NULL;
+        QThread::usleep(kRingFullSleepUsec);
+    }
+
+    return &ring_[head];
+}
+
+void PacketProducer::publish()
+{
+    head_.fetchAndStoreRelease((int(head_) + 1) & (kRingSize - 1));
+}
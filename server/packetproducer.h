@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_PACKET_PRODUCER_H
+#define _SERVER_PACKET_PRODUCER_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QThread>
+
+class StreamBase;
+
+/*!
+  Generates packets on the fly for a port's (sequential) stream list
+
+  Used instead of a pre-built packet list when a stream is continuous or
+  when the packet list would be too large to materialize. The producer
+  thread renders frames (with their nsec timestamps relative to the start
+  of transmit) into a bounded ring which is drained by the port's
+  transmitter - so memory is constant irrespective of the number of
+  packets and the sustained rate is limited only by how fast frames can be
+  generated.
+
+  The ring is single producer/single consumer and lock free - peek()/pop()
+  must be called only from the transmitter
+*/
+class PacketProducer: public QThread
+{
+public:
+    struct Packet {
+        quint64 tsNsec;
+        int length;
+        uchar *data;
+    };
+
+    PacketProducer();
+    ~PacketProducer();
+
+    void setStreams(const QList<StreamBase*> &streamList);
+
+    void run();
+    void start();
+    void stop();
+
+    // Consumer side
+    const Packet* peek();
+    void pop();
+    bool isDone();
+    void waitForPackets();
+
+private:
+    static const int kRingSize = 1024; // must be a power of 2
+    static const int kMaxPktSize = 16384;
+    static const int kRingFullSleepUsec = 100;
+    static const int kRingEmptySleepUsec = 10;
+    static const int kPrimeTimeoutMsec = 100;
+
+    int count() {
+        return (int(head_) - int(tail_)) & (kRingSize - 1);
+    }
+    Packet* nextFreeSlot();
+    void publish();
+
+    QList<StreamBase*> streamList_; // snapshot owned by the producer
+
+    Packet ring_[kRingSize];
+    uchar *ringBuf_;
+    int slotSize_;
+    QAtomicInt head_;   // next slot to be written - only producer writes
+    QAtomicInt tail_;   // next slot to be read - only consumer writes
+    QAtomicInt done_;
+
+    volatile bool stop_;
+};
+
+#endif
@@ -19,35 +19,56 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include "pcapport.h"
 
+#include "linuxrxring.h"
+#include "../common/ostrace.h"
+
 #include <QtGlobal>
 
 #ifdef Q_OS_WIN32
 #include <windows.h>
 #endif
 
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/prctl.h>
+#include <time.h>
+
+#include <linux/filter.h>
+#endif
+
 pcap_if_t *PcapPort::deviceList_ = NULL;
 
 
 #if defined(Q_OS_LINUX)
-typedef struct timeval TimeStamp;
+typedef struct timespec TimeStamp;
 static void inline getTimeStamp(TimeStamp *stamp)
 {
-    gettimeofday(stamp, NULL);
+    clock_gettime(CLOCK_MONOTONIC, stamp);
 }
 
-// Returns time diff in usecs between end and start
-static long inline udiffTimeStamp(const TimeStamp *start, const TimeStamp *end)
+// Returns time diff in nsecs between end and start
+static qint64 inline ndiffTimeStamp(const TimeStamp *start, 
+        const TimeStamp *end)
 {
-    struct timeval diff;
-    long usecs;
-
-    timersub(end, start, &diff);
+    return qint64(end->tv_sec - start->tv_sec)*qint64(1e9) 
+                + (end->tv_nsec - start->tv_nsec);
+}
 
-    usecs = diff.tv_usec;
-    if (diff.tv_sec)
-        usecs += diff.tv_sec*1e6;
+// Moves stamp by nsec (which may be negative)
+static void inline addTimeStamp(TimeStamp *stamp, qint64 nsec)
+{
+    qint64 t = qint64(stamp->tv_nsec) + nsec;
 
-    return usecs;
+    stamp->tv_sec += t / qint64(1e9);
+    stamp->tv_nsec = t % qint64(1e9);
+    if (stamp->tv_nsec < 0)
+    {
+        stamp->tv_sec--;
+        stamp->tv_nsec += qint64(1e9);
+    }
 }
 #elif defined(Q_OS_WIN32)
 static quint64 gTicksFreq;
@@ -57,33 +78,53 @@ static void inline getTimeStamp(TimeStamp* stamp)
     QueryPerformanceCounter(stamp);
 }
 
-static long inline udiffTimeStamp(const TimeStamp *start, const TimeStamp *end) 
+// Returns time diff in nsecs between end and start
+static qint64 inline ndiffTimeStamp(const TimeStamp *start, 
+        const TimeStamp *end) 
 {
     if (end->QuadPart >= start->QuadPart)
-        return (end->QuadPart - start->QuadPart)*long(1e6)/gTicksFreq;
+    {
+        quint64 ticks = end->QuadPart - start->QuadPart;
+
+        // split to avoid overflowing the intermediate product
+        return (ticks/gTicksFreq)*qint64(1e9) 
+                + ((ticks%gTicksFreq)*qint64(1e9))/gTicksFreq;
+    }
     else
     {
         // FIXME: incorrect! what's the max value for this counter before
         // it rolls over?
-        return (start->QuadPart)*long(1e6)/gTicksFreq;
+        return (start->QuadPart)*qint64(1e9)/gTicksFreq;
     }
 }
 #else
 typedef int TimeStamp;
 static void inline getTimeStamp(TimeStamp*) {}
-static long inline udiffTimeStamp(const TimeStamp*, const TimeStamp*) { return 0; }
+static qint64 inline ndiffTimeStamp(const TimeStamp*, const TimeStamp*) 
+{ 
+    return 0; 
+}
 #endif
 
-PcapPort::PcapPort(int id, const char *device)
+/*!
+  The Rx/Tx stats are counted per packet by a pair of monitors (each with
+  its own pcap handle and thread) if useMonitors is true - else a 
+  subclass must provide the stats e.g. from the interface counters
+*/
+PcapPort::PcapPort(int id, const char *device, bool useMonitors)
     : AbstractPort(id, device)
 {
-    monitorRx_ = new PortMonitor(device, kDirectionRx, &stats_);
-    monitorTx_ = new PortMonitor(device, kDirectionTx, &stats_);
-    transmitter_ = new PortTransmitter(device);
-    capturer_ = new PortCapturer(device);
+    monitorRx_ = monitorTx_ = NULL;
+    if (useMonitors)
+    {
+        monitorRx_ = new PortMonitor(device, kDirectionRx, &stats_);
+        monitorTx_ = new PortMonitor(device, kDirectionTx, &stats_);
 
-    if (!monitorRx_->handle() || !monitorTx_->handle())
-        isUsable_ = false;
+        if (!monitorRx_->handle() || !monitorTx_->handle())
+            isUsable_ = false;
+    }
+    transmitter_ = new PortTransmitter(device, &stats_, &txMaxLate_);
+    capturer_ = new PortCapturer(device, &stats_);
 
     if (!deviceList_)
     {
@@ -113,13 +154,22 @@ PcapPort::PcapPort(int id, const char *device)
 
 void PcapPort::init()
 {
-    if (!monitorTx_->isDirectional())
-        transmitter_->useExternalStats(&stats_);
-
-    transmitter_->setHandle(monitorRx_->handle());
+    if (hasMonitors())
+        transmitter_->setHandle(monitorRx_->handle());
 
     updateNotes();
 
+    startMonitors();
+}
+
+void PcapPort::startMonitors()
+{
+    if (!hasMonitors())
+        return;
+
+    if (!monitorTx_->isDirectional())
+        transmitter_->useExternalStats(&stats_);
+
     monitorRx_->start();
     monitorTx_->start();
 }
@@ -149,6 +199,9 @@ void PcapPort::updateNotes()
 {
     QString notes;
 
+    if (!hasMonitors())
+        return;
+
     if ((!monitorRx_->isPromiscuous()) || (!monitorTx_->isPromiscuous()))
         notes.append("<li>Non Promiscuous Mode</li>");
 
@@ -167,6 +220,65 @@ void PcapPort::updateNotes()
             arg(notes).toStdString());
 }
 
+/*!
+  Compiles the filter expression for an ethernet link - an empty filter
+  accepts all packets (truncated to snapLen). Caller must pcap_freecode()
+  the program if this returns true
+*/
+bool PcapPort::compileFilter(const char *filter, int snapLen,
+        struct bpf_program *program, QString *error)
+{
+    pcap_t *handle = pcap_open_dead(DLT_EN10MB, snapLen);
+    bool ret = true;
+
+    if (!handle)
+        return false;
+
+    if (pcap_compile(handle, program, filter, 1 /* optimize */, 
+                0xffffffff /* netmask unknown */) < 0)
+    {
+        qWarning("%s: invalid filter '%s': %s", __FUNCTION__, filter,
+                pcap_geterr(handle));
+        if (error)
+            *error = QString("invalid filter '%1': %2").arg(filter)
+                        .arg(pcap_geterr(handle));
+        ret = false;
+    }
+
+    pcap_close(handle);
+    return ret;
+}
+
+/*!
+  Returns true if the filter and stop filter of config compile - else 
+  returns false with the reason in result, so that an invalid config is
+  rejected upfront instead of capture silently not starting later
+*/
+bool PcapPort::isCaptureConfigValid(const OstProto::CaptureConfig &config,
+        QString &result)
+{
+    int snapLen = config.snap_len() ? config.snap_len() : 65535;
+    struct bpf_program program;
+
+    if (!config.filter().empty())
+    {
+        if (!compileFilter(config.filter().c_str(), snapLen, &program,
+                    &result))
+            return false;
+        pcap_freecode(&program);
+    }
+
+    if (!config.stop_filter().empty())
+    {
+        if (!compileFilter(config.stop_filter().c_str(), snapLen, &program,
+                    &result))
+            return false;
+        pcap_freecode(&program);
+    }
+
+    return true;
+}
+
 PcapPort::PortMonitor::PortMonitor(const char *device, Direction direction,
         AbstractPort::PortStats *stats)
 {
@@ -312,7 +424,8 @@ void PcapPort::PortMonitor::stop()
     pcap_breakloop(handle());
 }
 
-PcapPort::PortTransmitter::PortTransmitter(const char *device)
+PcapPort::PortTransmitter::PortTransmitter(const char *device,
+        AbstractPort::PortStats *portStats, AbstractPort::MaxStat *maxLate)
 {
     char errbuf[PCAP_ERRBUF_SIZE] = "";
 
@@ -325,11 +438,19 @@ PcapPort::PortTransmitter::PortTransmitter(const char *device)
                 "This Win32 platform does not support performance counter");
 #endif
     state_ = kNotStarted;
-    returnToQIdx_ = -1;
-    loopDelay_ = 0;
+    producer_ = NULL;
+    buildList_ = activeList_ = &packetList_[0];
+    committedList_ = NULL;
     stop_ = false;
     stats_ = new AbstractPort::PortStats;
     usingInternalStats_ = true;
+    portStats_ = portStats;
+    maxLate_ = maxLate;
+#ifdef Q_OS_LINUX
+    txQueue_ = NULL;
+#endif
+    txBatchWindow_ = 0;
+    spinNsec_ = 0;
     handle_ = pcap_open_live(device, 64 /* FIXME */, 0, 1000 /* ms */, errbuf);
 
     if (handle_ == NULL)
@@ -346,73 +467,138 @@ _open_error:
 
 PcapPort::PortTransmitter::~PortTransmitter()
 {
+    for (int i = 0; i < kPacketListCount; i++)
+        qDeleteAll(packetList_[i].sequences);
     if (usingInternalStats_)
         delete stats_;
     if (usingInternalHandle_)
         pcap_close(handle_);
+#ifdef Q_OS_LINUX
+    delete txQueue_;
+#endif
 }
 
 void PcapPort::PortTransmitter::clearPacketList()
 {
-    Q_ASSERT(!isRunning());
-    // \todo lock for packetSequenceList
-    while(packetSequenceList_.size())
-        delete packetSequenceList_.takeFirst();
+    // Find out if the transmitter has switched to the list we last
+    // committed - if it hasn't, it won't anymore
+    if (committedList_)
+    {
+        if (!pendingList_.testAndSetOrdered(committedList_, NULL))
+            activeList_ = committedList_;
+        committedList_ = NULL;
+    }
+
+    if (isRunning())
+    {
+        // Build the new list while the active one (and the one still 
+        // being transmitted, if different) is in use by the transmitter
+        PacketList *txList = txList_;
+
+        for (int i = 0; i < kPacketListCount; i++)
+        {
+            buildList_ = &packetList_[i];
+            if ((buildList_ != activeList_) && (buildList_ != txList))
+                break;
+        }
+        qDeleteAll(buildList_->sequences);
+        buildList_->sequences.clear();
+    }
+    else
+    {
+        for (int i = 0; i < kPacketListCount; i++)
+        {
+            qDeleteAll(packetList_[i].sequences);
+            packetList_[i].sequences.clear();
+            packetList_[i].segments.clear();
+        }
+        buildList_ = activeList_ = &packetList_[0];
+    }
 
     currentPacketSequence_ = NULL;
     repeatSequenceStart_ = -1;
     repeatSize_ = 0;
     packetCount_ = 0;
 
-    returnToQIdx_ = -1;
+    buildList_->segments.clear();
+}
+
+/*
+  Makes the newly built packet list the one to be transmitted - if 
+  transmit is on, the transmitter switches over to it at the next packet 
+  set boundary without stopping
+*/
+void PcapPort::PortTransmitter::commitPacketList()
+{
+    if (!isRunning())
+        return; // will be used at the next start()
+
+    committedList_ = buildList_;
+    pendingList_.fetchAndStoreOrdered(buildList_);
+}
+
+void PcapPort::PortTransmitter::startPacketListSegment()
+{
+    Segment segment;
+
+    // A segment always starts with a new packetSequence
+    currentPacketSequence_ = NULL;
 
-    setPacketListLoopMode(false, 0, 0); 
+    segment.startIdx = buildList_->sequences.size();
+    segment.nextSegment = -1;
+    segment.delayNsec = 0;
+    segment.delayFrac = 0;
+
+    buildList_->segments.append(segment);
 }
 
 void PcapPort::PortTransmitter::loopNextPacketSet(qint64 size, qint64 repeats,
-        long repeatDelaySec, long repeatDelayNsec)
+        quint64 repeatDelayNsec, quint32 repeatDelayFrac)
 {
+    if (buildList_->segments.isEmpty())
+        startPacketListSegment();
+
     currentPacketSequence_ = new PacketSequence;
     currentPacketSequence_->repeatCount_ = repeats;
-    currentPacketSequence_->usecDelay_ = repeatDelaySec * long(1e6) 
-                                            + repeatDelayNsec/1000;
+    currentPacketSequence_->nsecDelay_ = repeatDelayNsec;
+    currentPacketSequence_->nsecDelayFrac_ = repeatDelayFrac;
 
-    repeatSequenceStart_ = packetSequenceList_.size();
+    repeatSequenceStart_ = buildList_->sequences.size();
     repeatSize_ = size;
     packetCount_ = 0;
 
-    packetSequenceList_.append(currentPacketSequence_);
+    buildList_->sequences.append(currentPacketSequence_);
 }
 
-bool PcapPort::PortTransmitter::appendToPacketList(long sec, long nsec, 
+bool PcapPort::PortTransmitter::appendToPacketList(quint64 tsNsec,
         const uchar *packet, int length)
 {
     bool op = true;
     pcap_pkthdr pktHdr;
 
+    if (buildList_->segments.isEmpty())
+        startPacketListSegment();
+
     pktHdr.caplen = pktHdr.len = length;
-    pktHdr.ts.tv_sec = sec;
-    pktHdr.ts.tv_usec = nsec/1000;
+    PacketSequence::nsecToTs(tsNsec, &pktHdr.ts);
 
     if (currentPacketSequence_ == NULL || 
             !currentPacketSequence_->hasFreeSpace(2*sizeof(pcap_pkthdr)+length))
     {
         if (currentPacketSequence_ != NULL)
         {
-            long usecs;
-
-            usecs = (pktHdr.ts.tv_sec 
-                        - currentPacketSequence_->lastPacket_->ts.tv_sec) 
-                            * long(1e6);
-            usecs += (pktHdr.ts.tv_usec 
-                        - currentPacketSequence_->lastPacket_->ts.tv_usec);
-            currentPacketSequence_->usecDelay_ = usecs;
+            // The sequence has no repeats, so its delay is just the gap 
+            // to this packet - the packet timeline is exact, so no frac
+            currentPacketSequence_->nsecDelay_ = PacketSequence::tsToNsec(
+                    pktHdr.ts) - PacketSequence::tsToNsec(
+                        currentPacketSequence_->lastPacket_->ts);
+            currentPacketSequence_->nsecDelayFrac_ = 0;
         }
 
         //! \todo (LOW): calculate sendqueue size
         currentPacketSequence_ = new PacketSequence;
 
-        packetSequenceList_.append(currentPacketSequence_);
+        buildList_->sequences.append(currentPacketSequence_);
 
         // Validate that the pkt will fit inside the new currentSendQueue_
         Q_ASSERT(currentPacketSequence_->hasFreeSpace(
@@ -427,21 +613,24 @@ bool PcapPort::PortTransmitter::appendToPacketList(long sec, long nsec,
     packetCount_++;
     if (repeatSize_ > 0 && packetCount_ == repeatSize_)
     {
-        qDebug("repeatSequenceStart_=%d, repeatSize_ = %llu",
+        OST_TRACE(kTraceBuild, kTraceInfo,
+                "repeatSequenceStart_=%d, repeatSize_ = %llu",
                 repeatSequenceStart_, repeatSize_);
 
         // Set the packetSequence repeatSize 
         Q_ASSERT(repeatSequenceStart_ >= 0);
-        Q_ASSERT(repeatSequenceStart_ < packetSequenceList_.size());
+        Q_ASSERT(repeatSequenceStart_ < buildList_->sequences.size());
 
-        if (currentPacketSequence_ != packetSequenceList_[repeatSequenceStart_])
+        if (currentPacketSequence_ != buildList_->sequences[repeatSequenceStart_])
         {
-            PacketSequence *start = packetSequenceList_[repeatSequenceStart_];
+            PacketSequence *start = buildList_->sequences[repeatSequenceStart_];
 
-            currentPacketSequence_->usecDelay_ = start->usecDelay_;
-            start->usecDelay_ = 0;
+            currentPacketSequence_->nsecDelay_ = start->nsecDelay_;
+            currentPacketSequence_->nsecDelayFrac_ = start->nsecDelayFrac_;
+            start->nsecDelay_ = 0;
+            start->nsecDelayFrac_ = 0;
             start->repeatSize_ = 
-                    packetSequenceList_.size() - repeatSequenceStart_;
+                    buildList_->sequences.size() - repeatSequenceStart_;
         }
 
         repeatSize_ = 0;
@@ -461,6 +650,37 @@ void PcapPort::PortTransmitter::setHandle(pcap_t *handle)
     usingInternalHandle_ = false;
 }
 
+#ifdef Q_OS_LINUX
+/*
+  Transmit packets via txQueue (instead of pcap_sendpacket()) - the 
+  transmitter takes ownership of txQueue
+
+  Packets due within kTxBatchWindowNsec of each other are queued and
+  transmitted together instead of delaying between them
+*/
+void PcapPort::PortTransmitter::setTxQueue(LinuxTxQueue *txQueue)
+{
+    Q_ASSERT(!isRunning());
+
+    delete txQueue_;
+    txQueue_ = txQueue;
+    if (txQueue)
+        txBatchWindow_ = kTxBatchWindowNsec;
+    else
+        txBatchWindow_ = 0;
+}
+
+/*
+  Bypass the qdisc layer for transmit (if the tx queue supports it) - see
+  LinuxTxQueue; may be called while transmitting
+*/
+void PcapPort::PortTransmitter::setQdiscBypass(bool bypass)
+{
+    if (txQueue_)
+        txQueue_->setQdiscBypass(bypass);
+}
+#endif
+
 void PcapPort::PortTransmitter::useExternalStats(AbstractPort::PortStats *stats)
 {
     if (usingInternalStats_)
@@ -471,8 +691,6 @@ void PcapPort::PortTransmitter::useExternalStats(AbstractPort::PortStats *stats)
 
 void PcapPort::PortTransmitter::run()
 {
-    //! \todo (MED) Stream Mode - continuous: define before implement
-
     // NOTE1: We can't use pcap_sendqueue_transmit() directly even on Win32
     // 'coz of 2 reasons - there's no way of stopping it before all packets
     // in the sendQueue are sent out and secondly, stats are available only
@@ -487,113 +705,248 @@ void PcapPort::PortTransmitter::run()
 
     const int kSyncTransmit = 1;
     int i;
-    long overHead = 0; // overHead should be negative or zero
+    int seg;
+    // overHead (nsecs) should be negative or zero - or upto txBatchWindow_
+    // if packets were sent ahead of time as part of a batch
+    qint64 overHead = 0;
+    quint32 fracAcc = 0; // accumulated binary fraction of nsec delays
+    PacketList *list = activeList_;
+    PacketList *newList;
+    PacketList *deferredList = NULL;
+
+    rateProfile_.reset();
+    clearPreload();
+
+#ifdef Q_OS_LINUX
+    // Wake up from a sleep as close to the requested time as possible
+    // instead of the default 50us timer slack (per thread)
+    if (prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0) < 0)
+        qDebug("%s: unable to set timer slack: %s", __FUNCTION__,
+                strerror(errno));
+    if (!spinNsec_)
+        calibrateSleep();
+#endif
+
+    if (producer_)
+    {
+        int ret;
 
-    qDebug("packetSequenceList_.size = %d", packetSequenceList_.size());
-    if (packetSequenceList_.size() <= 0)
+        state_ = kRunning;
+        ret = producerTransmit(handle_, overHead);
+        if (ret < 0)
+        {
+            qDebug("error %d in producerTransmit()", ret);
+            stop_ = false;
+        }
+        goto _exit;
+    }
+
+    OST_TRACE(kTraceTx, kTraceInfo, 
+            "sequences.size = %d", list->sequences.size());
+    if (list->sequences.size() <= 0)
         goto _exit;
 
-    for(i = 0; i < packetSequenceList_.size(); i++) {
-        qDebug("sendQ[%d]: rptCnt = %d, rptSz = %d, usecDelay = %ld", i, 
-                packetSequenceList_.at(i)->repeatCount_, 
-                packetSequenceList_.at(i)->repeatSize_,
-                packetSequenceList_.at(i)->usecDelay_);
-        qDebug("sendQ[%d]: pkts = %ld, usecDuration = %ld", i, 
-                packetSequenceList_.at(i)->packets_, 
-                packetSequenceList_.at(i)->usecDuration_);
+    for(i = 0; i < list->sequences.size(); i++) {
+        OST_TRACE(kTraceTx, kTraceDetail,
+                "sendQ[%d]: rptCnt = %d, rptSz = %d, nsecDelay = %llu", i, 
+                list->sequences.at(i)->repeatCount_, 
+                list->sequences.at(i)->repeatSize_,
+                list->sequences.at(i)->nsecDelay_);
+        OST_TRACE(kTraceTx, kTraceDetail,
+                "sendQ[%d]: pkts = %ld, nsecDuration = %llu", i, 
+                list->sequences.at(i)->packets_, 
+                list->sequences.at(i)->nsecDuration_);
+    }
+
+    for (i = 0; i < list->segments.size(); i++) {
+        OST_TRACE(kTraceTx, kTraceDetail,
+                "segment[%d]: start = %d, next = %d, delay = %llu", i,
+                list->segments.at(i).startIdx,
+                list->segments.at(i).nextSegment,
+                list->segments.at(i).delayNsec);
     }
 
     state_ = kRunning;
-    i = 0;
-    while (i < packetSequenceList_.size())
+    seg = 0;
+    while ((seg >= 0) && (seg < list->segments.size()) && !stop_)
     {
+        int end = segmentEnd(list, seg);
 
-_restart:
-        int rptSz  = packetSequenceList_.at(i)->repeatSize_;
-        int rptCnt = packetSequenceList_.at(i)->repeatCount_;
-
-        for (int j = 0; j < rptCnt; j++)
+        i = list->segments.at(seg).startIdx;
+        while (i < end)
         {
-            for (int k = 0; k < rptSz; k++)
+            int rptSz  = list->sequences.at(i)->repeatSize_;
+            int rptCnt = list->sequences.at(i)->repeatCount_;
+
+            for (int j = 0; j < rptCnt; j++)
             {
-                int ret;
-                PacketSequence *seq = packetSequenceList_.at(i+k);
+                for (int k = 0; k < rptSz; k++)
+                {
+                    int ret;
+                    PacketSequence *seq = list->sequences.at(i+k);
 #ifdef Q_OS_WIN32
-                TimeStamp ovrStart, ovrEnd;
+                    TimeStamp ovrStart, ovrEnd;
 
-                if (seq->usecDuration_ <= long(1e6)) // 1s
-                {
-                    getTimeStamp(&ovrStart);
-                    ret = pcap_sendqueue_transmit(handle_, 
-                            seq->sendQueue_, kSyncTransmit);
-                    if (ret >= 0)
+                    // A rate profile needs every gap to be scaled
+                    if ((seq->nsecDuration_ <= quint64(1e9)) // 1s
+                            && rateProfile_.isEmpty())
                     {
-                        stats_->txPkts += seq->packets_;
-                        stats_->txBytes += seq->bytes_;
-
-                        getTimeStamp(&ovrEnd);
-                        overHead += seq->usecDuration_ 
-                            - udiffTimeStamp(&ovrStart, &ovrEnd);
-                        Q_ASSERT(overHead <= 0);
+                        // Lateness of the first packet (after the delay
+                        // below) - that of the others is not known
+                        countLateness(-overHead);
+                        getTimeStamp(&ovrStart);
+                        ret = pcap_sendqueue_transmit(handle_, 
+                                seq->sendQueue_, kSyncTransmit);
+                        if (ret >= 0)
+                        {
+                            stats_->txPkts += seq->packets_;
+                            stats_->txBytes += seq->bytes_;
+
+                            getTimeStamp(&ovrEnd);
+                            overHead += qint64(seq->nsecDuration_)
+                                - ndiffTimeStamp(&ovrStart, &ovrEnd);
+                            Q_ASSERT(overHead <= 0);
+                        }
+                        if (stop_)
+                            ret = -2;
+                    }
+                    else
+                    {
+                        ret = sendQueueTransmit(handle_, seq->sendQueue_, 
+                                overHead, kSyncTransmit);
                     }
-                    if (stop_)
-                        ret = -2;
-                }
-                else
-                {
-                    ret = sendQueueTransmit(handle_, seq->sendQueue_, 
-                            overHead, kSyncTransmit);
-                }
 #else
-                ret = sendQueueTransmit(handle_, seq->sendQueue_, 
-                            overHead, kSyncTransmit);
+                    ret = sendQueueTransmit(handle_, seq->sendQueue_, 
+                                overHead, kSyncTransmit);
 #endif
 
-                if (ret >= 0)
-                {
-                    long usecs = seq->usecDelay_ + overHead; 
-                    if (usecs > 0) 
+                    if (ret >= 0)
                     {
-                        udelay(usecs);
-                        overHead = 0;
+                        qint64 nsecs = rateProfile_.scaled(
+                                Timeline::fracDelay(seq->nsecDelay_, 
+                                    seq->nsecDelayFrac_, fracAcc)) + overHead; 
+                        // Overshoot, if any, is made up in the next gap;
+                        // sendQueueTransmit() counts it as the lateness of
+                        // the next packet (so also for the segment delay)
+                        if (nsecs > 0) 
+                            overHead = -nsdelay(nsecs);
+                        else
+                            overHead = nsecs;
                     }
                     else
-                        overHead = usecs;
-                }
-                else
-                {
-                    qDebug("error %d in sendQueueTransmit()", ret);
-                    qDebug("overHead = %ld", overHead);
-                    stop_ = false;
-                    goto _exit;
+                    {
+                        qDebug("error %d in sendQueueTransmit()", ret);
+                        qDebug("overHead = %lld", overHead);
+                        stop_ = false;
+                        goto _exit;
+                    }
+
+                    // Switch over to a new packet list (if any) at this
+                    // packet set boundary - the current segment continues
+                    // from the same position in the new list if its layout
+                    // is unchanged, else the switch is deferred to the end
+                    // of the segment so that no packet is sent twice
+                    newList = pendingList_.fetchAndStoreOrdered(NULL);
+                    if (newList)
+                    {
+                        if (isSameSegmentLayout(list, newList, seg))
+                        {
+                            OST_TRACE(kTraceTx, kTraceInfo,
+                                    "switching to new packet list");
+                            clearPreload();
+                            i += newList->segments.at(seg).startIdx
+                                    - list->segments.at(seg).startIdx;
+                            end = segmentEnd(newList, seg);
+                            list = newList;
+                            txList_.fetchAndStoreOrdered(list);
+                            deferredList = NULL;
+                        }
+                        else
+                            deferredList = newList;
+                    }
                 }
             }
+
+            // Move to the next Packet Set
+            i += rptSz;
         }
 
-        // Move to the next Packet Set
-        i += rptSz;
-    }
+        {
+            qint64 nsecs = rateProfile_.scaled(
+                                Timeline::fracDelay(
+                                    list->segments.at(seg).delayNsec, 
+                                    list->segments.at(seg).delayFrac, fracAcc))
+                                + overHead;
+
+            if (nsecs > 0)
+                overHead = -nsdelay(nsecs);
+            else
+                overHead = nsecs;
+        }
 
-    if (returnToQIdx_ >= 0)
-    {
-        long usecs = loopDelay_ + overHead;
+        seg = list->segments.at(seg).nextSegment;
 
-        if (usecs > 0)
+        // The new list (if any) continues with the next segment
+        newList = pendingList_.fetchAndStoreOrdered(NULL);
+        if (!newList)
+            newList = deferredList;
+        if (newList)
         {
-            udelay(usecs);
-            overHead = 0;
+            OST_TRACE(kTraceTx, kTraceInfo, "switching to new packet list");
+            clearPreload();
+            list = newList;
+            txList_.fetchAndStoreOrdered(list);
+            deferredList = NULL;
+            if (seg >= list->segments.size())
+                seg = 0;
         }
-        else
-            overHead = usecs;
-
-        i = returnToQIdx_;
-        goto _restart;
     }
+    stop_ = false;
 
 _exit:
     state_ = kFinished;
 }
 
+int PcapPort::PortTransmitter::segmentEnd(const PacketList *list, int seg)
+{
+    // A segment extends upto the start of the next segment
+    return ((seg + 1) < list->segments.size()) ?
+                list->segments.at(seg + 1).startIdx :
+                list->sequences.size();
+}
+
+/*!
+  Returns true if segment \a seg has the same packet sets (number of
+  packets, repeat size and count of each sequence) in both lists, so that
+  a transmit in progress can continue from the same position in \a list2
+*/
+bool PcapPort::PortTransmitter::isSameSegmentLayout(const PacketList *list1,
+        const PacketList *list2, int seg)
+{
+    if ((seg >= list1->segments.size()) || (seg >= list2->segments.size()))
+        return false;
+
+    int start1 = list1->segments.at(seg).startIdx;
+    int start2 = list2->segments.at(seg).startIdx;
+    int count = segmentEnd(list1, seg) - start1;
+
+    if (count != (segmentEnd(list2, seg) - start2))
+        return false;
+
+    for (int i = 0; i < count; i++)
+    {
+        const PacketSequence *seq1 = list1->sequences.at(start1 + i);
+        const PacketSequence *seq2 = list2->sequences.at(start2 + i);
+
+        if ((seq1->repeatSize_ != seq2->repeatSize_)
+                || (seq1->repeatCount_ != seq2->repeatCount_)
+                || (seq1->packets_ != seq2->packets_))
+            return false;
+    }
+
+    return true;
+}
+
 void PcapPort::PortTransmitter::start()
 {
     // FIXME: return error
@@ -602,6 +955,14 @@ void PcapPort::PortTransmitter::start()
         return;
     }
 
+    if (producer_)
+        producer_->start();
+
+    activeList_ = buildList_;
+    committedList_ = NULL;
+    pendingList_.fetchAndStoreOrdered(NULL);
+    txList_.fetchAndStoreOrdered(activeList_);
+
     state_ = kNotStarted;
     QThread::start();
 
@@ -615,6 +976,8 @@ void PcapPort::PortTransmitter::stop()
         stop_ = true;
         while (state_ == kRunning)
             QThread::msleep(10);
+        if (producer_)
+            producer_->stop();
     }
     else {
         // FIXME: return error
@@ -629,14 +992,19 @@ bool PcapPort::PortTransmitter::isRunning()
 }
 
 int PcapPort::PortTransmitter::sendQueueTransmit(pcap_t *p,
-        pcap_send_queue *queue, long &overHead, int sync)
+        pcap_send_queue *queue, qint64 &overHead, int sync)
 {
     TimeStamp ovrStart, ovrEnd;
-    struct timeval ts;
+    quint64 ts;
     struct pcap_pkthdr *hdr = (struct pcap_pkthdr*) queue->buffer;
     char *end = queue->buffer + queue->len;
 
-    ts = hdr->ts;
+    ts = PacketSequence::tsToNsec(hdr->ts);
+
+#ifdef Q_OS_LINUX
+    if (txQueue_)
+        txQueue_->preload((uchar*) queue->buffer, queue->len);
+#endif
 
     getTimeStamp(&ovrStart);
     while((char*) hdr < end)
@@ -646,29 +1014,31 @@ int PcapPort::PortTransmitter::sendQueueTransmit(pcap_t *p,
 
         if (sync)
         {
-            long usec = (hdr->ts.tv_sec - ts.tv_sec) * 1000000 +
-                (hdr->ts.tv_usec - ts.tv_usec);
+            quint64 pktTs = PacketSequence::tsToNsec(hdr->ts);
+            qint64 nsec = rateProfile_.scaled(pktTs - ts);
 
             getTimeStamp(&ovrEnd);
 
-            overHead -= udiffTimeStamp(&ovrStart, &ovrEnd);
-            Q_ASSERT(overHead <= 0);
-            usec += overHead;
-            if (usec > 0)
+            overHead -= ndiffTimeStamp(&ovrStart, &ovrEnd);
+            Q_ASSERT(overHead <= txBatchWindow_);
+            nsec += overHead;
+            if (nsec > txBatchWindow_)
             {
-                udelay(usec);
-                overHead = 0;
+                // packets queued so far are due now
+                flushPackets();
+                overHead = -nsdelay(nsec);
             }
             else
-                overHead = usec;
+                overHead = nsec; // batch with the packets queued so far
+            countLateness(-overHead);
 
-            ts = hdr->ts;
+            ts = pktTs;
             getTimeStamp(&ovrStart);
         }
 
         Q_ASSERT(pktLen > 0);
 
-        pcap_sendpacket(p, pkt, pktLen);
+        sendPacket(p, pkt, pktLen);
         stats_->txPkts++;
         stats_->txBytes += pktLen;
 
@@ -678,52 +1048,228 @@ int PcapPort::PortTransmitter::sendQueueTransmit(pcap_t *p,
 
         if (stop_)
         {
+            flushPackets();
             return -2;
         }
     }
 
+    flushPackets();
     return 0;
 }
 
-void PcapPort::PortTransmitter::udelay(long usec)
+/*
+  Transmits packets generated on the fly by the producer - overHead 
+  accounting is the same as in sendQueueTransmit(). If the producer can't
+  keep up, packets are sent as fast as they are generated
+*/
+int PcapPort::PortTransmitter::producerTransmit(pcap_t *p, qint64 &overHead)
+{
+    TimeStamp ovrStart, ovrEnd;
+    quint64 ts = 0;
+
+    getTimeStamp(&ovrStart);
+    while (!stop_)
+    {
+        const PacketProducer::Packet *pkt = producer_->peek();
+
+        if (!pkt)
+        {
+            flushPackets();
+            if (producer_->isDone())
+                return 0;
+            producer_->waitForPackets(); // producer is behind
+            continue;
+        }
+
+        qint64 nsec = rateProfile_.scaled(pkt->tsNsec - ts);
+
+        getTimeStamp(&ovrEnd);
+        overHead -= ndiffTimeStamp(&ovrStart, &ovrEnd);
+        Q_ASSERT(overHead <= txBatchWindow_);
+        nsec += overHead;
+        if (nsec > txBatchWindow_)
+        {
+            flushPackets();
+            overHead = -nsdelay(nsec);
+        }
+        else
+            overHead = nsec;
+        countLateness(-overHead);
+
+        ts = pkt->tsNsec;
+        getTimeStamp(&ovrStart);
+
+        sendPacket(p, pkt->data, pkt->length);
+        stats_->txPkts++;
+        stats_->txBytes += pkt->length;
+
+        producer_->pop();
+    }
+
+    flushPackets();
+    return -2;
+}
+
+/*
+  Sends (or queues, if using a tx queue) a packet - queued packets are 
+  transmitted in a batch by flushPackets(), which must be called before
+  any delay so that queued packets are not delayed
+*/
+int PcapPort::PortTransmitter::sendPacket(pcap_t *p, const uchar *packet,
+        int length)
+{
+#ifdef Q_OS_LINUX
+    if (txQueue_)
+    {
+        if (txQueue_->send(packet, length) == 0)
+            return 0;
+
+        // Can't queue this packet - maintain packet order
+        txQueue_->flush();
+    }
+#endif
+
+    return pcap_sendpacket(p, packet, length);
+}
+
+/*
+  Transmits the packets queued on the tx queue (if any) - packets dropped
+  by the queue, since they were counted when queued, are uncounted
+*/
+void PcapPort::PortTransmitter::flushPackets()
+{
+#ifdef Q_OS_LINUX
+    if (txQueue_)
+    {
+        quint64 packets, bytes;
+
+        txQueue_->flush();
+        txQueue_->takeDropped(packets, bytes);
+        stats_->txPkts -= packets;
+        stats_->txBytes -= bytes;
+    }
+#endif
+}
+
+/*
+  Forgets the packet buffers preloaded on the tx queue (if any) - must be
+  called before the buffers of the current packet list may be freed or
+  reused i.e. whenever we switch to another list
+*/
+void PcapPort::PortTransmitter::clearPreload()
+{
+#ifdef Q_OS_LINUX
+    if (txQueue_)
+        txQueue_->clearPreload();
+#endif
+}
+
+/*
+  Delays for nsec and returns the nsecs by which the delay overshot (0 if
+  not known or if stopped) - on Linux, a long delay sleeps (freeing the
+  cpu for other ports) till shortly before the deadline and spins for the
+  rest of it so that the sleep's wakeup latency doesn't delay us
+*/
+qint64 PcapPort::PortTransmitter::nsdelay(quint64 nsec)
 {
 #if defined(Q_OS_WIN32)
     LARGE_INTEGER tgtTicks;
     LARGE_INTEGER curTicks;
 
     QueryPerformanceCounter(&curTicks);
-    tgtTicks.QuadPart = curTicks.QuadPart + (usec*ticksFreq_)/1000000;
+    tgtTicks.QuadPart = curTicks.QuadPart 
+        + (nsec/quint64(1e9))*ticksFreq_ 
+        + ((nsec%quint64(1e9))*ticksFreq_)/quint64(1e9);
 
     while (curTicks.QuadPart < tgtTicks.QuadPart)
         QueryPerformanceCounter(&curTicks);
+
+    return ndiffTimeStamp(&tgtTicks, &curTicks);
 #elif defined(Q_OS_LINUX)
-    struct timeval delay, target, now;
+    TimeStamp now, deadline, wakeup, slice;
+    qint64 latency;
 
-    //qDebug("usec delay = %ld", usec);
+    //qDebug("nsec delay = %llu", nsec);
 
-    delay.tv_sec = 0;
-    delay.tv_usec = usec;
+    getTimeStamp(&now);
+    deadline = now;
+    addTimeStamp(&deadline, nsec);
 
-    while (delay.tv_usec >= 1000000)
+    if (nsec >= quint64(spinNsec_ + kMinSleepNsec))
     {
-        delay.tv_sec++;
-        delay.tv_usec -= 1000000;
+        wakeup = deadline;
+        addTimeStamp(&wakeup, -spinNsec_);
+
+        // Sleep in slices so that a long delay doesn't hold up a stop
+        while (ndiffTimeStamp(&now, &wakeup) > 0)
+        {
+            slice = now;
+            addTimeStamp(&slice, kSleepSliceNsec);
+            if (ndiffTimeStamp(&wakeup, &slice) > 0)
+                slice = wakeup;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slice, NULL);
+            getTimeStamp(&now);
+            if (stop_)
+                return 0;
+        }
+
+        // Adapt the spin to the wakeup latency - quickly up, slowly down
+        latency = ndiffTimeStamp(&wakeup, &now);
+        if (latency > spinNsec_)
+            spinNsec_ = qMin(latency, qint64(kMaxSpinNsec));
+        else
+            spinNsec_ = qMax(spinNsec_ - (spinNsec_ - latency)/16, 
+                             qint64(kMinSpinNsec));
     }
 
-    gettimeofday(&now, NULL);
-    timeradd(&now, &delay, &target);
+    while (ndiffTimeStamp(&now, &deadline) > 0)
+        getTimeStamp(&now);
 
-    do {
-        gettimeofday(&now, NULL);
-    } while (timercmp(&now, &target, <));
+    return ndiffTimeStamp(&deadline, &now);
 #else
-    QThread::usleep(usec);
+    QThread::usleep(nsec/1000);
+    return 0;
 #endif 
 }
 
-PcapPort::PortCapturer::PortCapturer(const char *device)
+#ifdef Q_OS_LINUX
+/*
+  Sets the initial spin of nsdelay() as per the wakeup latency of a few 
+  short sleeps of this thread - nsdelay() adapts it thereafter
+*/
+void PcapPort::PortTransmitter::calibrateSleep()
+{
+    const int kSleeps = 8;
+    const int kSleepNsec = 50000;
+    TimeStamp wakeup, now;
+    qint64 latency, maxLatency = 0;
+
+    for (int i = 0; i < kSleeps; i++)
+    {
+        getTimeStamp(&wakeup);
+        addTimeStamp(&wakeup, kSleepNsec);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL);
+        getTimeStamp(&now);
+
+        latency = ndiffTimeStamp(&wakeup, &now);
+        if (latency > maxLatency)
+            maxLatency = latency;
+    }
+
+    spinNsec_ = qBound(qint64(kMinSpinNsec), 2*maxLatency, 
+                       qint64(kMaxSpinNsec));
+    qDebug("%s: max wakeup latency = %lld nsec; spin = %lld nsec", 
+            __FUNCTION__, maxLatency, spinNsec_);
+}
+#endif
+
+PcapPort::PortCapturer::PortCapturer(const char *device,
+        AbstractPort::PortStats *stats)
 {
     device_ = QString::fromAscii(device);
+    stats_ = stats;
+    maxPackets_ = 0;
+    maxBytes_ = 0;
     stop_ = false;
     state_ = kNotStarted;
 
@@ -732,8 +1278,10 @@ PcapPort::PortCapturer::PortCapturer(const char *device)
 
     qDebug("cap file = %s", capFile_.fileName().toAscii().constData());
 
-    dumpHandle_ = NULL;
     handle_ = NULL;
+    hasStopFilter_ = false;
+    packets_ = 0;
+    bytes_ = 0;
 }
 
 PcapPort::PortCapturer::~PortCapturer()
@@ -745,6 +1293,7 @@ void PcapPort::PortCapturer::run()
 {
     int flag = PCAP_OPENFLAG_PROMISCUOUS;
     char errbuf[PCAP_ERRBUF_SIZE] = "";
+    struct bpf_program filter;
     
     qDebug("In %s", __PRETTY_FUNCTION__);
 
@@ -753,9 +1302,38 @@ void PcapPort::PortCapturer::run()
         qWarning("temp cap file is not open");
         goto _exit;
     }
+
+    hasStopFilter_ = !config_.stop_filter().empty();
+    if (hasStopFilter_ && !compileFilter(config_.stop_filter().c_str(),
+                config_.snap_len(), &stopFilter_))
+    {
+        hasStopFilter_ = false;
+        goto _exit;
+    }
+
+    writer_.setSegments(config_.segment_count(), config_.segment_bytes(),
+            config_.segment_packets());
+    if (!writer_.open(capFile_.fileName(), config_.snap_len()))
+        goto _finish;
+    packets_ = 0;
+    bytes_ = 0;
+
+#ifdef Q_OS_LINUX
+    // Use a TPACKET_V3 ring, if possible
+    if (ringCapture() == 0)
+    {
+        stop_ = false;
+        goto _finish;
+    }
+#endif
+
+    if (!compileFilter(config_.filter().c_str(), config_.snap_len(), 
+                &filter))
+        goto _finish;
+
 _retry:
-    handle_ = pcap_open_live(device_.toAscii().constData(), 65535, 
-                    flag, 1000 /* ms */, errbuf);
+    handle_ = pcap_open_live(device_.toAscii().constData(), 
+                    config_.snap_len(), flag, 1000 /* ms */, errbuf);
 
     if (handle_ == NULL)
     {
@@ -770,12 +1348,22 @@ _retry:
         {
             qDebug("%s: Error opening port %s: %s\n", __FUNCTION__,
                     device_.toAscii().constData(), errbuf);
-            goto _exit;
+            pcap_freecode(&filter);
+            goto _finish;
         }
     }
 
-    dumpHandle_ = pcap_dump_open(handle_, 
-            capFile_.fileName().toAscii().constData());
+    if (pcap_setfilter(handle_, &filter) < 0)
+    {
+        qWarning("%s: unable to set filter: %s", __FUNCTION__, 
+                pcap_geterr(handle_));
+        pcap_freecode(&filter);
+        pcap_close(handle_);
+        handle_ = NULL;
+        goto _finish;
+    }
+    pcap_freecode(&filter);
+
     state_ = kRunning;
     while (1)
     {
@@ -787,10 +1375,13 @@ _retry:
         switch (ret)
         {
             case 1:
-                pcap_dump((uchar*) dumpHandle_, hdr, data);
+                if (!capture(*hdr, data))
+                    stop_ = true;
                 break;
             case 0:
-                // timeout: just go back to the loop
+                // timeout: make the capture so far available for a fetch
+                // and just go back to the loop
+                writer_.flush();
                 break;
             case -1:
                 qWarning("%s: error reading packet (%d): %s", 
@@ -803,20 +1394,126 @@ _retry:
 
         if (stop_) 
         {
-            qDebug("user requested capture stop\n");
+            qDebug("capture stopped\n");
             break;
         }
     }
-    pcap_dump_close(dumpHandle_);
+
+    {
+        struct pcap_stat ps;
+
+        if (pcap_stats(handle_, &ps) == 0)
+            stats_->captureDrops += ps.ps_drop;
+    }
+
     pcap_close(handle_);
-    dumpHandle_ = NULL;
     handle_ = NULL;
     stop_ = false;
 
+_finish:
+    writer_.close();
+    if (hasStopFilter_)
+        pcap_freecode(&stopFilter_);
+    hasStopFilter_ = false;
+
 _exit:
     state_ = kFinished;
 }
 
+/*
+  Writes the packet to the capture file - returns false if capture is 
+  to be stopped i.e. a limit is reached (the packet is not written) or
+  the packet matches the stop filter (the packet is written)
+*/
+bool PcapPort::PortCapturer::capture(const struct pcap_pkthdr &hdr,
+        const uchar *data)
+{
+    if (isOverLimit(packets_ + 1, bytes_ + hdr.caplen))
+    {
+        qDebug("capture limit reached\n");
+        return false;
+    }
+
+    writer_.append(hdr.ts.tv_sec, hdr.ts.tv_usec, hdr.caplen, hdr.len,
+            data);
+    packets_++;
+    bytes_ += hdr.caplen;
+
+    if (hasStopFilter_ && pcap_offline_filter(&stopFilter_, &hdr, data))
+    {
+        qDebug("capture stop filter matched\n");
+        return false;
+    }
+
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+/*
+  Captures via a TPACKET_V3 ring until stopped - each block of packets
+  is written to the capture file with a single write. Returns -1 if the
+  ring could not be setup
+*/
+int PcapPort::PortCapturer::ringCapture()
+{
+    LinuxRxRing ring;
+    LinuxRxRing::Packet pkt;
+    struct pcap_pkthdr hdr;
+    struct bpf_program filter;
+    struct sock_fprog fprog;
+
+    if (!compileFilter(config_.filter().c_str(), config_.snap_len(), 
+                &filter))
+        return -1;
+
+    // Classic BPF as compiled by libpcap is what the kernel runs - the 
+    // filter's return value truncates the packet to the snaplen
+    fprog.len = filter.bf_len;
+    fprog.filter = (struct sock_filter*) filter.bf_insns;
+    if (!ring.open(device_.toAscii().constData(), config_.snap_len(), 
+                &fprog))
+    {
+        pcap_freecode(&filter);
+        return -1;
+    }
+    pcap_freecode(&filter);
+
+    state_ = kRunning;
+    while (!stop_)
+    {
+        int count = ring.nextBlock(100 /* ms */);
+
+        if (count < 0)
+        {
+            qWarning("%s: error reading block: %s", __FUNCTION__,
+                    strerror(errno));
+            break;
+        }
+
+        while (!stop_ && ring.nextPacket(&pkt))
+        {
+            hdr.ts.tv_sec = pkt.tsSec;
+            hdr.ts.tv_usec = pkt.tsNsec/1000;
+            hdr.caplen = pkt.caplen;
+            hdr.len = pkt.length;
+            if (!capture(hdr, pkt.data))
+                stop_ = true;
+        }
+
+        if (count > 0)
+            ring.releaseBlock();
+
+        writer_.flush();
+        stats_->captureDrops += ring.drops();
+    }
+
+    if (stop_)
+        qDebug("capture stopped\n");
+
+    return 0;
+}
+#endif
+
 void PcapPort::PortCapturer::start()
 {
     // FIXME: return error
@@ -855,3 +1552,19 @@ QFile* PcapPort::PortCapturer::captureFile()
 {
     return &capFile_;
 }
+
+/*!
+  Sets the filter, snaplen and limits for the next start() - ignored if
+  the capture is already running
+*/
+void PcapPort::PortCapturer::setConfig(const OstProto::CaptureConfig &config)
+{
+    if (state_ == kRunning)
+        return;
+
+    config_.CopyFrom(config);
+    if (config_.snap_len() == 0)
+        config_.set_snap_len(65535);
+    maxPackets_ = config_.max_packets();
+    maxBytes_ = config_.max_bytes();
+}
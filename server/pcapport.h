@@ -20,17 +20,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #ifndef _SERVER_PCAP_PORT_H
 #define _SERVER_PCAP_PORT_H
 
+#include <QAtomicPointer>
 #include <QTemporaryFile>
 #include <QThread>
 #include <pcap.h>
 
 #include "abstractport.h"
+#include "capturewriter.h"
+#include "linuxtxqueue.h"
+#include "packetproducer.h"
 #include "pcapextra.h"
 
 class PcapPort : public AbstractPort
 {
 public:
-    PcapPort(int id, const char *device);
+    PcapPort(int id, const char *device, bool useMonitors = true);
     ~PcapPort();
 
     void init();
@@ -40,33 +44,47 @@ public:
 
     virtual void clearPacketList() { 
         transmitter_->clearPacketList();
-        setPacketListLoopMode(false, 0, 0);
+    }
+    virtual void commitPacketList() {
+        transmitter_->commitPacketList();
+    }
+    virtual void startPacketListSegment() {
+        transmitter_->startPacketListSegment();
     }
     virtual void loopNextPacketSet(qint64 size, qint64 repeats,
-            long repeatDelaySec, long repeatDelayNsec) {
+            quint64 repeatDelayNsec, quint32 repeatDelayFrac) {
         transmitter_->loopNextPacketSet(size, repeats, 
-                repeatDelaySec, repeatDelayNsec);
+                repeatDelayNsec, repeatDelayFrac);
     }
-    virtual bool appendToPacketList(long sec, long nsec, const uchar *packet, 
+    virtual bool appendToPacketList(quint64 tsNsec, const uchar *packet,
             int length) {
-        return transmitter_->appendToPacketList(sec, nsec, packet, length); 
+        return transmitter_->appendToPacketList(tsNsec, packet, length); 
     }
-    virtual void setPacketListLoopMode(bool loop, quint64 secDelay, quint64 nsecDelay)
+    virtual void setPacketListSegmentNext(int segment, int nextSegment,
+            quint64 delayNsec, quint32 delayFrac)
     {
-        transmitter_->setPacketListLoopMode(loop, secDelay, nsecDelay);
+        transmitter_->setPacketListSegmentNext(segment, nextSegment,
+                delayNsec, delayFrac);
     }
 
     virtual void startTransmit() { 
         Q_ASSERT(!isDirty());
+        transmitter_->setPacketProducer(producer_);
+        transmitter_->setRateProfile(rateProfile_);
         transmitter_->start(); 
     }
     virtual void stopTransmit()  { transmitter_->stop();  }
     virtual bool isTransmitOn() { return transmitter_->isRunning(); }
 
-    virtual void startCapture() { capturer_->start(); }
+    virtual void startCapture() {
+        capturer_->setConfig(data_.capture_config());
+        capturer_->start();
+    }
     virtual void stopCapture()  { capturer_->stop(); }
     virtual bool isCaptureOn()  { return capturer_->isRunning(); }
     virtual QIODevice* captureData() { return capturer_->captureFile(); }
+    virtual bool isCaptureConfigValid(const OstProto::CaptureConfig &config,
+            QString &result);
 
 protected:
     enum Direction
@@ -75,6 +93,9 @@ protected:
         kDirectionTx
     };
 
+    static bool compileFilter(const char *filter, int snapLen,
+            struct bpf_program *program, QString *error = NULL);
+
     class PortMonitor: public QThread
     {
     public:
@@ -100,18 +121,34 @@ protected:
     class PortTransmitter: public QThread
     {
     public:
-        PortTransmitter(const char *device);
+        PortTransmitter(const char *device, AbstractPort::PortStats *portStats,
+                AbstractPort::MaxStat *maxLate);
         ~PortTransmitter();
         void clearPacketList();
+        void commitPacketList();
+        void startPacketListSegment();
         void loopNextPacketSet(qint64 size, qint64 repeats, 
-            long repeatDelaySec, long repeatDelayNsec);
-        bool appendToPacketList(long sec, long usec, const uchar *packet, 
+            quint64 repeatDelayNsec, quint32 repeatDelayFrac);
+        bool appendToPacketList(quint64 tsNsec, const uchar *packet,
             int length);
-        void setPacketListLoopMode(bool loop, quint64 secDelay, quint64 nsecDelay) {
-            returnToQIdx_ = loop ? 0 : -1;
-            loopDelay_ = secDelay*long(1e6) + nsecDelay/1000;
+        void setPacketListSegmentNext(int segment, int nextSegment,
+                quint64 delayNsec, quint32 delayFrac) {
+            Q_ASSERT(segment < buildList_->segments.size());
+            buildList_->segments[segment].nextSegment = nextSegment;
+            buildList_->segments[segment].delayNsec = delayNsec;
+            buildList_->segments[segment].delayFrac = delayFrac;
+        }
+        void setPacketProducer(PacketProducer *producer) {
+            producer_ = producer;
+        }
+        void setRateProfile(const AbstractPort::RateProfile &profile) {
+            rateProfile_ = profile;
         }
         void setHandle(pcap_t *handle);
+#ifdef Q_OS_LINUX
+        void setTxQueue(LinuxTxQueue *txQueue);
+        void setQdiscBypass(bool bypass);
+#endif
         void useExternalStats(AbstractPort::PortStats *stats);
         void run();
         void start();
@@ -133,10 +170,11 @@ protected:
                 lastPacket_ = NULL;
                 packets_ = 0;
                 bytes_ = 0;
-                usecDuration_ = 0;
+                nsecDuration_ = 0;
                 repeatCount_ = 1;
                 repeatSize_ = 1;
-                usecDelay_ = 0;
+                nsecDelay_ = 0;
+                nsecDelayFrac_ = 0;
             }
             ~PacketSequence() {
                 pcap_sendqueue_destroy(sendQueue_);
@@ -150,46 +188,131 @@ protected:
             int appendPacket(const struct pcap_pkthdr *pktHeader, 
                     const uchar *pktData) {
                 if (lastPacket_) 
-                {
-                    usecDuration_ += (pktHeader->ts.tv_sec 
-                                        - lastPacket_->ts.tv_sec) * long(1e6);
-                    usecDuration_ += (pktHeader->ts.tv_usec 
-                                        - lastPacket_->ts.tv_usec);
-                }
+                    nsecDuration_ += tsToNsec(pktHeader->ts) 
+                                        - tsToNsec(lastPacket_->ts);
                 packets_++;
                 bytes_ += pktHeader->caplen;
                 lastPacket_ = (struct pcap_pkthdr *) 
                                     (sendQueue_->buffer + sendQueue_->len);
                 return pcap_sendqueue_queue(sendQueue_, pktHeader, pktData);
             }
+
+            // Packet timestamps in the sendQueue have nsec resolution - the
+            // tv_usec field holds nsecs (same as libpcap's nano precision
+            // savefiles) - except on Win32 where the sendQueue may be handed
+            // over to pcap_sendqueue_transmit() which needs usecs
+            static quint64 tsToNsec(const struct timeval &ts) {
+#ifdef Q_OS_WIN32
+                return quint64(ts.tv_sec)*quint64(1e9) + ts.tv_usec*1000;
+#else
+                return quint64(ts.tv_sec)*quint64(1e9) + ts.tv_usec;
+#endif
+            }
+            static void nsecToTs(quint64 nsec, struct timeval *ts) {
+                ts->tv_sec = nsec/quint64(1e9);
+#ifdef Q_OS_WIN32
+                ts->tv_usec = (nsec % quint64(1e9))/1000;
+#else
+                ts->tv_usec = nsec % quint64(1e9);
+#endif
+            }
+
             pcap_send_queue *sendQueue_;
             struct pcap_pkthdr *lastPacket_;
             long packets_;
             long bytes_;
-            ulong usecDuration_;
+            quint64 nsecDuration_;
             int repeatCount_;
             int repeatSize_;
-            long usecDelay_;
+            quint64 nsecDelay_;
+            quint32 nsecDelayFrac_;
         };
 
-        void udelay(long usec);
-        int sendQueueTransmit(pcap_t *p, pcap_send_queue *queue, long &overHead,
-                    int sync);
+        // A segment is the packetSequences from startIdx upto the start
+        // of the next segment
+        struct Segment
+        {
+            int startIdx;
+            int nextSegment; // -1 => stop
+            quint64 delayNsec;
+            quint32 delayFrac;
+        };
+
+        struct PacketList
+        {
+            QList<PacketSequence*> sequences;
+            QList<Segment> segments;
+        };
+
+        // packets due within this window are transmitted in one batch
+        static const int kTxBatchWindowNsec = 1000;
+
+        // packets sent later than this are counted as late
+        static const int kLateNsec = 1000;
+
+        // A delay sleeps till spinNsec_ before the deadline (if that's at
+        // least kMinSleepNsec away) and spins for the rest of it; spinNsec_
+        // adapts to the sleep's wakeup latency within these limits
+        static const int kMinSpinNsec = 2000;
+        static const int kMaxSpinNsec = 500000;
+        static const int kMinSleepNsec = 10000;
+        static const int kSleepSliceNsec = 100000000; // max, for stop_
+
+        qint64 nsdelay(quint64 nsec);
+#ifdef Q_OS_LINUX
+        void calibrateSleep();
+#endif
+        void countLateness(qint64 nsec) {
+            if (nsec > kLateNsec) {
+                portStats_->txLatePkts++;
+                maxLate_->update(nsec);
+            }
+        }
+        void clearPreload();
+        int sendPacket(pcap_t *p, const uchar *packet, int length);
+        void flushPackets();
+        int sendQueueTransmit(pcap_t *p, pcap_send_queue *queue, 
+                    qint64 &overHead, int sync);
+        int producerTransmit(pcap_t *p, qint64 &overHead);
+
+        static int segmentEnd(const PacketList *list, int seg);
+        static bool isSameSegmentLayout(const PacketList *list1,
+                const PacketList *list2, int seg);
 
         quint64 ticksFreq_;
-        QList<PacketSequence*> packetSequenceList_;
+        // The packet list is buffered so that it can be rebuilt while the
+        // transmitter is running - buildList_ is the one being built and
+        // activeList_ the one last handed over to the transmitter (same if
+        // not transmitting); pendingList_ is handed over to the transmitter
+        // which may take it but keep transmitting txList_ till the end of
+        // the segment - so a third list is needed to build into
+        static const int kPacketListCount = 3;
+        PacketList packetList_[kPacketListCount];
+        PacketList *buildList_;
+        PacketList *activeList_;
+        PacketList *committedList_;
+        QAtomicPointer<PacketList> pendingList_;
+        QAtomicPointer<PacketList> txList_;
         PacketSequence *currentPacketSequence_;
         int repeatSequenceStart_;
         quint64 repeatSize_;
         quint64 packetCount_;
 
-        int returnToQIdx_;
-        quint64 loopDelay_;
+        PacketProducer *producer_;
+        AbstractPort::RateProfile rateProfile_;
 
         bool usingInternalStats_;
         AbstractPort::PortStats *stats_;
+        // Lateness is counted by us even if the tx stats are not
+        AbstractPort::PortStats *portStats_;
+        AbstractPort::MaxStat *maxLate_;
         bool usingInternalHandle_;
         pcap_t *handle_;
+#ifdef Q_OS_LINUX
+        LinuxTxQueue *txQueue_; // owned
+#endif
+        qint64 txBatchWindow_; // nsecs
+        qint64 spinNsec_;      // 0 => not calibrated yet
         volatile bool stop_;
         volatile State state_;
     };
@@ -197,13 +320,14 @@ protected:
     class PortCapturer: public QThread
     {
     public:
-        PortCapturer(const char *device);
+        PortCapturer(const char *device, AbstractPort::PortStats *stats);
         ~PortCapturer();
         void run();
         void start();
         void stop();
         bool isRunning();
         QFile* captureFile();
+        void setConfig(const OstProto::CaptureConfig &config);
 
     private:
         enum State 
@@ -213,17 +337,41 @@ protected:
             kFinished
         };
 
+#ifdef Q_OS_LINUX
+        int ringCapture();
+#endif
+        bool capture(const struct pcap_pkthdr &hdr, const uchar *data);
+        bool isOverLimit(quint64 packets, quint64 bytes) const {
+            return (maxPackets_ && (packets > maxPackets_))
+                    || (maxBytes_ && (bytes > maxBytes_));
+        }
+
         QString         device_;
+        AbstractPort::PortStats *stats_;
+        OstProto::CaptureConfig config_;
+        quint64         maxPackets_;
+        quint64         maxBytes_;
+        struct bpf_program stopFilter_;
+        bool            hasStopFilter_;
+        quint64         packets_;
+        quint64         bytes_;
         volatile bool   stop_;
         QTemporaryFile  capFile_;
+        CaptureWriter   writer_;
         pcap_t          *handle_;
-        pcap_dumper_t   *dumpHandle_;
         volatile State  state_;
     };
 
+    // Per packet Rx/Tx stats - NULL if the stats are from the platform's
+    // interface counters instead
     PortMonitor     *monitorRx_;
     PortMonitor     *monitorTx_;
 
+    bool hasMonitors() const { return monitorRx_ != NULL; }
+    void startMonitors();
+
+    PortTransmitter* transmitter() { return transmitter_; }
+
     void updateNotes();
 
 private:
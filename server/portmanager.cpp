@@ -23,12 +23,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include <pcap.h>
 
 #include "dpdk.h"
+#include "droneenv.h"
 
 #include "bsdport.h"
 #include "dpdkport.h"
 #include "linuxport.h"
 #include "pcapport.h"
 #include "winpcapport.h"
+#include "xdpport.h"
 
 PortManager *PortManager::instance_ = NULL;
 
@@ -38,6 +40,12 @@ PortManager::PortManager()
     pcap_if_t *deviceList;
     pcap_if_t *device;
     char errbuf[PCAP_ERRBUF_SIZE];
+#if defined(Q_OS_LINUX)
+    QList<QByteArray> xdpDevices = droneXdpPorts();
+#endif
+#if defined(Q_OS_LINUX) || defined(Q_OS_BSD4)
+    QList<QByteArray> monitorDevices = droneMonitorPorts();
+#endif
 
     qDebug("Retrieving the device list from the local machine\n"); 
 
@@ -55,9 +63,14 @@ PortManager::PortManager()
 #if defined(Q_OS_WIN32)
         port = new WinPcapPort(i, device->name);
 #elif defined(Q_OS_LINUX)
-        port = new LinuxPort(i, device->name);
+        if (xdpDevices.contains(QByteArray(device->name)))
+            port = new XdpPort(i, device->name);
+        else
+            port = new LinuxPort(i, device->name,
+                    monitorDevices.contains(QByteArray(device->name)));
 #elif defined(Q_OS_BSD4)
-        port = new BsdPort(i, device->name);
+        port = new BsdPort(i, device->name,
+                monitorDevices.contains(QByteArray(device->name)));
 #else
         port = new PcapPort(i, device->name);
 #endif
@@ -0,0 +1,312 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "xdpport.h"
+
+#ifdef Q_OS_LINUX
+
+#include "linuxxsk.h"
+
+#include <sys/time.h>
+#include <time.h>
+
+XdpPort::XdpPort(int id, const char *device)
+    : LinuxPort(id, device)
+{
+    xsk_ = NULL;
+    receiver_ = NULL;
+}
+
+XdpPort::~XdpPort()
+{
+    // The receiver must be done with the socket before the transmitter
+    // (which owns the socket) is deleted
+    if (receiver_)
+    {
+        receiver_->stop();
+        delete receiver_;
+    }
+}
+
+void XdpPort::init()
+{
+    LinuxPort::init();
+
+    if (!xsk_)
+    {
+        addNote("AF_XDP socket could not be setup - using a packet socket");
+        return;
+    }
+
+    addNote("<i>Capture</i>: Only packets received on queue 0 are captured;"
+            " transmitted packets are never captured; packets are"
+            " timestamped when read from the socket, not on arrival");
+
+    receiver_ = new Receiver(xsk_);
+    receiver_->start();
+}
+
+void XdpPort::startCapture()
+{
+    if (receiver_)
+        receiver_->startCapture(data_.capture_config());
+    else
+        LinuxPort::startCapture();
+}
+
+void XdpPort::stopCapture()
+{
+    if (receiver_)
+        receiver_->stopCapture();
+    else
+        LinuxPort::stopCapture();
+}
+
+bool XdpPort::isCaptureOn()
+{
+    if (receiver_)
+        return receiver_->isCaptureOn();
+
+    return LinuxPort::isCaptureOn();
+}
+
+QIODevice* XdpPort::captureData()
+{
+    if (receiver_)
+        return receiver_->captureFile();
+
+    return LinuxPort::captureData();
+}
+
+LinuxTxQueue* XdpPort::createTxQueue()
+{
+    LinuxXsk *xsk = new LinuxXsk;
+
+    if (xsk->open(name()))
+    {
+        xsk_ = xsk;
+        return xsk;
+    }
+    delete xsk;
+
+    return LinuxPort::createTxQueue();
+}
+
+XdpPort::Receiver::Receiver(LinuxXsk *xsk)
+{
+    xsk_ = xsk;
+    stop_ = false;
+    captureState_ = kCaptureOff;
+
+    if (!capFile_.open())
+        qWarning("Unable to open temp cap file");
+
+    qDebug("cap file = %s", capFile_.fileName().toAscii().constData());
+
+    hasFilter_ = false;
+    hasStopFilter_ = false;
+    snapLen_ = 65535;
+    maxPackets_ = 0;
+    maxBytes_ = 0;
+    packets_ = 0;
+    bytes_ = 0;
+}
+
+XdpPort::Receiver::~Receiver()
+{
+    if (hasFilter_)
+        pcap_freecode(&filter_);
+    if (hasStopFilter_)
+        pcap_freecode(&stopFilter_);
+    capFile_.close();
+}
+
+/*!
+  Drains the socket's rx ring - packets are written into the capture file 
+  if capture is on, else just dropped
+*/
+void XdpPort::Receiver::run()
+{
+    LinuxXsk::Packet packets[kBatchSize];
+
+    while (!stop_)
+    {
+        int n;
+
+        if (captureState_ == kCaptureStarting)
+        {
+            writer_.setSegments(config_.segment_count(),
+                    config_.segment_bytes(), config_.segment_packets());
+            writer_.open(capFile_.fileName(), snapLen_);
+            captureState_ = writer_.isOpen() ? kCaptureOn : kCaptureOff;
+        }
+        else if (captureState_ == kCaptureStopping)
+        {
+            writer_.close();
+            captureState_ = kCaptureOff;
+        }
+
+        n = xsk_->receive(packets, kBatchSize, kPollTimeoutMsec);
+        if (n <= 0)
+            continue;
+
+        if (captureState_ == kCaptureOn)
+        {
+            // The rx descriptors carry no timestamp, so each packet is
+            // timestamped as it is read (and not once per batch)
+            for (int i = 0; i < n; i++)
+            {
+                struct timespec now;
+                struct timeval ts;
+
+                clock_gettime(CLOCK_REALTIME, &now);
+                ts.tv_sec = now.tv_sec;
+                ts.tv_usec = now.tv_nsec/1000;
+                if (!capture(packets[i].data, packets[i].length, ts))
+                {
+                    writer_.close();
+                    captureState_ = kCaptureOff;
+                    break;
+                }
+            }
+            writer_.flush();
+        }
+
+        xsk_->release();
+    }
+
+    writer_.close();
+    captureState_ = kCaptureOff;
+}
+
+/*
+  Writes the packet into the capture file as per the capture config - 
+  returns false if capture is to be stopped i.e. a limit is reached (the
+  packet is not written) or the packet matches the stop filter (the 
+  packet is written)
+*/
+bool XdpPort::Receiver::capture(const uchar *data, int length,
+        const struct timeval &ts)
+{
+    struct pcap_pkthdr hdr;
+
+    hdr.ts = ts;
+    hdr.len = length;
+    hdr.caplen = qMin(length, snapLen_);
+
+    if (hasFilter_ && !pcap_offline_filter(&filter_, &hdr, data))
+        return true;
+
+    if ((maxPackets_ && (packets_ + 1 > maxPackets_))
+            || (maxBytes_ && (bytes_ + hdr.caplen > maxBytes_)))
+    {
+        qDebug("capture limit reached");
+        return false;
+    }
+
+    writer_.append(ts.tv_sec, ts.tv_usec, hdr.caplen, hdr.len, data);
+    packets_++;
+    bytes_ += hdr.caplen;
+
+    if (hasStopFilter_ && pcap_offline_filter(&stopFilter_, &hdr, data))
+    {
+        qDebug("capture stop filter matched");
+        return false;
+    }
+
+    return true;
+}
+
+void XdpPort::Receiver::stop()
+{
+    stop_ = true;
+    wait();
+}
+
+void XdpPort::Receiver::startCapture(const OstProto::CaptureConfig &config)
+{
+    // FIXME: return error
+    if (captureState_ == kCaptureOn) {
+        qWarning("Capture start requested but is already running!");
+        return;
+    }
+
+    // Capture is off, so the receiver thread isn't using these
+    config_.CopyFrom(config);
+    if (config_.snap_len() == 0)
+        config_.set_snap_len(65535);
+
+    if (hasFilter_)
+        pcap_freecode(&filter_);
+    hasFilter_ = false;
+    if (!config_.filter().empty())
+    {
+        if (!compileFilter(config_.filter().c_str(), config_.snap_len(),
+                    &filter_))
+            return; // checked already by isCaptureConfigValid()
+        hasFilter_ = true;
+    }
+
+    if (hasStopFilter_)
+        pcap_freecode(&stopFilter_);
+    hasStopFilter_ = false;
+    if (!config_.stop_filter().empty())
+    {
+        if (!compileFilter(config_.stop_filter().c_str(), 
+                    config_.snap_len(), &stopFilter_))
+            return; // checked already by isCaptureConfigValid()
+        hasStopFilter_ = true;
+    }
+
+    snapLen_ = config_.snap_len();
+    maxPackets_ = config_.max_packets();
+    maxBytes_ = config_.max_bytes();
+    packets_ = 0;
+    bytes_ = 0;
+
+    captureState_ = kCaptureStarting;
+    while (captureState_ == kCaptureStarting)
+        QThread::msleep(10);
+}
+
+void XdpPort::Receiver::stopCapture()
+{
+    if (captureState_ == kCaptureOn) {
+        captureState_ = kCaptureStopping;
+        while (captureState_ == kCaptureStopping)
+            QThread::msleep(10);
+    }
+    else {
+        // FIXME: return error
+        qWarning("Capture stop requested but is not running!");
+        return;
+    }
+}
+
+bool XdpPort::Receiver::isCaptureOn()
+{
+    return (captureState_ == kCaptureOn);
+}
+
+QFile* XdpPort::Receiver::captureFile()
+{
+    return &capFile_;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef _SERVER_XDP_PORT_H
+#define _SERVER_XDP_PORT_H
+
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+
+#include "linuxport.h"
+
+class LinuxXsk;
+
+/*!
+  Linux port which transmits and receives via an AF_XDP socket
+
+  The port's packet list is transmitted from the socket's UMEM (see 
+  LinuxXsk) and all packets received on queue 0 are redirected to the
+  socket - so, like a DPDK port, the kernel doesn't see them. Received
+  packets are drained by a receiver thread which also captures them. 
+  Rx/Tx stats are the interface stats, same as any other Linux port.
+
+  If the socket can't be setup, the port works as a regular LinuxPort
+*/
+class XdpPort : public LinuxPort
+{
+public:
+    XdpPort(int id, const char *device);
+    ~XdpPort();
+
+    void init();
+
+    virtual void startCapture();
+    virtual void stopCapture();
+    virtual bool isCaptureOn();
+    virtual QIODevice* captureData();
+
+protected:
+    virtual LinuxTxQueue* createTxQueue();
+
+private:
+    class Receiver: public QThread
+    {
+    public:
+        Receiver(LinuxXsk *xsk);
+        ~Receiver();
+        void run();
+        void stop();
+        void startCapture(const OstProto::CaptureConfig &config);
+        void stopCapture();
+        bool isCaptureOn();
+        QFile* captureFile();
+
+    private:
+        enum CaptureState
+        {
+            kCaptureOff,
+            kCaptureStarting,
+            kCaptureOn,
+            kCaptureStopping
+        };
+
+        static const int kBatchSize = 64;
+        static const int kPollTimeoutMsec = 100;
+
+        bool capture(const uchar *data, int length,
+                const struct timeval &ts);
+
+        LinuxXsk                *xsk_;
+        volatile bool           stop_;
+        volatile CaptureState   captureState_;
+        QTemporaryFile          capFile_;
+        CaptureWriter           writer_;
+
+        // Capture config - not applied by the kernel as for other ports,
+        // since packets redirected to the socket are never seen by it
+        OstProto::CaptureConfig config_;
+        struct bpf_program      filter_;
+        bool                    hasFilter_;
+        struct bpf_program      stopFilter_;
+        bool                    hasStopFilter_;
+        int                     snapLen_;
+        quint64                 maxPackets_;
+        quint64                 maxBytes_;
+        quint64                 packets_;
+        quint64                 bytes_;
+    };
+
+    LinuxXsk *xsk_;     // owned by the transmitter
+    Receiver *receiver_;
+};
+
+#endif
+
+#endif
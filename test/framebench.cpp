@@ -0,0 +1,389 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "framebench.h"
+
+#include "abstractport.h"
+#include "abstractprotocol.h"
+#include "protocollistiterator.h"
+#include "streambase.h"
+
+#include "eth2.pb.h"
+#include "ip4.pb.h"
+#include "ip6.pb.h"
+#include "mac.pb.h"
+#include "payload.pb.h"
+#include "protocol.pb.h"
+#include "tcp.pb.h"
+#include "udp.pb.h"
+#include "userscript.pb.h"
+#include "vlan.pb.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+  Frame generation micro-benchmarks
+
+  Builds a few representative stream configs and times the frame 
+  generation methods for each - frameValue(), frameVariableCount(),
+  protocolFrameCksum() and a packet list update of a port which discards
+  the packets. Besides the rate, we also report the average count of heap
+  allocations per frame (where we can count them)
+*/
+
+//
+// Heap allocation counter - on glibc we interpose malloc() and friends
+// for the whole process (including Qt's own allocations); the benchmark
+// is single threaded, so the counter isn't atomic
+//
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+#define FRAMEBENCH_COUNT_ALLOCS
+
+static quint64 allocCount = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *ptr, size_t size);
+
+void* malloc(size_t size)
+{
+    allocCount++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    allocCount++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void *ptr, size_t size)
+{
+    allocCount++;
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+//
+// A port which drops the packet list - so that updatePacketList() can
+// be timed without any driver or device
+//
+class NullPort : public AbstractPort
+{
+public:
+    NullPort() : AbstractPort(0, "null") { packets_ = 0; }
+
+    virtual bool hasExclusiveControl() { return false; }
+    virtual bool setExclusiveControl(bool /*exclusive*/) { return false; }
+
+    virtual void clearPacketList() { packets_ = 0; }
+    virtual void startPacketListSegment() {}
+    virtual void loopNextPacketSet(qint64 /*size*/, qint64 /*repeats*/,
+            quint64 /*repeatDelayNsec*/, quint32 /*repeatDelayFrac*/) {}
+    virtual bool appendToPacketList(quint64 /*tsNsec*/, 
+            const uchar* /*packet*/, int /*length*/) 
+        { packets_++; return true; }
+    virtual void setPacketListSegmentNext(int /*segment*/, 
+            int /*nextSegment*/, quint64 /*delayNsec*/, 
+            quint32 /*delayFrac*/) {}
+    virtual void commitPacketList() {}
+
+    virtual void startTransmit() {}
+    virtual void stopTransmit() {}
+    virtual bool isTransmitOn() { return false; }
+
+    virtual void startCapture() {}
+    virtual void stopCapture() {}
+    virtual bool isCaptureOn() { return false; }
+    virtual QIODevice* captureData() { return NULL; }
+
+    quint64 packets() { return packets_; }
+
+private:
+    quint64 packets_;
+};
+
+class Benchmark
+{
+public:
+    Benchmark(const char *config, const char *method) 
+    {
+        config_ = config;
+        method_ = method;
+#ifdef FRAMEBENCH_COUNT_ALLOCS
+        allocs_ = allocCount;
+#endif
+        timer_.start();
+    }
+
+    void done(quint64 frames)
+    {
+        qint64 nsec = timer_.nsecsElapsed();
+
+        printf("%-16s %-22s %12.0f frames/s", config_, method_, 
+                nsec ? frames * 1e9 / nsec : 0.0);
+#ifdef FRAMEBENCH_COUNT_ALLOCS
+        printf(" %10.2f allocs/frame", 
+                frames ? double(allocCount - allocs_) / frames : 0.0);
+#endif
+        printf("\n");
+    }
+
+private:
+    const char *config_;
+    const char *method_;
+    quint64 allocs_;
+    QElapsedTimer timer_;
+};
+
+static OstProto::Protocol* addProtocol(OstProto::Stream &s, int protocolId)
+{
+    OstProto::Protocol *p = s.add_protocol();
+
+    p->mutable_protocol_id()->set_id(protocolId);
+    return p;
+}
+
+static OstProto::Stream baseStream(int frameLen)
+{
+    OstProto::Stream s;
+
+    s.mutable_stream_id()->set_id(1);
+    s.mutable_core()->set_is_enabled(true);
+    s.mutable_core()->set_frame_len(frameLen);
+    s.mutable_control()->set_unit(OstProto::StreamControl::e_su_packets);
+    s.mutable_control()->set_num_packets(1000);
+    s.mutable_control()->set_packets_per_sec(1000000);
+
+    addProtocol(s, OstProto::Protocol::kMacFieldNumber)
+        ->MutableExtension(OstProto::mac)->set_dst_mac(0x000102030405ULL);
+
+    return s;
+}
+
+static void addIp4(OstProto::Stream &s, OstProto::Ip4::IpAddrMode srcMode)
+{
+    OstProto::Ip4 *ip4;
+
+    addProtocol(s, OstProto::Protocol::kEth2FieldNumber);
+    ip4 = addProtocol(s, OstProto::Protocol::kIp4FieldNumber)
+                ->MutableExtension(OstProto::ip4);
+    ip4->set_src_ip(0x0a000001);
+    ip4->set_src_ip_mode(srcMode);
+    ip4->set_src_ip_count(256);
+    ip4->set_dst_ip(0x0a000101);
+}
+
+static QList<QPair<QString, OstProto::Stream> > streamConfigs()
+{
+    QList<QPair<QString, OstProto::Stream> > configs;
+    OstProto::Stream s;
+    OstProto::Ip6 *ip6;
+
+    // Mac+Eth2+Ip4+Udp+Payload
+    s = baseStream(1024);
+    addIp4(s, OstProto::Ip4::e_im_fixed);
+    addProtocol(s, OstProto::Protocol::kUdpFieldNumber);
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber);
+    configs.append(qMakePair(QString("ip4-udp"), s));
+
+    // Same as above with a source address that varies
+    s = baseStream(1024);
+    addIp4(s, OstProto::Ip4::e_im_inc_host);
+    addProtocol(s, OstProto::Protocol::kUdpFieldNumber);
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber);
+    configs.append(qMakePair(QString("ip4-udp-inc"), s));
+
+    // QinQ VLAN stack
+    s = baseStream(1024);
+    addProtocol(s, OstProto::Protocol::kVlanFieldNumber)
+        ->MutableExtension(OstProto::vlan)->set_vlan_tag(100);
+    addProtocol(s, OstProto::Protocol::kVlanFieldNumber)
+        ->MutableExtension(OstProto::vlan)->set_vlan_tag(200);
+    addIp4(s, OstProto::Ip4::e_im_fixed);
+    addProtocol(s, OstProto::Protocol::kUdpFieldNumber);
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber);
+    configs.append(qMakePair(QString("vlan2-ip4-udp"), s));
+
+    // IPv6/TCP with a varying source address
+    s = baseStream(1024);
+    addProtocol(s, OstProto::Protocol::kEth2FieldNumber);
+    ip6 = addProtocol(s, OstProto::Protocol::kIp6FieldNumber)
+                ->MutableExtension(OstProto::ip6);
+    ip6->set_src_addr_hi(0x20010db800000000ULL);
+    ip6->set_src_addr_lo(1);
+    ip6->set_src_addr_mode(OstProto::Ip6::kIncHost);
+    ip6->set_src_addr_prefix(64);
+    ip6->set_dst_addr_hi(0x20010db800000000ULL);
+    ip6->set_dst_addr_lo(2);
+    addProtocol(s, OstProto::Protocol::kTcpFieldNumber);
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber);
+    configs.append(qMakePair(QString("ip6-tcp"), s));
+
+    // UserScript
+    s = baseStream(256);
+    addIp4(s, OstProto::Ip4::e_im_fixed);
+    addProtocol(s, OstProto::Protocol::kUserScriptFieldNumber)
+        ->MutableExtension(OstProto::userScript)->set_program(
+            "protocol.protocolFrameValue = function(index) {\n"
+            "    return [0xde, 0xad, 0xbe, 0xef, (index >> 8) & 0xff,\n"
+            "            index & 0xff, 0, 0];\n"
+            "}\n"
+            "protocol.protocolFrameSize = function(index) {\n"
+            "    return 8;\n"
+            "}\n"
+            "protocol.setProtocolFrameValueVariable(true);\n"
+            "protocol.setProtocolFrameVariableCount(256);\n");
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber);
+    configs.append(qMakePair(QString("userscript"), s));
+
+    // Random length, random payload and a random source address
+    s = baseStream(64);
+    s.mutable_core()->set_len_mode(OstProto::StreamCore::e_fl_random);
+    s.mutable_core()->set_frame_len_min(64);
+    s.mutable_core()->set_frame_len_max(1518);
+    addIp4(s, OstProto::Ip4::e_im_random_host);
+    addProtocol(s, OstProto::Protocol::kUdpFieldNumber);
+    addProtocol(s, OstProto::Protocol::kPayloadFieldNumber)
+        ->MutableExtension(OstProto::payload)->set_pattern_mode(
+                OstProto::Payload::e_dp_random);
+    configs.append(qMakePair(QString("random"), s));
+
+    return configs;
+}
+
+static void benchStream(const char *name, const OstProto::Stream &config,
+        int frames)
+{
+    static uchar buf[16384];
+    StreamBase *stream = new StreamBase;
+    ProtocolListIterator *iter;
+    quint64 bytes = 0;
+
+    stream->protoDataCopyFrom(config);
+
+    {
+        Benchmark b(name, "frameValue");
+
+        for (int i = 0; i < frames; i++)
+            bytes += stream->frameValue(buf, sizeof(buf), i);
+        b.done(frames);
+    }
+
+    {
+        Benchmark b(name, "frameVariableCount");
+        int count = 0;
+
+        for (int i = 0; i < frames; i++)
+            count += stream->frameVariableCount();
+        b.done(frames);
+        Q_UNUSED(count);
+    }
+
+    iter = stream->createProtocolListIterator();
+    while (iter->hasNext())
+    {
+        AbstractProtocol *proto = iter->next();
+        AbstractProtocol::CksumType type;
+        quint32 cksum = 0;
+        const char *method;
+
+        switch (proto->protocolNumber())
+        {
+        case OstProto::Protocol::kIp4FieldNumber:
+            type = AbstractProtocol::CksumIp;
+            method = "protocolFrameCksum(ip)";
+            break;
+        case OstProto::Protocol::kTcpFieldNumber:
+        case OstProto::Protocol::kUdpFieldNumber:
+            type = AbstractProtocol::CksumTcpUdp;
+            method = "protocolFrameCksum(l4)";
+            break;
+        default:
+            continue;
+        }
+
+        Benchmark b(name, method);
+        for (int i = 0; i < frames; i++)
+            cksum += proto->protocolFrameCksum(i, type);
+        b.done(frames);
+        Q_UNUSED(cksum);
+    }
+    delete iter;
+
+    {
+        NullPort port;
+        OstProto::Port portConfig;
+        int rounds = qMax(frames / int(config.control().num_packets()), 1);
+
+        port.addStream(stream);
+        foreach (OstProto::TransmitMode mode, QList<OstProto::TransmitMode>()
+                    << OstProto::kSequentialTransmit
+                    << OstProto::kInterleavedTransmit)
+        {
+            Benchmark b(name, mode == OstProto::kSequentialTransmit ? 
+                    "updatePacketListSeq" : "updatePacketListIntl");
+            quint64 packets = 0;
+
+            portConfig.set_transmit_mode(mode);
+            port.modify(portConfig);
+            for (int i = 0; i < rounds; i++)
+            {
+                port.updatePacketList();
+                packets += port.packets();
+            }
+            b.done(packets);
+        }
+        port.deleteStream(stream->id());
+    }
+
+    if (!bytes)
+        printf("%s: no frames generated\n", name);
+}
+
+int testFrameBench(int argc, char* argv[])
+{
+    QList<QPair<QString, OstProto::Stream> > configs = streamConfigs();
+    int frames = 100000;
+
+    if (argc > 3)
+    {
+        printf("usage:\n");
+        printf("%s framebench [frames]\n", argv[0]);
+        return 255;
+    }
+
+    if (argc == 3)
+        frames = qMax(atoi(argv[2]), 1);
+
+    printf("frames per benchmark = %d\n", frames);
+    for (int i = 0; i < configs.size(); i++)
+        benchStream(configs.at(i).first.toAscii().constData(), 
+                configs.at(i).second, frames);
+
+    return 0;
+}
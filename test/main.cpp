@@ -1,4 +1,6 @@
 
+#include "framebench.h"
+#include "txbench.h"
 #include "ostprotolib.h"
 #include "pcapfileformat.h"
 #include "protocol.pb.h"
@@ -26,6 +28,8 @@ int usage(int /*argc*/, char* argv[])
     printf("%s <command>\n", argv[0]);
     printf("command -\n");
     printf("  importpcap\n");
+    printf("  framebench\n");
+    printf("  txbench\n");
 
     return 255;
 }
@@ -100,6 +104,10 @@ int main(int argc, char* argv[])
         exitCode = usage(argc, argv);
     else if (strcmp(argv[1],"importpcap") == 0)
         exitCode = testImportPcap(argc, argv);
+    else if (strcmp(argv[1],"framebench") == 0)
+        exitCode = testFrameBench(argc, argv);
+    else if (strcmp(argv[1],"txbench") == 0)
+        exitCode = testTxBench(argc, argv);
     else
         exitCode = usage(argc, argv);
 
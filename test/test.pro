@@ -1,7 +1,7 @@
 TEMPLATE = app
 CONFIG += qt console
 QT += xml network script
-INCLUDEPATH += "../rpc/" "../common/" "../client"
+INCLUDEPATH += "../rpc/" "../common/" "../client" "../server"
 win32 {
     LIBS += -lwpcap -lpacket
     CONFIG(debug, debug|release) {
@@ -31,8 +31,18 @@ win32 {
 LIBS += -lprotobuf
 LIBS += -L"../extra/qhexedit2/$(OBJECTS_DIR)/" -lqhexedit2
 
-HEADERS += 
-SOURCES += main.cpp
+HEADERS += framebench.h txbench.h
+SOURCES += main.cpp framebench.cpp txbench.cpp
+
+# for the framebench null port
+HEADERS += ../server/abstractport.h ../server/packetproducer.h
+SOURCES += ../server/abstractport.cpp ../server/packetproducer.cpp
+
+# for the txbench tx ring, sendmmsg and AF_XDP
+HEADERS += ../server/linuxtxmmsg.h ../server/linuxtxring.h \
+    ../server/linuxxsk.h
+SOURCES += ../server/linuxtxmmsg.cpp ../server/linuxtxring.cpp \
+    ../server/linuxxsk.cpp
 
 QMAKE_DISTCLEAN += object_script.*
 
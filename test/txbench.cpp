@@ -0,0 +1,177 @@
+/*
+Copyright (C) 2014 Srivats P.
+
+This file is part of "Ostinato"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "txbench.h"
+
+#include <QtGlobal>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+  Transmit micro-benchmark for Linux
+
+  Sends the same packet count times on an interface - first with one
+  send() per packet on a packet socket (which is what pcap_sendpacket()
+  does), then via the TPACKET transmit ring, batched with sendmmsg() and
+  via an AF_XDP socket (preloaded, so without any copy) - and reports
+  the rate. AF_XDP uses copy mode on a veth.
+  Needs root; use a veth pair to benchmark without a NIC e.g.
+
+    ip link add vbench0 type veth peer name vbench1
+    ip link set vbench0 up; ip link set vbench1 up
+    test txbench vbench0
+*/
+
+#ifdef Q_OS_LINUX
+
+#include "linuxtxmmsg.h"
+#include "linuxtxring.h"
+#include "linuxxsk.h"
+
+#include <QElapsedTimer>
+
+#include <errno.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/if_packet.h>
+
+static void report(const char *method, int count, qint64 nsecs)
+{
+    printf("%-8s %10d pkts %10.3f ms %12.0f pps\n", method, count,
+            nsecs/1e6, nsecs ? count*1e9/nsecs : 0.0);
+}
+
+static int benchSend(const char *device, const uchar *pkt, int len, 
+        int count)
+{
+    QElapsedTimer timer;
+    struct sockaddr_ll addr;
+    int fd;
+
+    fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0)
+        goto _error;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = if_nametoindex(device);
+    if (!addr.sll_ifindex 
+            || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+        goto _error;
+
+    timer.start();
+    for (int i = 0; i < count; i++)
+    {
+        while (send(fd, pkt, len, 0) < 0)
+        {
+            if (errno != ENOBUFS && errno != EAGAIN)
+                goto _error;
+        }
+    }
+    report("send", count, timer.nsecsElapsed());
+
+    close(fd);
+    return 0;
+
+_error:
+    printf("send: %s\n", strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    return 1;
+}
+
+static int benchQueue(const char *method, LinuxTxQueue *queue,
+        const char *device, const uchar *pkt, int len, int count)
+{
+    QElapsedTimer timer;
+
+    if (!queue->open(device))
+    {
+        printf("%s: unable to open\n", method);
+        return 1;
+    }
+
+    queue->preload(pkt, len);
+
+    timer.start();
+    for (int i = 0; i < count; i++)
+    {
+        if (queue->send(pkt, len) < 0)
+        {
+            printf("%s: send failed for packet %d\n", method, i);
+            return 1;
+        }
+    }
+    queue->flush();
+    report(method, count, timer.nsecsElapsed());
+
+    queue->close();
+    return 0;
+}
+
+int testTxBench(int argc, char* argv[])
+{
+    LinuxTxRing ring;
+    LinuxTxMmsg mmsg;
+    LinuxXsk xsk;
+    uchar pkt[1514];
+    int count = 1000000;
+    int len = 64;
+    int ret = 0;
+
+    if (argc < 3)
+    {
+        printf("usage:\n");
+        printf("%s txbench <interface> [count] [length]\n", argv[0]);
+        return 255;
+    }
+
+    if (argc > 3)
+        count = atoi(argv[3]);
+    if (argc > 4)
+        len = qBound(14, atoi(argv[4]), int(sizeof(pkt)));
+
+    // Broadcast ethernet frame with a local experimental ethertype
+    memset(pkt, 0, sizeof(pkt));
+    memset(pkt, 0xff, 6);
+    pkt[6] = 0x02;
+    pkt[12] = 0x88;
+    pkt[13] = 0xb5;
+
+    ret |= benchSend(argv[2], pkt, len, count);
+    ret |= benchQueue("ring", &ring, argv[2], pkt, len, count);
+    ret |= benchQueue("sendmmsg", &mmsg, argv[2], pkt, len, count);
+    ret |= benchQueue("xsk", &xsk, argv[2], pkt, len, count);
+
+    return ret;
+}
+
+#else
+
+int testTxBench(int /*argc*/, char* /*argv*/[])
+{
+    printf("txbench is supported only on Linux\n");
+    return 1;
+}
+
+#endif